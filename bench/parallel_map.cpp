@@ -0,0 +1,74 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <thread>
+#include "parallel.h"
+#include "scheme.h"
+
+// Time of parallel-map with a pool of workers against the same map run in the calling
+// thread. The coarse map makes a few expensive calls per worker, the fine one many cheap
+// calls, which only the chunking keeps from being slower than the serial run.
+
+namespace {
+
+constexpr size_t kRepeats = 3;
+
+struct Case {
+    const char* name;
+    const char* expr;
+};
+
+constexpr Case kCases[] = {
+    {"coarse: 256 x (fib 20)", "(parallel-for-each (lambda (x) (fib 20)) coarse)"},
+    {"fine: 200000 x (* x x)", "(parallel-for-each (lambda (x) (* x x)) fine)"},
+    {"fine, results copied back", "(parallel-map (lambda (x) (* x x)) fine)"},
+};
+
+// Best of kRepeats runs, in seconds.
+double Time(Interpreter& interpreter, const std::string& expr) {
+    double best = std::numeric_limits<double>::max();
+    for (size_t i = 0; i < kRepeats; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        interpreter.Run(expr);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+}  // namespace
+
+// Usage: parallel_map [workers], one per core by default
+int main(int argc, char** argv) {
+    size_t workers = std::max(1u, std::thread::hardware_concurrency());
+    if (argc > 1) {
+        std::string_view arg = argv[1];
+        std::from_chars(arg.data(), arg.data() + arg.size(), workers);
+    }
+
+    Interpreter interpreter;
+    interpreter.Run("(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))");
+    interpreter.Run("(define (range n acc) (if (= n 0) acc (range (- n 1) (cons n acc))))");
+    interpreter.Run("(define coarse (range 256 '()))");
+    interpreter.Run("(define fine (range 200000 '()))");
+
+    // A single worker runs maps in the calling thread. The pool is started by the first
+    // parallel map, with the count set then.
+    double serial[std::size(kCases)];
+    SetWorkersCount(1);
+    for (size_t i = 0; i < std::size(kCases); ++i) {
+        serial[i] = Time(interpreter, kCases[i].expr);
+    }
+    SetWorkersCount(workers);
+    std::printf("%zu workers, %u cores\n", workers, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < std::size(kCases); ++i) {
+        double parallel = Time(interpreter, kCases[i].expr);
+        std::printf("%-28s serial %8.3f s  parallel %8.3f s  speedup %5.2fx\n", kCases[i].name,
+                    serial[i], parallel, serial[i] / parallel);
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include "parser.h"
+#include "scheme.h"
+
+// Read throughput on a generated corpus of quoted lists of fixnums, flonums and symbols
+// nested a few levels deep, like generated data files: through a tokenizer over the whole
+// input, as Interpreter::Run reads, and through StreamReader, as scripts are read.
+
+namespace {
+
+constexpr size_t kDefaultSizeMb = 100;
+constexpr size_t kMaxDepth = 8;
+// Forms read between two safepoints, which collect the ones read before.
+constexpr size_t kFormsPerBatch = 256;
+
+void AppendDatum(std::mt19937& random, size_t depth, std::string* out);
+
+void AppendList(std::mt19937& random, size_t depth, std::string* out) {
+    size_t count = 1 + random() % 5;
+    out->push_back('(');
+    for (size_t i = 0; i < count; ++i) {
+        if (i > 0) {
+            out->push_back(' ');
+        }
+        AppendDatum(random, depth - 1, out);
+    }
+    out->push_back(')');
+}
+
+void AppendDatum(std::mt19937& random, size_t depth, std::string* out) {
+    size_t kind = random() % 10;
+    if (depth > 0 && kind < 3) {
+        AppendList(random, depth, out);
+    } else if (kind < 6) {
+        *out += std::to_string(static_cast<int>(random() % 2000001) - 1000000);
+    } else if (kind < 8) {
+        *out += std::to_string(random() % 1000) + '.' + std::to_string(10 + random() % 90);
+    } else {
+        *out += "sym" + std::to_string(random() % 1000);
+    }
+}
+
+std::string MakeCorpus(size_t size) {
+    std::mt19937 random{42};
+    std::string corpus;
+    while (corpus.size() < size) {
+        corpus += "(quote ";
+        AppendList(random, kMaxDepth, &corpus);
+        corpus += ")\n";
+    }
+    return corpus;
+}
+
+// Reads forms with read_form until is_end, returns the number of forms and prints the rate.
+void ReadAll(Interpreter& interpreter, const char* name, size_t size,
+             const std::function<bool()>& is_end, const std::function<void()>& read_form) {
+    auto start = std::chrono::steady_clock::now();
+    size_t forms = 0;
+    while (!is_end()) {
+        interpreter.Enter([&](ScopePtr) {
+            for (size_t i = 0; i < kFormsPerBatch && !is_end(); ++i) {
+                read_form();
+                ++forms;
+            }
+        });
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::printf("%-14s %zu forms in %6.3f s, %7.1f MB/s\n", name, forms, elapsed.count(),
+                size / 1e6 / elapsed.count());
+}
+
+}  // namespace
+
+// Usage: read_throughput [size of the corpus in MB]
+int main(int argc, char** argv) {
+    size_t size_mb = kDefaultSizeMb;
+    if (argc > 1) {
+        std::string_view arg = argv[1];
+        std::from_chars(arg.data(), arg.data() + arg.size(), size_mb);
+    }
+    std::string corpus = MakeCorpus(size_mb << 20);
+    std::printf("corpus of %.1f MB\n", corpus.size() / 1e6);
+
+    Interpreter interpreter;
+    Tokenizer tokenizer{corpus};
+    ReadAll(
+        interpreter, "tokenizer", corpus.size(), [&] { return tokenizer.IsEnd(); },
+        [&] { Read(&tokenizer); });
+
+    std::istringstream in{corpus};
+    StreamReader reader{&in};
+    ReadAll(
+        interpreter, "stream reader", corpus.size(), [&] { return reader.IsEnd(); },
+        [&] { reader.ReadForm(); });
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include "lib.h"
+#include "number.h"
+#include "scheme.h"
+
+// Cost of the argument checks of + by the type tag, against dynamic_cast which Is and As
+// were before, and of whole calls of + which check their arguments that way.
+
+namespace {
+
+constexpr size_t kArgs = 8;
+constexpr size_t kChecks = 20'000'000;
+// Calls which allocate their result run in batches, with a collection between two.
+constexpr size_t kBatches = 100;
+constexpr size_t kCallsPerBatch = 20'000;
+
+// Nanoseconds per run of body, which runs count times.
+double Time(size_t count, const std::function<void()>& body) {
+    auto start = std::chrono::steady_clock::now();
+    body();
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / count;
+}
+
+bool CheckFlonumsWithDynamicCast(const Args& args) {
+    for (ObjectPtr arg : args) {
+        if (dynamic_cast<Flonum*>(arg) == nullptr) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+int main() {
+    Interpreter interpreter;
+    Args fixnums;
+    Args flonums;
+    interpreter.Enter([&](ScopePtr) {
+        for (size_t i = 0; i < kArgs; ++i) {
+            fixnums.push_back(Number::Make(i));
+            flonums.push_back(runtime::NewTenured<Flonum>(i + 0.5));
+            GC::GetCurrent().AddRoot(flonums.back());
+        }
+    });
+
+    // Keeps the checks from being optimized away.
+    volatile size_t passed = 0;
+    std::printf("argument checks of %zu arguments, ns per call\n", kArgs);
+    std::printf("  dynamic_cast<Flonum*>, flonums   %6.2f\n", Time(kChecks, [&] {
+                    for (size_t i = 0; i < kChecks; ++i) {
+                        passed = passed + CheckFlonumsWithDynamicCast(flonums);
+                    }
+                }));
+    std::printf("  CheckArgsType<Flonum>, flonums   %6.2f\n", Time(kChecks, [&] {
+                    for (size_t i = 0; i < kChecks; ++i) {
+                        passed = passed + CheckArgsType<Flonum>(flonums);
+                    }
+                }));
+    std::printf("  CheckArgsType<Number>, flonums   %6.2f\n", Time(kChecks, [&] {
+                    for (size_t i = 0; i < kChecks; ++i) {
+                        passed = passed + CheckArgsType<Number>(flonums);
+                    }
+                }));
+    std::printf("  CheckArgsType<Number>, fixnums   %6.2f\n", Time(kChecks, [&] {
+                    for (size_t i = 0; i < kChecks; ++i) {
+                        passed = passed + CheckArgsType<Number>(fixnums);
+                    }
+                }));
+
+    std::printf("calls of + with %zu arguments, ns per call\n", kArgs);
+    auto time_plus = [&](const Args& args) {
+        return Time(kBatches * kCallsPerBatch, [&] {
+            for (size_t batch = 0; batch < kBatches; ++batch) {
+                interpreter.Enter([&](ScopePtr) {
+                    Local<Procedure> plus{runtime::New<Plus>()};
+                    for (size_t i = 0; i < kCallsPerBatch; ++i) {
+                        passed = passed + (plus->Apply(args) != nullptr);
+                    }
+                });
+            }
+        });
+    };
+    std::printf("  fixnums                          %6.2f\n", time_plus(fixnums));
+    std::printf("  flonums                          %6.2f\n", time_plus(flonums));
+    return passed == 0;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "object.h"
+
+// Arbitrary-precision integer: sign and magnitude in base 2^32 limbs, least significant
+// first, without leading zero limbs. Zero is non-negative and has no limbs.
+class BigInteger {
+public:
+    BigInteger() = default;
+    explicit BigInteger(int64_t value);
+    // Parses an optionally signed decimal literal.
+    static BigInteger Parse(std::string_view text);
+
+    bool IsNegative() const {
+        return negative_;
+    }
+    bool IsZero() const {
+        return limbs_.empty();
+    }
+    // Stores the value into *value if it fits into int64_t.
+    bool ToInt64(int64_t* value) const;
+    // Nearest double, may be infinite.
+    double ToDouble() const;
+    std::string ToString() const;
+
+    BigInteger operator-() const;
+    friend BigInteger operator+(const BigInteger& lhs, const BigInteger& rhs);
+    friend BigInteger operator-(const BigInteger& lhs, const BigInteger& rhs);
+    // Karatsuba multiplication once both operands are long enough.
+    friend BigInteger operator*(const BigInteger& lhs, const BigInteger& rhs);
+    // Quotient truncated toward zero, rhs must not be zero.
+    friend BigInteger operator/(const BigInteger& lhs, const BigInteger& rhs);
+    friend std::strong_ordering operator<=>(const BigInteger& lhs, const BigInteger& rhs);
+    friend bool operator==(const BigInteger& lhs, const BigInteger& rhs) = default;
+    // Bytes allocated for the limbs.
+    size_t GetStorageSize() const {
+        return limbs_.capacity() * sizeof(uint32_t);
+    }
+
+private:
+    using Limbs = std::vector<uint32_t>;
+
+    BigInteger(bool negative, Limbs limbs);
+
+    bool negative_ = false;
+    Limbs limbs_;
+};
+
+// Integer outside the fixnum range. Results which fit into a fixnum are always demoted,
+// so every integer has a single representation.
+class Bignum : public Object {
+public:
+    static constexpr TypeRange kTypes = ObjectType::Bignum;
+
+    explicit Bignum(BigInteger value);
+    const BigInteger& GetValue() const {
+        return value_;
+    }
+    ObjectPtr Eval() override {
+        return this;
+    }
+    std::string ToString() override {
+        return value_.ToString();
+    }
+    size_t GetExternalSize() const override {
+        return value_.GetStorageSize();
+    }
+
+private:
+    BigInteger value_;
+};
+
+// Integer with the given value, demoted to a fixnum if it fits.
+ObjectPtr MakeInteger(const BigInteger& value);
+BigInteger ToBigInteger(ObjectPtr integer);
+
+inline ObjectPtr MakeInteger(int64_t value) {
+    if (Number::Fits(value)) {
+        return Number::Make(value);
+    }
+    return MakeInteger(BigInteger{value});
+}
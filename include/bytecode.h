@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "object.h"
+
+enum class OpCode : uint8_t {
+    Const,            // push constant[arg]
+    Nil,              // push ()
+    Local,            // push slot arg of the frame depth levels up
+    CheckedLocal,     // same as Local, falls into the next Raise if the slot is unbound
+    SetLocal,         // pop into slot arg of the frame depth levels up
+    Global,           // push global variable named by constant[arg]
+    SetGlobal,        // pop into existing global variable named by constant[arg]
+    DefineGlobal,     // pop into global variable named by constant[arg]
+    DeepCopy,         // replace top with its deep copy
+    Future,           // replace the closure on top with a future running it
+    Pop,              // drop top
+    Jump,             // go to arg
+    JumpIfFalse,      // pop, go to arg if value is false
+    JumpIfFalseKeep,  // go to arg if top is false, pop it otherwise
+    JumpIfTrueKeep,   // go to arg if top is true, pop it otherwise
+    Closure,          // push closure of prototype constant[arg] over the current frame
+    Call,             // call function below arg arguments
+    TailCall,         // same as Call, but reuses the current call frame
+    Return,           // pop result and leave the current call frame
+    Raise,            // throw error[arg] of kind depth
+};
+
+struct Instruction {
+    OpCode op;
+    uint16_t depth;
+    uint32_t arg;
+};
+
+enum class ErrorKind : uint16_t { Syntax, Runtime, Name };
+
+// Throws the exception of the kind.
+[[noreturn]] void Raise(ErrorKind kind, const std::string& message);
+
+// Compiled body of a lambda or a top-level expression.
+class Prototype : public Object {
+public:
+    static constexpr TypeRange kTypes = ObjectType::Prototype;
+
+    explicit Prototype(size_t params_count);
+
+    size_t Emit(OpCode op, uint32_t arg = 0, uint16_t depth = 0);
+    void Patch(size_t index, uint32_t arg);
+    void Truncate(size_t size);
+    uint32_t AddConstant(ObjectPtr obj);
+    uint32_t AddError(const std::string& message);
+
+    size_t Size() const {
+        return code_.size();
+    }
+    const Instruction* GetCode() const {
+        return code_.data();
+    }
+    const ObjectPtr* GetConstants() const {
+        return constants_.data();
+    }
+    size_t GetConstantsCount() const {
+        return constants_.size();
+    }
+    const std::string& GetError(size_t index) const {
+        return errors_[index];
+    }
+    size_t GetErrorsCount() const {
+        return errors_.size();
+    }
+    size_t GetParamsCount() const {
+        return params_count_;
+    }
+    size_t GetSlotsCount() const {
+        return slots_count_;
+    }
+    void SetSlotsCount(size_t slots_count) {
+        slots_count_ = slots_count;
+    }
+
+    ObjectPtr Eval() override {
+        return this;
+    }
+    std::string ToString() override {
+        return "prototype";
+    }
+    void Trace(Tracer& tracer) override {
+        TraceParts(tracer, 0, constants_.size());
+    }
+    // Parts are constants.
+    size_t GetTraceParts() const override {
+        return constants_.size();
+    }
+    void TraceParts(Tracer& tracer, size_t begin, size_t end) override {
+        for (size_t i = begin; i < end; ++i) {
+            tracer(constants_[i]);
+        }
+    }
+    size_t GetExternalSize() const override {
+        return code_.capacity() * sizeof(Instruction) +
+               constants_.capacity() * sizeof(ObjectPtr) +
+               errors_.capacity() * sizeof(std::string);
+    }
+
+private:
+    std::vector<Instruction> code_;
+    std::vector<ObjectPtr> constants_;
+    std::vector<std::string> errors_;
+    size_t params_count_;
+    size_t slots_count_;
+};
+
+using PrototypePtr = Prototype*;
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "bytecode.h"
+#include "object.h"
+#include "resolver.h"
+#include "scope.h"
+
+// Lowers AST produced by Read into bytecode for VirtualMachine.
+// Head symbol is compiled as a special form if it is not shadowed by a local variable
+// and the global scope binds it to a SpecialForm.
+class Compiler {
+public:
+    explicit Compiler(GlobalScopePtr global_scope);
+
+    // Compiles top-level expression into a prototype without parameters.
+    PrototypePtr Compile(ObjectPtr ast);
+
+private:
+    void CompileExpr(ObjectPtr expr, bool tail);
+    void CompileSymbol(SymbolPtr symbol);
+    void CompileCombination(CellPtr form, bool tail);
+    void CompileCall(CellPtr form, bool tail);
+    void CompileQuote(ObjectPtr args);
+    void CompileIf(ObjectPtr args, bool tail);
+    void CompileDefine(ObjectPtr args);
+    void CompileSet(ObjectPtr args);
+    void CompileLambda(ObjectPtr args);
+    void CompileFuture(ObjectPtr args);
+    void CompileLogical(ObjectPtr args, bool tail, bool is_and);
+    PrototypePtr CompileProcedure(const std::vector<SymbolPtr>& params, ObjectPtr body);
+    void EmitDefine(SymbolPtr name);
+    void EmitRaise(size_t start, ErrorKind kind, const std::string& message);
+
+    GlobalScopePtr global_scope_;
+    PrototypePtr proto_ = nullptr;
+    FrameLayout* layout_ = nullptr;
+};
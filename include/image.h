@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "scope.h"
+
+// Heap images.
+// An image holds everything reachable from the bindings of a global scope: closures,
+// their code and scopes, lists, vectors and numbers. References are stored as indices,
+// symbols by name and builtins by type, so an image is relocatable and can be loaded by
+// any process running the same build.
+
+void SaveImage(GlobalScopePtr global_scope, const std::string& path);
+
+// Defines the bindings of the image in global_scope, which must have the builtins of
+// CreateGlobalScope. The file is mapped into memory, then its objects are allocated in
+// one pass and their references are fixed up in a second one.
+void LoadImage(GlobalScopePtr global_scope, const std::string& path);
+
+class ImageWriter;
+class ImageLoader;
+struct Task;
+
+// Images in memory, to copy objects into the heap of another interpreter, e.g. one on
+// another thread. References to the global scope of the writer become references to the
+// global scope of the reader. Frozen objects are referred to rather than copied, so the
+// reader must keep their environment alive. Futures are copied without waiting: a copy
+// shares the task of the original, which comes with the image.
+
+struct ObjectsImage {
+    std::string data;
+    std::vector<std::shared_ptr<Task>> tasks;
+};
+
+class ObjectsWriter {
+public:
+    explicit ObjectsWriter(GlobalScopePtr global_scope);
+    ~ObjectsWriter();
+
+    // Adds the bindings of the global scope, the reader defines them in its own, and the
+    // copies of frozen scopes changed by the interpreter, see ScopeStack::Shadow.
+    void AddBindings();
+    // Adds only the bindings which code reachable from roots may use, e.g. to run roots
+    // in another interpreter.
+    void AddBindings(const Args& roots);
+    // Adds obj and everything reachable from it, except the global scope.
+    void Add(ObjectPtr obj);
+    ObjectsImage Finish();
+
+private:
+    void AddShadows();
+
+    GlobalScopePtr global_scope_;
+    std::unique_ptr<ImageWriter> writer_;
+};
+
+class ObjectsReader {
+public:
+    // The image must outlive the reader.
+    ObjectsReader(GlobalScopePtr global_scope, const ObjectsImage& image);
+    ~ObjectsReader();
+
+    bool IsEnd() const;
+    // Defines bindings added by AddBindings in the global scope and gives the interpreter
+    // the copies of frozen scopes. They go straight to the old generation.
+    void ReadBindings();
+    // Copy of the next object added by Add, rooted until the next read.
+    ObjectPtr Read();
+
+private:
+    std::unique_ptr<ImageLoader> loader_;
+};
+
+// Code caches.
+// A code cache holds the parsed top-level forms of a source in the image format, keyed
+// by the build of the interpreter and the size and the hash of the source, so running it
+// again skips tokenizing and parsing. Forms are cached rather than compiled code:
+// compiling depends on the global bindings at the time each form runs.
+
+uint64_t HashSource(std::string_view source);
+
+// Appends the forms of the cache at path to forms, which the caller roots. All of them are
+// loaded before any may run. Returns false and leaves forms empty if there is no cache for
+// source, or if it was written by another build or is damaged.
+bool ReadCodeCache(GlobalScopePtr global_scope, const std::string& path,
+                   std::string_view source, Args* forms);
+
+class CodeCacheWriter {
+public:
+    explicit CodeCacheWriter(std::string_view source);
+    ~CodeCacheWriter();
+
+    // Forms must be added before evaluating them, evaluation may change quoted data.
+    void Add(ObjectPtr form);
+    // Replaces the file at path atomically.
+    void Save(const std::string& path);
+
+private:
+    uint64_t source_size_;
+    uint64_t source_hash_;
+    std::unique_ptr<ImageWriter> writer_;
+};
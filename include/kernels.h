@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "object.h"
+
+// Bulk kernels over the contiguous storage of vectors.
+// Fixnum kernels read the tagged words directly: tagging is monotonic, so words compare
+// like their values. Flonum kernels work on doubles unboxed into a plain array. Every
+// kernel has an AVX2 version chosen at run time when the CPU supports it and a scalar one.
+// Reductions of doubles sum lanes separately, so they may round differently from a
+// left-to-right fold.
+namespace kernels {
+
+enum class CompareOp { Equal, Less, Greater, LessEq, GreaterEq };
+
+// Disabling forces the scalar versions, e.g. to compare results.
+void SetSimdEnabled(bool enabled);
+bool IsSimdEnabled();
+
+// Whether every word is a fixnum.
+bool AllFixnums(const ObjectPtr* data, size_t size);
+
+// Exact sum of the values of fixnums, size must be below 2^32.
+__int128 SumFixnums(const ObjectPtr* data, size_t size);
+// Smallest and largest fixnum, size must be positive.
+ObjectPtr MinFixnum(const ObjectPtr* data, size_t size);
+ObjectPtr MaxFixnum(const ObjectPtr* data, size_t size);
+// Element-wise sums of fixnums. Returns false if some sum doesn't fit into a fixnum,
+// out is unspecified then.
+bool AddFixnums(const ObjectPtr* lhs, const ObjectPtr* rhs, ObjectPtr* out, size_t size);
+// out[i] is 1 if op holds for lhs[i] and rhs[i], 0 otherwise.
+void CompareFixnums(const ObjectPtr* lhs, const ObjectPtr* rhs, uint8_t* out, size_t size,
+                    CompareOp op);
+
+double SumDoubles(const double* data, size_t size);
+double DotDoubles(const double* lhs, const double* rhs, size_t size);
+// Size must be positive. NaN if any element is NaN.
+double MinDouble(const double* data, size_t size);
+double MaxDouble(const double* data, size_t size);
+void AddDoubles(const double* lhs, const double* rhs, double* out, size_t size);
+void ScaleDoubles(const double* data, double factor, double* out, size_t size);
+// Comparisons involving NaN are false.
+void CompareDoubles(const double* lhs, const double* rhs, uint8_t* out, size_t size,
+                    CompareOp op);
+
+}  // namespace kernels
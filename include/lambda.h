@@ -1,26 +1,96 @@
 #pragma once
 
 #include <string>
+#include <utility>
 #include <vector>
 #include "object.h"
+#include "resolver.h"
 #include "scope.h"
 
-class LambdaFunction : public Function {
+// Lambda with the body resolved for its frame layout. Evaluating (template) creates
+// a closure over the current scope, so nested lambdas are resolved only once.
+class LambdaTemplate : public SpecialForm {
 public:
-    LambdaFunction(const std::vector<std::string>& params, ObjectPtr body, ScopePtr scope);
+    static constexpr TypeRange kTypes = ObjectType::LambdaTemplate;
+
+    LambdaTemplate(const std::vector<SymbolPtr>& params, ObjectPtr body,
+                   const FrameLayout* parent, GlobalScopePtr global_scope);
+    // Template with a resolved body, e.g. restored from a heap image.
+    LambdaTemplate(FrameLayout layout, ObjectPtr body);
     ObjectPtr operator()(ObjectPtr) override;
+    const FrameLayout& GetLayout() const {
+        return layout_;
+    }
+    ObjectPtr GetBody() const {
+        return body_;
+    }
     std::string ToString() override {
-        return "lambda_func";
+        return "lambda";
+    }
+    void Trace(Tracer& tracer) override {
+        tracer(body_);
+    }
+    size_t GetExternalSize() const override {
+        return layout_.names.capacity() * sizeof(SymbolPtr);
     }
 
 private:
-    std::vector<std::string> params_;
+    FrameLayout layout_;
     ObjectPtr body_;
+};
+
+using LambdaTemplatePtr = LambdaTemplate*;
+
+class LambdaFunction : public Procedure {
+public:
+    static constexpr TypeRange kTypes = ObjectType::LambdaFunction;
+
+    LambdaFunction(LambdaTemplatePtr lambda, ScopePtr scope);
+    ObjectPtr Apply(const Args&) override;
+    bool EvalTail(ObjectPtr args, ScopeGuard& frame, ObjectPtr& res) override;
+    LambdaTemplatePtr GetTemplate() const {
+        return template_;
+    }
+    ScopePtr GetScope() const {
+        return captured_scope_;
+    }
+    std::string ToString() override {
+        return "lambda_func";
+    }
+    void Trace(Tracer& tracer) override {
+        tracer(template_);
+        tracer(captured_scope_);
+    }
+
+private:
+    FramePtr MakeFrame(const Args& args);
+    // Evaluates the body except its last form in the current scope, returns the last form.
+    ObjectPtr EvalLeadingForms();
+
+    LambdaTemplatePtr template_;
     ScopePtr captured_scope_;
 };
 
-class Lambda : public Function {
+template <>
+inline constexpr bool kOwnsStorage<LambdaFunction> = false;
+
+struct LambdaSyntax {
+    std::vector<SymbolPtr> params;
+    ObjectPtr body;
+};
+
+// Parses ((params...) body...) part of the lambda form.
+LambdaSyntax ParseLambda(ObjectPtr obj);
+
+// Parses ((name params...) body...) part of the define form.
+std::pair<SymbolPtr, LambdaSyntax> ParseDefineLambda(ObjectPtr obj);
+
+class Lambda : public SpecialForm {
 public:
+    static constexpr TypeRange kTypes = ObjectType::Lambda;
+
+    Lambda() : SpecialForm(ObjectType::Lambda) {
+    }
     ObjectPtr operator()(ObjectPtr args) override;
     std::string ToString() override {
         return "lambda";
@@ -1,23 +1,30 @@
 #pragma once
 
 #include <algorithm>
+#include <cmath>
 #include <cstddef>
 #include <functional>
 #include <limits>
+#include "kernels.h"
+#include "number.h"
 #include "object.h"
 #include "runtime.h"
 
-class Quote : public Function {
+class Quote : public SpecialForm {
 public:
+    static constexpr TypeRange kTypes = ObjectType::Quote;
+
+    Quote() : SpecialForm(ObjectType::Quote) {
+    }
     ObjectPtr operator()(ObjectPtr) override;
     std::string ToString() override {
         return "'";
     }
 };
 
-class NumPredicate : public Function {
+class NumPredicate : public Procedure {
 public:
-    ObjectPtr operator()(ObjectPtr) override;
+    ObjectPtr Apply(const Args&) override;
     std::string ToString() override {
         return "number?";
     }
@@ -32,32 +39,43 @@ struct ReturnType<R(Args...)> {
 };
 
 template <typename bin_op, size_t min_cnt = 0, size_t max_cnt = kMaxArgs, int init = 1>
-class Folder : public Function {
-    ObjectPtr operator()(ObjectPtr obj) override {
-        auto args = GetSafeArgs<true, Number>(obj, min_cnt, max_cnt);
+class Folder : public Procedure {
+    ObjectPtr Apply(const Args& args) override {
+        EnsureArgs<true, Number>(args, min_cnt, max_cnt);
         bin_op func;
-        using RetType = decltype(func(0, 0));
+        using RetType = decltype(func(ObjectPtr{}, ObjectPtr{}));
         if constexpr (std::is_same_v<RetType, bool>) {
             bool res = init;
             for (size_t i = 1; i < args.size(); ++i) {
-                if (!func(As<Number>(args[i - 1])->GetValue(), As<Number>(args[i])->GetValue())) {
+                bool holds = Is<Flonum>(args[i - 1]) || Is<Flonum>(args[i])
+                                 ? func(ToDouble(args[i - 1]), ToDouble(args[i]))
+                                 : func(args[i - 1], args[i]);
+                if (!holds) {
                     res = false;
                 }
             }
-            return runtime::New<Symbol>(res);
+            return Symbol::Boolean(res);
         } else {
-            int res;
+            Local<Object> res;
             size_t start_index = 0;
-            if constexpr (min_cnt >= 2) {
-                res = func(As<Number>(args[0])->GetValue(), As<Number>(args[1])->GetValue());
-                start_index = 2;
+            if constexpr (min_cnt >= 1) {
+                res = args[0];
+                start_index = 1;
             } else {
-                res = init;
+                res = Number::Make(init);
             }
             for (size_t i = start_index; i < args.size(); ++i) {
-                res = func(res, As<Number>(args[i])->GetValue());
+                if (Is<Flonum>(res) || Is<Flonum>(args[i])) {
+                    // The rest of the fold is inexact: accumulate unboxed, box only the result.
+                    double acc = ToDouble(res);
+                    for (; i < args.size(); ++i) {
+                        acc = func(acc, ToDouble(args[i]));
+                    }
+                    return runtime::New<Flonum>(acc);
+                }
+                res = func(res, args[i]);
             }
-            return runtime::New<Number>(res);
+            return res;
         }
     }
     std::string ToString() override {
@@ -66,74 +84,117 @@ class Folder : public Function {
 };
 
 // Compare Numbers
-using Equal = Folder<std::equal_to<int>>;
-using Greater = Folder<std::greater<int>>;
-using Less = Folder<std::less<int>>;
-using GreaterEq = Folder<std::greater_equal<int>>;
-using LessEq = Folder<std::less_equal<int>>;
+
+// Applies the comparison, e.g. std::less<>, to the result of CompareNumbers and 0, or
+// directly to doubles when an operand is inexact, so NaN compares false.
+template <typename Compare>
+class CompareFunctor {
+public:
+    bool operator()(ObjectPtr lhs, ObjectPtr rhs) {
+        return Compare{}(CompareNumbers(lhs, rhs), 0);
+    }
+    bool operator()(double lhs, double rhs) {
+        return Compare{}(lhs, rhs);
+    }
+};
+
+using Equal = Folder<CompareFunctor<std::equal_to<>>>;
+using Greater = Folder<CompareFunctor<std::greater<>>>;
+using Less = Folder<CompareFunctor<std::less<>>>;
+using GreaterEq = Folder<CompareFunctor<std::greater_equal<>>>;
+using LessEq = Folder<CompareFunctor<std::less_equal<>>>;
 
 // Calc Numbers
-using Plus = Folder<std::plus<int>, 0, kMaxArgs, 0>;
-using Minus = Folder<std::minus<int>, 2, kMaxArgs, 0>;
-using Multiply = Folder<std::multiplies<int>, 0, kMaxArgs, 1>;
-using Div = Folder<std::divides<int>, 2, kMaxArgs, 0>;
+
+// Op on exact operands, DoubleOp on unboxed inexact ones.
+template <ObjectPtr (*Op)(ObjectPtr, ObjectPtr), typename DoubleOp>
+class ArithmeticFunctor {
+public:
+    ObjectPtr operator()(ObjectPtr lhs, ObjectPtr rhs) {
+        return Op(lhs, rhs);
+    }
+    double operator()(double lhs, double rhs) {
+        return DoubleOp{}(lhs, rhs);
+    }
+};
+
+using Plus = Folder<ArithmeticFunctor<AddNumbers, std::plus<>>, 0, kMaxArgs, 0>;
+using Minus = Folder<ArithmeticFunctor<SubtractNumbers, std::minus<>>, 2, kMaxArgs, 0>;
+using Multiply = Folder<ArithmeticFunctor<MultiplyNumbers, std::multiplies<>>, 0, kMaxArgs, 1>;
+using Div = Folder<ArithmeticFunctor<DivideNumbers, std::divides<>>, 2, kMaxArgs, 0>;
 
 // Special Functions
 
-template <typename T>
+// NaN wins over any number in min and max, vector-min and vector-max included, whatever
+// its position.
 class MaxFunctor {
 public:
-    T operator()(const T& lhs, const T& rhs) {
-        return std::max(lhs, rhs);
+    ObjectPtr operator()(ObjectPtr lhs, ObjectPtr rhs) {
+        return CompareNumbers(lhs, rhs) < 0 ? rhs : lhs;
+    }
+    double operator()(double lhs, double rhs) {
+        return std::isnan(rhs) || rhs > lhs ? rhs : lhs;
     }
 };
 
-template <typename T>
 class MinFunctor {
 public:
-    T operator()(const T& lhs, const T& rhs) {
-        return std::min(lhs, rhs);
+    ObjectPtr operator()(ObjectPtr lhs, ObjectPtr rhs) {
+        return CompareNumbers(rhs, lhs) < 0 ? rhs : lhs;
+    }
+    double operator()(double lhs, double rhs) {
+        return std::isnan(rhs) || rhs < lhs ? rhs : lhs;
     }
 };
 
-using Max = Folder<MaxFunctor<int>, 1, kMaxArgs, std::numeric_limits<int>::min()>;
-using Min = Folder<MinFunctor<int>, 1, kMaxArgs, std::numeric_limits<int>::max()>;
+using Max = Folder<MaxFunctor, 1>;
+using Min = Folder<MinFunctor, 1>;
 
-class Abs : public Function {
-    ObjectPtr operator()(ObjectPtr) override;
+class Abs : public Procedure {
+    ObjectPtr Apply(const Args&) override;
     std::string ToString() override {
         return "abs";
     }
 };
 
 // Boolean
-class BoolPredicate : public Function {
+class BoolPredicate : public Procedure {
 public:
-    ObjectPtr operator()(ObjectPtr) override;
+    ObjectPtr Apply(const Args&) override;
     std::string ToString() override {
         return "boolean?";
     }
 };
 
-class LogicalNot : public Function {
+class LogicalNot : public Procedure {
 public:
-    ObjectPtr operator()(ObjectPtr) override;
+    ObjectPtr Apply(const Args&) override;
     std::string ToString() override {
         return "not";
     }
 };
 
-class LogicalAnd : public Function {
+class LogicalAnd : public SpecialForm {
 public:
+    static constexpr TypeRange kTypes = ObjectType::LogicalAnd;
+
+    LogicalAnd() : SpecialForm(ObjectType::LogicalAnd) {
+    }
     ObjectPtr operator()(ObjectPtr) override;
+    bool EvalTail(ObjectPtr args, ScopeGuard& frame, ObjectPtr& res) override;
     std::string ToString() override {
         return "and";
     }
 };
 
-class LogicalOr : public Function {
+class LogicalOr : public SpecialForm {
 public:
+    static constexpr TypeRange kTypes = ObjectType::LogicalOr;
+
+    LogicalOr() : SpecialForm(ObjectType::LogicalOr) {
+    }
     ObjectPtr operator()(ObjectPtr) override;
+    bool EvalTail(ObjectPtr args, ScopeGuard& frame, ObjectPtr& res) override;
     std::string ToString() override {
         return "or";
     }
@@ -141,83 +202,225 @@ public:
 
 // List functions
 
-class PairPredicate : public Function {
+class PairPredicate : public Procedure {
 public:
-    ObjectPtr operator()(ObjectPtr) override;
+    ObjectPtr Apply(const Args&) override;
     std::string ToString() override {
         return "pair?";
     }
 };
 
-class NullPredicate : public Function {
+class NullPredicate : public Procedure {
 public:
-    ObjectPtr operator()(ObjectPtr) override;
+    ObjectPtr Apply(const Args&) override;
     std::string ToString() override {
         return "null?";
     }
 };
 
-class ListPredicate : public Function {
+class ListPredicate : public Procedure {
 public:
-    ObjectPtr operator()(ObjectPtr) override;
+    ObjectPtr Apply(const Args&) override;
     std::string ToString() override {
         return "list?";
     }
 };
 
-class PairCons : public Function {
+class PairCons : public Procedure {
 public:
-    ObjectPtr operator()(ObjectPtr) override;
+    ObjectPtr Apply(const Args&) override;
     std::string ToString() override {
         return "cons";
     }
 };
 
-class PairCar : public Function {
+class PairCar : public Procedure {
 public:
-    ObjectPtr operator()(ObjectPtr) override;
+    ObjectPtr Apply(const Args&) override;
     std::string ToString() override {
         return "car";
     }
 };
 
-class PairCdr : public Function {
+class PairCdr : public Procedure {
 public:
-    ObjectPtr operator()(ObjectPtr) override;
+    ObjectPtr Apply(const Args&) override;
     std::string ToString() override {
         return "cdr";
     }
 };
 
-class ListCtor : public Function {
+class ListCtor : public Procedure {
 public:
-    ObjectPtr operator()(ObjectPtr) override;
+    ObjectPtr Apply(const Args&) override;
     std::string ToString() override {
         return "list";
     }
 };
 
-class ListRef : public Function {
+class ListRef : public Procedure {
 public:
-    ObjectPtr operator()(ObjectPtr) override;
+    ObjectPtr Apply(const Args&) override;
     std::string ToString() override {
         return "list-ref";
     }
 };
 
-class ListTail : public Function {
+class ListTail : public Procedure {
 public:
-    ObjectPtr operator()(ObjectPtr) override;
+    ObjectPtr Apply(const Args&) override;
     std::string ToString() override {
         return "list-tail";
     }
 };
 
+// Vectors
+
+class VectorPredicate : public Procedure {
+public:
+    ObjectPtr Apply(const Args&) override;
+    std::string ToString() override {
+        return "vector?";
+    }
+};
+
+class MakeVector : public Procedure {
+public:
+    ObjectPtr Apply(const Args&) override;
+    std::string ToString() override {
+        return "make-vector";
+    }
+};
+
+class VectorCtor : public Procedure {
+public:
+    ObjectPtr Apply(const Args&) override;
+    std::string ToString() override {
+        return "vector";
+    }
+};
+
+class VectorLength : public Procedure {
+public:
+    ObjectPtr Apply(const Args&) override;
+    std::string ToString() override {
+        return "vector-length";
+    }
+};
+
+class VectorRef : public Procedure {
+public:
+    ObjectPtr Apply(const Args&) override;
+    std::string ToString() override {
+        return "vector-ref";
+    }
+};
+
+class VectorSet : public Procedure {
+public:
+    ObjectPtr Apply(const Args&) override;
+    std::string ToString() override {
+        return "vector-set!";
+    }
+};
+
+class VectorToList : public Procedure {
+public:
+    ObjectPtr Apply(const Args&) override;
+    std::string ToString() override {
+        return "vector->list";
+    }
+};
+
+class ListToVector : public Procedure {
+public:
+    ObjectPtr Apply(const Args&) override;
+    std::string ToString() override {
+        return "list->vector";
+    }
+};
+
+// Vector kernels
+// Bulk numeric operations on whole vectors. Vectors of fixnums, or of fixnums and flonums,
+// go through the SIMD kernels of kernels.h; vectors with bignums use the generic arithmetic.
+
+class VectorSum : public Procedure {
+public:
+    ObjectPtr Apply(const Args&) override;
+    std::string ToString() override {
+        return "vector-sum";
+    }
+};
+
+class VectorMin : public Procedure {
+public:
+    ObjectPtr Apply(const Args&) override;
+    std::string ToString() override {
+        return "vector-min";
+    }
+};
+
+class VectorMax : public Procedure {
+public:
+    ObjectPtr Apply(const Args&) override;
+    std::string ToString() override {
+        return "vector-max";
+    }
+};
+
+class VectorDot : public Procedure {
+public:
+    ObjectPtr Apply(const Args&) override;
+    std::string ToString() override {
+        return "vector-dot";
+    }
+};
+
+class VectorAdd : public Procedure {
+public:
+    ObjectPtr Apply(const Args&) override;
+    std::string ToString() override {
+        return "vector-add";
+    }
+};
+
+class VectorScale : public Procedure {
+public:
+    ObjectPtr Apply(const Args&) override;
+    std::string ToString() override {
+        return "vector-scale";
+    }
+};
+
+// Vector of booleans, Op applied to the elements at each index.
+ObjectPtr CompareVectors(const Args& args, kernels::CompareOp op);
+
+template <kernels::CompareOp Op>
+class VectorCompare : public Procedure {
+    ObjectPtr Apply(const Args& args) override {
+        return CompareVectors(args, Op);
+    }
+    std::string ToString() override {
+        return "";
+    }
+};
+
+using VectorEqual = VectorCompare<kernels::CompareOp::Equal>;
+using VectorLess = VectorCompare<kernels::CompareOp::Less>;
+using VectorGreater = VectorCompare<kernels::CompareOp::Greater>;
+using VectorLessEq = VectorCompare<kernels::CompareOp::LessEq>;
+using VectorGreaterEq = VectorCompare<kernels::CompareOp::GreaterEq>;
+
 // If
 
-class If : public Function {
+class If : public SpecialForm {
 public:
+    static constexpr TypeRange kTypes = ObjectType::If;
+
+    If() : SpecialForm(ObjectType::If) {
+    }
     ObjectPtr operator()(ObjectPtr) override;
+    bool EvalTail(ObjectPtr args, ScopeGuard& frame, ObjectPtr& res) override;
     std::string ToString() override {
         return "if";
     }
@@ -225,14 +428,20 @@ public:
 
 // Variables
 
-class SymbolPredicate : public Function {
-    ObjectPtr operator()(ObjectPtr) override;
+class SymbolPredicate : public Procedure {
+    ObjectPtr Apply(const Args&) override;
     std::string ToString() override {
         return "symbol?";
     }
 };
 
-class Define : public Function {
+class Define : public SpecialForm {
+public:
+    static constexpr TypeRange kTypes = ObjectType::Define;
+
+    Define() : SpecialForm(ObjectType::Define) {
+    }
+private:
     ObjectPtr operator()(ObjectPtr) override;
     ObjectPtr DefineLambda(ObjectPtr);
     std::string ToString() override {
@@ -240,22 +449,28 @@ class Define : public Function {
     }
 };
 
-class Set : public Function {
+class Set : public SpecialForm {
+public:
+    static constexpr TypeRange kTypes = ObjectType::Set;
+
+    Set() : SpecialForm(ObjectType::Set) {
+    }
+private:
     ObjectPtr operator()(ObjectPtr) override;
     std::string ToString() override {
         return "set!";
     }
 };
 
-class SetCar : public Function {
-    ObjectPtr operator()(ObjectPtr) override;
+class SetCar : public Procedure {
+    ObjectPtr Apply(const Args&) override;
     std::string ToString() override {
         return "set-car!";
     }
 };
 
-class SetCdr : public Function {
-    ObjectPtr operator()(ObjectPtr) override;
+class SetCdr : public Procedure {
+    ObjectPtr Apply(const Args&) override;
     std::string ToString() override {
         return "set-cdr!";
     }
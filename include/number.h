@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "bignum.h"
+#include "object.h"
+
+// Inexact real number, boxed on the heap.
+class Flonum : public Object {
+public:
+    static constexpr TypeRange kTypes = ObjectType::Flonum;
+
+    explicit Flonum(double value);
+    double GetValue() const {
+        return value_;
+    }
+    ObjectPtr Eval() override {
+        return this;
+    }
+    std::string ToString() override;
+
+private:
+    double value_;
+};
+
+template <>
+inline constexpr bool kOwnsStorage<Flonum> = false;
+
+// Value of any number as a double.
+double ToDouble(ObjectPtr number);
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Arithmetic on numbers.
+// Fixnum operands take the inline path, which checks for overflow with the compiler
+// intrinsics. Other operands and overflowing results go through the out-of-line path:
+// the result is a flonum if an operand is one, otherwise an exact integer.
+
+ObjectPtr AddNumbersSlow(ObjectPtr lhs, ObjectPtr rhs);
+ObjectPtr SubtractNumbersSlow(ObjectPtr lhs, ObjectPtr rhs);
+ObjectPtr MultiplyNumbersSlow(ObjectPtr lhs, ObjectPtr rhs);
+ObjectPtr DivideNumbersSlow(ObjectPtr lhs, ObjectPtr rhs);
+int CompareNumbersSlow(ObjectPtr lhs, ObjectPtr rhs);
+
+inline ObjectPtr AddNumbers(ObjectPtr lhs, ObjectPtr rhs) {
+    int64_t res;
+    if (IsFixnum(lhs) && IsFixnum(rhs) &&
+        !__builtin_add_overflow(Number::GetValue(lhs), Number::GetValue(rhs), &res) &&
+        Number::Fits(res)) {
+        return Number::Make(res);
+    }
+    return AddNumbersSlow(lhs, rhs);
+}
+
+inline ObjectPtr SubtractNumbers(ObjectPtr lhs, ObjectPtr rhs) {
+    int64_t res;
+    if (IsFixnum(lhs) && IsFixnum(rhs) &&
+        !__builtin_sub_overflow(Number::GetValue(lhs), Number::GetValue(rhs), &res) &&
+        Number::Fits(res)) {
+        return Number::Make(res);
+    }
+    return SubtractNumbersSlow(lhs, rhs);
+}
+
+inline ObjectPtr MultiplyNumbers(ObjectPtr lhs, ObjectPtr rhs) {
+    int64_t res;
+    if (IsFixnum(lhs) && IsFixnum(rhs) &&
+        !__builtin_mul_overflow(Number::GetValue(lhs), Number::GetValue(rhs), &res) &&
+        Number::Fits(res)) {
+        return Number::Make(res);
+    }
+    return MultiplyNumbersSlow(lhs, rhs);
+}
+
+// Quotient of integers is truncated toward zero.
+inline ObjectPtr DivideNumbers(ObjectPtr lhs, ObjectPtr rhs) {
+    if (IsFixnum(lhs) && IsFixnum(rhs) && Number::GetValue(rhs) != 0) {
+        int64_t res = Number::GetValue(lhs) / Number::GetValue(rhs);
+        if (Number::Fits(res)) {
+            return Number::Make(res);
+        }
+    }
+    return DivideNumbersSlow(lhs, rhs);
+}
+
+// Negative, zero or positive as lhs is less than, equal to or greater than rhs.
+// NaN yields zero, callers which must tell it apart compare doubles.
+inline int CompareNumbers(ObjectPtr lhs, ObjectPtr rhs) {
+    if (IsFixnum(lhs) && IsFixnum(rhs)) {
+        int64_t lhs_value = Number::GetValue(lhs);
+        int64_t rhs_value = Number::GetValue(rhs);
+        return (lhs_value > rhs_value) - (lhs_value < rhs_value);
+    }
+    return CompareNumbersSlow(lhs, rhs);
+}
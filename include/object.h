@@ -1,10 +1,14 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <limits>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <type_traits>
-#include <unordered_set>
 #include <vector>
 #include <numeric>
 #include "error.h"
@@ -13,56 +17,192 @@
 class Object;
 using ObjectPtr = Object*;
 
+// Type tag of a heap object, set by the constructor. Each family of classes occupies
+// a contiguous range, so checking for a base class is a range compare.
+enum class ObjectType : uint8_t {
+    Symbol,
+    Cell,
+    GlobalScope,
+    Frame,
+    Prototype,
+    LocalRef,
+    Bignum,
+    Flonum,
+    Vector,
+    Future,
+    // Procedures
+    Builtin,
+    LambdaFunction,
+    Closure,
+    // Special forms
+    Quote,
+    If,
+    Define,
+    Set,
+    Lambda,
+    LogicalAnd,
+    LogicalOr,
+    FutureForm,
+    LambdaTemplate,
+};
+
+struct TypeRange {
+    ObjectType first;
+    ObjectType last;
+
+    constexpr TypeRange(ObjectType type) : first(type), last(type) {
+    }
+    constexpr TypeRange(ObjectType first, ObjectType last) : first(first), last(last) {
+    }
+    constexpr bool Contains(ObjectType type) const {
+        return first <= type && type <= last;
+    }
+};
+
+// Visits reference slots of objects. The collector may rewrite a slot when its referent moves.
+class Tracer {
+public:
+    virtual void Visit(ObjectPtr& slot) = 0;
+
+    template <class T>
+    void operator()(T*& slot) {
+        ObjectPtr obj = slot;
+        Visit(obj);
+        slot = static_cast<T*>(obj);
+    }
+
+protected:
+    ~Tracer() = default;
+};
+
 class Object {
 public:
     virtual ~Object() = default;
     virtual ObjectPtr Eval() = 0;
     virtual std::string ToString() = 0;
+    // Passes every reference held in the fields of the object to the tracer.
+    virtual void Trace(Tracer&) {
+    }
+    // Large objects are traced in parts, so a slice of the collector may stop in the middle
+    // of one. TraceParts passes the references of the parts [begin, end) to the tracer.
+    virtual size_t GetTraceParts() const {
+        return 1;
+    }
+    virtual void TraceParts(Tracer& tracer, size_t /*begin*/, size_t /*end*/) {
+        Trace(tracer);
+    }
+    // Bytes of storage owned outside the heap block, counted toward the size of the heap.
+    virtual size_t GetExternalSize() const {
+        return 0;
+    }
+    ObjectType GetType() const {
+        return type_;
+    }
+    // Frozen objects are shared by heaps and must not change, see GC::Freeze.
+    bool IsFrozen() const {
+        return frozen;
+    }
 
 protected:
-    Object() = default;
+    explicit Object(ObjectType type) : type_(type) {
+    }
+    // Used by the collector to promote objects out of the nursery.
+    Object(Object&&) = default;
 
-    bool marked = true;
-    std::unordered_set<ObjectPtr> dependencies;
-    void AddDependency(ObjectPtr);
-    void RemoveDependency(ObjectPtr);
-    void Mark();
+    ObjectType type_;
+    bool remembered = false;
+    bool frozen = false;
+    // Set by the collector from kOwnsStorage.
+    bool owns_storage = true;
+    // Position in the old generation table, indexes the mark bitmap of the collector.
+    uint32_t heap_index = 0;
     friend GC;
 };
 
+// Classes whose objects keep all their data in their own heap block, without a std::vector
+// or other storage allocated outside it, specialize this as false: the collector frees
+// them without running their destructors.
+template <class T>
+inline constexpr bool kOwnsStorage = true;
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Tagged immediates.
+// Heap objects are aligned, so a pointer with the low bit set can't point to one.
+// Such pointers hold fixnums: the value is stored in the upper bits of the pointer itself.
+
+constexpr uintptr_t kFixnumTag = 1;
+
+inline bool IsFixnum(ObjectPtr obj) {
+    return (reinterpret_cast<uintptr_t>(obj) & kFixnumTag) != 0;
+}
+
+// Pointer which can be dereferenced: not the empty list and not an immediate.
+inline bool IsHeapObject(ObjectPtr obj) {
+    return obj != nullptr && !IsFixnum(obj);
+}
+
+// Integers are fixnums when they fit, bignums (see bignum.h) otherwise. Inexact numbers
+// are flonums (see number.h).
+class Number {
+public:
+    // Range of fixnums.
+    static constexpr int64_t kMin = std::numeric_limits<intptr_t>::min() >> 1;
+    static constexpr int64_t kMax = std::numeric_limits<intptr_t>::max() >> 1;
+
+    static bool Fits(int64_t value) {
+        return kMin <= value && value <= kMax;
+    }
+    // The value must fit into a fixnum.
+    static ObjectPtr Make(int64_t value) {
+        auto bits = static_cast<uintptr_t>(static_cast<intptr_t>(value));
+        return reinterpret_cast<ObjectPtr>((bits << 1) | kFixnumTag);
+    }
+    static int64_t GetValue(ObjectPtr obj) {
+        return reinterpret_cast<intptr_t>(obj) >> 1;
+    }
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 
 // Runtime type checking and conversion.
-// This can be helpful: https://en.cppreference.com/w/cpp/memory/shared_ptr/pointer_cast
+// T::kTypes is the type range of T and its subclasses. Subclasses without their own
+// kTypes inherit the range of the base and can't be told apart from it.
 
 template <class T>
-T* As(const ObjectPtr& obj) {
-    return dynamic_cast<T*>(obj);
+bool Is(const ObjectPtr& obj) {
+    return IsHeapObject(obj) && T::kTypes.Contains(obj->GetType());
 }
 
 template <class T>
-bool Is(const ObjectPtr& obj) {
-    return dynamic_cast<T*>(obj) != nullptr;
+T* As(const ObjectPtr& obj) {
+    return Is<T>(obj) ? static_cast<T*>(obj) : nullptr;
 }
 
-///////////////////////////////////////////////////////////////////////////////
+template <>
+inline bool Is<Number>(const ObjectPtr& obj) {
+    return IsFixnum(obj) ||
+           (obj != nullptr &&
+            TypeRange{ObjectType::Bignum, ObjectType::Flonum}.Contains(obj->GetType()));
+}
 
-class Number : public Object {
-public:
-    explicit Number(int);
-    int GetValue() const;
-    ObjectPtr Eval() override;
-    std::string ToString() override;
+// Evaluates any value including immediates and the empty list.
+ObjectPtr EvalObject(ObjectPtr obj);
 
-private:
-    int value_;
-};
+// External representation of obj, see Write in printer.h.
+std::string ObjectToString(ObjectPtr obj);
+
+class Symbol;
+using SymbolPtr = Symbol*;
 
+// Symbols are interned: there is exactly one Symbol per name, so symbols are
+// compared and hashed by pointer. Interned symbols live outside the GC heap.
 class Symbol : public Object {
 public:
-    explicit Symbol(const std::string&);
-    explicit Symbol(const char*);
-    explicit Symbol(bool);
+    static constexpr TypeRange kTypes = ObjectType::Symbol;
+
+    static SymbolPtr Intern(std::string_view name);
+    static SymbolPtr Boolean(bool value);
     const std::string& GetName() const;
     ObjectPtr Eval() override;
     std::string ToString() override {
@@ -70,15 +210,49 @@ public:
     }
 
 private:
+    explicit Symbol(std::string_view name);
+    friend class SymbolTable;
+
     std::string name_;
 };
 
 const std::string kTrueSymbol = "#t";
 const std::string kFalseSymbol = "#f";
+const std::string kQuoteSymbol = "quote";
+
+class SymbolTable {
+public:
+    static SymbolTable& GetInstance() {
+        static SymbolTable table;
+        return table;
+    }
+    SymbolPtr Intern(std::string_view name);
+    SymbolPtr GetTrue() const {
+        return true_;
+    }
+    SymbolPtr GetFalse() const {
+        return false_;
+    }
+    ~SymbolTable();
+
+private:
+    // Pre-interns booleans and names of special forms.
+    SymbolTable();
+    SymbolTable(const SymbolTable&) = delete;
+    SymbolTable& operator=(const SymbolTable&) = delete;
+
+    std::mutex mutex_;
+    // Keys are views of the names owned by symbols.
+    std::unordered_map<std::string_view, SymbolPtr> symbols_;
+    SymbolPtr true_;
+    SymbolPtr false_;
+};
 
 class Cell : public Object {
 public:
-    Cell() = default;
+    static constexpr TypeRange kTypes = ObjectType::Cell;
+
+    Cell();
     Cell(ObjectPtr, ObjectPtr);
     Cell(ObjectPtr, std::nullptr_t);
     ObjectPtr GetFirst() const;
@@ -86,43 +260,204 @@ public:
     void SetFirst(const ObjectPtr&);
     void SetSecond(const ObjectPtr&);
     ObjectPtr Eval() override;
-    std::string ToString() override;  // TODO
+    std::string ToString() override;
+    void Trace(Tracer& tracer) override {
+        tracer(first_);
+        tracer(second_);
+    }
+
 private:
     ObjectPtr first_, second_;
 };
 
+template <>
+inline constexpr bool kOwnsStorage<Cell> = false;
+
 using CellPtr = Cell*;
 
+using Args = std::vector<ObjectPtr>;
+
+class Vector;
+using VectorPtr = Vector*;
+
+// Fixed-length array of values, indexed in constant time. The elements follow the fields
+// in the same heap block, so a vector is a single allocation. Vectors evaluate to themselves.
+class Vector final : public Object {
+public:
+    static constexpr TypeRange kTypes = ObjectType::Vector;
+
+    // Vector of size elements set to fill, in the old generation if tenured.
+    static VectorPtr Make(size_t size, ObjectPtr fill, bool tenured = false);
+    static VectorPtr Make(const Args& elements);
+    // Used by the collector to promote vectors.
+    Vector(Vector&& other);
+    size_t GetSize() const {
+        return size_;
+    }
+    const ObjectPtr* GetData() const {
+        return reinterpret_cast<const ObjectPtr*>(this + 1);
+    }
+    ObjectPtr Get(size_t index) const {
+        return GetData()[index];
+    }
+    void Set(size_t index, ObjectPtr obj);
+    ObjectPtr Eval() override {
+        return this;
+    }
+    std::string ToString() override;
+    void Trace(Tracer& tracer) override {
+        TraceParts(tracer, 0, size_);
+    }
+    // Parts are elements.
+    size_t GetTraceParts() const override {
+        return size_;
+    }
+    void TraceParts(Tracer& tracer, size_t begin, size_t end) override {
+        for (size_t i = begin; i < end; ++i) {
+            tracer(GetElements()[i]);
+        }
+    }
+
+private:
+    Vector(size_t size, ObjectPtr fill);
+    explicit Vector(const Args& elements);
+    ObjectPtr* GetElements() {
+        return reinterpret_cast<ObjectPtr*>(this + 1);
+    }
+
+    size_t size_;
+    friend GC;
+};
+
+template <>
+inline constexpr bool kOwnsStorage<Vector> = false;
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Precise roots on the native stack.
+// Any allocation may start a collection, so an object held only in a C++ variable across
+// an allocation must be rooted. Roots are linked in the order of construction, their
+// lifetimes must be nested.
+
+class StackRoot {
+public:
+    StackRoot(const StackRoot&) = delete;
+    StackRoot& operator=(const StackRoot&) = delete;
+    virtual void Trace(Tracer& tracer) = 0;
+    StackRoot* GetPrev() const {
+        return prev_;
+    }
+
+protected:
+    StackRoot();
+    ~StackRoot();
+
+private:
+    StackRoot* prev_;
+};
+
+template <class T>
+class Local final : public StackRoot {
+public:
+    explicit Local(T* ptr = nullptr) : ptr_(ptr) {
+    }
+    Local& operator=(T* ptr) {
+        ptr_ = ptr;
+        return *this;
+    }
+    operator T*() const {
+        return ptr_;
+    }
+    T* operator->() const {
+        return ptr_;
+    }
+    void Trace(Tracer& tracer) override {
+        tracer(ptr_);
+    }
+
+private:
+    T* ptr_;
+};
+
+// Roots every element of the vector, including ones added later.
+class LocalArgs final : public StackRoot {
+public:
+    explicit LocalArgs(Args& args) : args_(args) {
+    }
+    void Trace(Tracer& tracer) override {
+        for (ObjectPtr& arg : args_) {
+            tracer(arg);
+        }
+    }
+
+private:
+    Args& args_;
+};
+
+class ScopeGuard;
+
 class Function : public Object {
 public:
+    static constexpr TypeRange kTypes{ObjectType::Builtin, ObjectType::LambdaTemplate};
+
     ObjectPtr Eval() override;
     virtual ObjectPtr operator()(ObjectPtr) = 0;
+    // Evaluates the call up to the expression in its tail position. Returns true and stores
+    // that expression into res if the caller has to evaluate it, in the current scope after
+    // the frame of the call is entered through frame. Otherwise stores the value of the call.
+    virtual bool EvalTail(ObjectPtr args, ScopeGuard& frame, ObjectPtr& res);
     std::string ToString() override = 0;
+
+protected:
+    explicit Function(ObjectType type) : Object(type) {
+    }
+    // Whole evaluation of the call for functions implementing EvalTail.
+    ObjectPtr EvalThroughTail(ObjectPtr args);
 };
 
 using FunctionPtr = Function*;
 
-using Args = std::vector<ObjectPtr>;
+// Function that works with already evaluated arguments. The tree-walker evaluates
+// the raw argument list in operator(), the bytecode VM calls Apply directly.
+class Procedure : public Function {
+public:
+    static constexpr TypeRange kTypes{ObjectType::Builtin, ObjectType::Closure};
+
+    explicit Procedure(ObjectType type = ObjectType::Builtin) : Function(type) {
+    }
+    ObjectPtr operator()(ObjectPtr) final;
+    virtual ObjectPtr Apply(const Args&) = 0;
+};
+
+using ProcedurePtr = Procedure*;
+
+// Function that receives its arguments unevaluated (quote, if, define, ...).
+// The bytecode compiler lowers these forms itself instead of calling them.
+class SpecialForm : public Function {
+public:
+    static constexpr TypeRange kTypes{ObjectType::Quote, ObjectType::LambdaTemplate};
+
+protected:
+    explicit SpecialForm(ObjectType type) : Function(type) {
+    }
+};
 
 template <bool IsEval = true>
 Args GetArgsVector(ObjectPtr arg_list) {
     std::vector<ObjectPtr> args;
+    LocalArgs root{args};
     while (arg_list != nullptr) {
         if (Is<Cell>(arg_list)) {
             auto cell = As<Cell>(arg_list);
             if constexpr (IsEval) {
-                if (cell->GetFirst() != nullptr) {
-                    args.push_back(cell->GetFirst()->Eval());
-                } else {
-                    args.push_back(nullptr);
-                }
+                args.push_back(EvalObject(cell->GetFirst()));
             } else {
                 args.push_back(cell->GetFirst());
             }
             arg_list = cell->GetSecond();
         } else {
             if constexpr (IsEval) {
-                args.push_back(arg_list->Eval());
+                args.push_back(EvalObject(arg_list));
             } else {
                 args.push_back(arg_list);
             }
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include "bytecode.h"
+#include "object.h"
+
+// Futures and parallel maps.
+// Tasks run on a pool of worker threads, each with an interpreter of its own. A task gets
+// copies of the global bindings, its procedure and its arguments taken when it is created,
+// and its results are copied back into the heap of the caller, see ObjectsWriter. Side
+// effects of a task are not visible to the caller. Workers don't wait for other tasks:
+// futures and parallel maps created by a task run at once on its worker. The frozen
+// environment of the caller, see FrozenEnvironment, is shared with the task, not copied.
+
+struct Task;
+
+// Number of worker threads, one per core by default. Must be set before the first task.
+void SetWorkersCount(size_t count);
+size_t GetWorkersCount();
+
+class Future : public Object {
+public:
+    static constexpr TypeRange kTypes = ObjectType::Future;
+
+    explicit Future(std::shared_ptr<Task> task);
+    explicit Future(ObjectPtr value);
+    // Future which failed with the error, e.g. one loaded from an image.
+    Future(ErrorKind kind, std::string error);
+
+    // Whether Touch won't wait.
+    bool IsReady() const;
+    // Whether Touch returns at once without raising.
+    bool HasValue() const;
+    // Waits for the task and copies its value into the current heap on the first call.
+    // A worker runs the task itself if no other worker has taken it yet.
+    void Wait();
+    // Value of a ready future which has one. Frozen futures copy it on every call.
+    ObjectPtr GetValue();
+    // Waits, then returns the value or raises the error of the task if it failed.
+    ObjectPtr Touch();
+    // Task of a future whose value isn't copied into the heap yet.
+    const std::shared_ptr<Task>& GetTask() const {
+        return task_;
+    }
+    // Error of a ready future without a value.
+    ErrorKind GetErrorKind() const;
+    const std::string& GetError() const;
+    ObjectPtr Eval() override {
+        return this;
+    }
+    std::string ToString() override {
+        return "#<future>";
+    }
+    void Trace(Tracer& tracer) override {
+        tracer(value_);
+    }
+
+private:
+    std::shared_ptr<Task> task_;
+    ObjectPtr value_ = nullptr;
+};
+
+// Future of calling thunk without arguments.
+ObjectPtr MakeFuture(ObjectPtr thunk);
+
+// (future body...) evaluates body in a task, as the body of a lambda without parameters.
+class FutureForm : public SpecialForm {
+public:
+    static constexpr TypeRange kTypes = ObjectType::FutureForm;
+
+    FutureForm() : SpecialForm(ObjectType::FutureForm) {
+    }
+    ObjectPtr operator()(ObjectPtr) override;
+    std::string ToString() override {
+        return "future";
+    }
+};
+
+// Value of a future, other values are returned as they are.
+class Touch : public Procedure {
+public:
+    ObjectPtr Apply(const Args&) override;
+    std::string ToString() override {
+        return "touch";
+    }
+};
+
+// (parallel-map f list...) is map with the calls split into chunks run by the workers.
+class ParallelMap : public Procedure {
+public:
+    ObjectPtr Apply(const Args&) override;
+    std::string ToString() override {
+        return "parallel-map";
+    }
+};
+
+class ParallelForEach : public Procedure {
+public:
+    ObjectPtr Apply(const Args&) override;
+    std::string ToString() override {
+        return "parallel-for-each";
+    }
+};
@@ -1,11 +1,21 @@
 #pragma once
 
+#include <istream>
+#include <string>
 #include "object.h"
 #include "tokenizer.h"
 
-ObjectPtr Read(Tokenizer* tokenizer);
+// Lists, vectors and quotes nested deeper than this are a SyntaxError. Data is copied,
+// printed and collected without recursion at any depth, but code is compiled and evaluated
+// recursively: the default leaves room on the native stack for code nested that deep.
+constexpr size_t kDefaultMaxReadDepth = 10000;
+
+void SetMaxReadDepth(size_t depth);
+size_t GetMaxReadDepth();
 
-CellPtr ReadList(Tokenizer* tokenizer);
+// Reads one datum. Nesting is tracked on an explicit stack, so deep input doesn't use
+// the native stack.
+ObjectPtr Read(Tokenizer* tokenizer);
 
 bool IsEndOfCell(const Token& token);
 
@@ -13,4 +23,29 @@ bool IsSeparator(const Token& token);
 
 bool IsStepInto(const Token& token);
 
-void NotFoundCloseBracket();
\ No newline at end of file
+void NotFoundCloseBracket();
+
+// Reads top-level forms one by one from a stream, forms may span lines. Only the unread
+// rest of the current chunk is buffered, grown while a form doesn't fit into it.
+class StreamReader {
+public:
+    explicit StreamReader(std::istream* in);
+
+    // Whether only whitespace is left.
+    bool IsEnd();
+
+    ObjectPtr ReadForm();
+
+private:
+    static constexpr size_t kChunkSize = 1 << 16;
+
+    std::string_view GetRest() const;
+    // Reads up to size more bytes.
+    void Fill(size_t size);
+
+    std::istream* in_;
+    std::string buffer_;
+    // Start of the unread part of buffer_.
+    size_t start_ = 0;
+    bool exhausted_ = false;
+};
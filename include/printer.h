@@ -0,0 +1,10 @@
+#pragma once
+
+#include <ostream>
+#include "object.h"
+
+// Writes the external representation of obj to out, as Scheme's write does.
+// Pairs and vectors are walked with an explicit stack, so deep structures don't use the
+// native stack. Pairs and vectors which are part of a cycle are written once with a datum
+// label, #n=, and referenced as #n# afterwards, so circular structures terminate.
+void Write(ObjectPtr obj, std::ostream& out);
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+#include "object.h"
+#include "scope.h"
+
+// Names of a lambda frame: parameters first, then internal defines.
+struct FrameLayout {
+    std::vector<SymbolPtr> names;
+    size_t params_count = 0;
+    // Enclosing lambda, nullptr for the global scope. Valid only while resolving.
+    const FrameLayout* parent = nullptr;
+
+    // Slot of the name in this frame, allocated if it is missing.
+    uint32_t AddLocal(SymbolPtr name);
+};
+
+struct LocalAddress {
+    uint16_t depth;
+    uint32_t slot;
+    bool is_param;
+};
+
+std::optional<LocalAddress> ResolveLocal(const FrameLayout* layout, SymbolPtr name);
+
+// Special form bound to the head symbol in the global scope. Returns nullptr if the head is
+// not a symbol, is shadowed by a local variable or is bound to something else.
+SpecialForm* FindSpecialForm(ObjectPtr head, const FrameLayout* layout,
+                             GlobalScopePtr global_scope);
+
+// Adds names introduced by define forms of the body expression to the layout.
+void CollectDefines(ObjectPtr expr, FrameLayout* layout, GlobalScopePtr global_scope);
+
+// Local variable of the tree-walker resolved to a slot of the current frame chain.
+class LocalRef : public Object {
+public:
+    static constexpr TypeRange kTypes = ObjectType::LocalRef;
+
+    LocalRef(SymbolPtr name, LocalAddress address);
+    SymbolPtr GetName() const {
+        return name_;
+    }
+    const LocalAddress& GetAddress() const {
+        return address_;
+    }
+    ObjectPtr Eval() override;
+    void Assign(ObjectPtr obj);
+    std::string ToString() override {
+        return name_->GetName();
+    }
+
+private:
+    FramePtr GetFrame() const;
+
+    SymbolPtr name_;
+    LocalAddress address_;
+};
+
+template <>
+inline constexpr bool kOwnsStorage<LocalRef> = false;
+
+// Copies the body expression for the tree-walker: local variables become LocalRefs,
+// lambda forms become (LambdaTemplate) calls. Quoted data and malformed forms are kept.
+ObjectPtr ResolveExpr(ObjectPtr expr, const FrameLayout* layout, GlobalScopePtr global_scope);
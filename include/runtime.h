@@ -1,6 +1,11 @@
 #pragma once
 
+#include <chrono>
 #include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
 #include <utility>
 #include <vector>
 #include "object.h"
@@ -8,33 +13,374 @@
 template <typename T>
 concept DerivedFrom = std::derived_from<T, Object>;
 
+// Grey objects of a full collection. Storage grows by chunks, so marking deep
+// structures uses neither the native stack nor one huge contiguous buffer.
+class MarkStack {
+public:
+    explicit MarkStack(size_t chunk_size);
+    void Push(ObjectPtr obj);
+    ObjectPtr Pop();
+    bool Empty() const {
+        return chunks_.back().empty();
+    }
+
+private:
+    size_t chunk_size_;
+    std::vector<std::vector<ObjectPtr>> chunks_;
+};
+
+// Fixed-size slots carved from large slabs. Freed slots form an intrusive free list,
+// so objects of one size class are packed together and freeing doesn't go through malloc.
+class SlabPool {
+public:
+    SlabPool(size_t slot_size, size_t slab_size);
+    void* Allocate();
+    void Free(void* ptr);
+    // Applies to slabs allocated later.
+    void SetSlabSize(size_t slab_size) {
+        slab_size_ = slab_size;
+    }
+    size_t GetSlotSize() const {
+        return slot_size_;
+    }
+    size_t GetSlabsCount() const {
+        return slabs_.size();
+    }
+    // Slots carved from the slabs so far, used or free.
+    size_t GetCapacity() const {
+        return capacity_;
+    }
+    size_t GetUsed() const {
+        return used_;
+    }
+
+private:
+    struct FreeSlot {
+        FreeSlot* next;
+    };
+
+    size_t slot_size_;
+    size_t slab_size_;
+    std::vector<std::unique_ptr<std::byte[]>> slabs_;
+    // Part of the last slab not carved into slots yet.
+    std::byte* bump_ = nullptr;
+    std::byte* end_ = nullptr;
+    FreeSlot* free_ = nullptr;
+    size_t capacity_ = 0;
+    size_t used_ = 0;
+};
+
+// Occupancy of the pool of one size class. Free slots, capacity - used, are the
+// fragmentation left by sweeping.
+struct PoolStats {
+    size_t slot_size;
+    size_t slabs;
+    size_t capacity;
+    size_t used;
+};
+
+// Generational collector.
+// New objects are bump-allocated in the nursery. A minor collection copies the survivors
+// reachable from the remembered set into the old generation and empties the nursery.
+// Minor collections move objects, so they run only at safe points, between top-level
+// expressions, when methods of heap objects are not running.
+//
+// The old generation is collected incrementally once it has grown by the growth factor
+// since the last cycle. A cycle starts at a safe point or at any allocation, then marks
+// and sweeps in slices bounded by the max pause, run at safe points and every few dozen
+// kilobytes allocated, more often while the slices fall behind. Large objects are traced in
+// parts, so a slice may stop in the middle of one. Marking is snapshot-at-the-beginning:
+// the snapshot consists of the roots, the stack roots and everything referenced from the
+// nursery, the write barrier shades overwritten references and objects created during the
+// cycle are marked. Mark bits are kept in a side bitmap.
+//
+// Old objects live in slab pools by size class, larger ones are allocated by operator new.
+// Storage owned outside the heap block, reported by Object::GetExternalSize, counts toward
+// the size of the heap.
+// Objects which don't own storage outside their block, see kOwnsStorage, are freed without
+// running their destructors, so dead young ones cost nothing to a minor collection.
+//
+// Every interpreter owns a heap. Objects are allocated in the heap current on the calling
+// thread, so interpreters on different threads don't share any state but interned symbols.
 class GC {
 public:
-    static GC& GetInstance() {
-        static GC gc;
-        return gc;
+    using Clock = std::chrono::steady_clock;
+
+    GC();
+    // Heap of the interpreter running on the calling thread.
+    static GC& GetCurrent() {
+        return *current_;
+    }
+    // Makes gc current on the calling thread, returns the previous one.
+    static GC* SetCurrent(GC* gc) {
+        return std::exchange(current_, gc);
     }
+    // Roots must not move: allocate them with NewTenured.
     void AddRoot(ObjectPtr ptr);
+
     template <DerivedFrom T, typename... Args>
     T* New(Args&&... args) {
-        T* ptr = new T(std::forward<Args>(args)...);
-        allocations_.push_back(ptr);
+        return NewSized<T>(sizeof(T), std::forward<Args>(args)...);
+    }
+
+    // Allocates directly in the old generation, the object never moves.
+    template <DerivedFrom T, typename... Args>
+    T* NewTenured(Args&&... args) {
+        return NewTenuredSized<T>(sizeof(T), std::forward<Args>(args)...);
+    }
+
+    // Same as New for objects followed by storage of their own in the same block, e.g.
+    // the slots of a frame: size is the size of the whole block. The move constructor of
+    // such an object must move that storage too.
+    template <DerivedFrom T, typename... Args>
+    T* NewSized(size_t size, Args&&... args) {
+        static_assert(alignof(T) <= kAlignment);
+        OnAllocation(size);
+        YoungHeader* header = AllocateYoung(size);
+        if (header == nullptr) {
+            return AllocateOld<T>(size, std::forward<Args>(args)...);
+        }
+        T* ptr = new (header + 1) T(std::forward<Args>(args)...);
+        // Set only after construction, so a throwing constructor leaves a dead block.
+        header->relocate = &Relocate<T>;
+        ptr->owns_storage = kOwnsStorage<T>;
+        if constexpr (kOwnsStorage<T>) {
+            young_owners_.push_back(ptr);
+            size_t external = ptr->GetExternalSize();
+            young_external_bytes_ += external;
+            allocated_since_slice_ += external;
+        }
         return ptr;
     }
-    void Collect();
+
+    template <DerivedFrom T, typename... Args>
+    T* NewTenuredSized(size_t size, Args&&... args) {
+        OnAllocation(size);
+        return AllocateOld<T>(size, std::forward<Args>(args)...);
+    }
+
+    bool IsYoung(ObjectPtr obj) const {
+        auto* ptr = reinterpret_cast<std::byte*>(obj);
+        return !IsFixnum(obj) && ptr >= nursery_.get() && ptr < top_;
+    }
+
+    // Must be called before replacing old_value with value in a field of holder
+    // after its construction.
+    void WriteBarrier(ObjectPtr holder, ObjectPtr old_value, ObjectPtr value) {
+        if (holder->frozen) {
+            throw RuntimeError{"Can't modify a frozen object"};
+        }
+        if (phase_ == Phase::Marking) {
+            Shade(old_value);
+        }
+        if (IsYoung(value) && !IsYoung(holder)) {
+            Remember(holder);
+        }
+    }
+
+    // Called between top-level expressions: collects the nursery if it is filling up,
+    // starts a cycle if the old generation has grown and runs a slice of the current one.
+    void Safepoint();
+    void CollectMinor();
+    // Runs a whole cycle of the old generation without the pause budget.
+    void CollectFull();
+    // Collects everything and freezes the live objects: other heaps may refer to them,
+    // but don't trace or collect them. The heap must not allocate afterwards, it is never
+    // collected again.
+    void Freeze();
+
+    // Number of grey objects per chunk of the mark stack.
+    void SetMarkChunkSize(size_t chunk_size) {
+        mark_chunk_size_ = chunk_size;
+    }
+    void SetMaxPause(std::chrono::microseconds max_pause) {
+        max_pause_ = max_pause;
+    }
+    void SetHeapGrowthFactor(double factor) {
+        growth_factor_ = factor;
+    }
+    // Size of slabs allocated later by the pools of the old generation.
+    void SetSlabSize(size_t slab_size);
+    std::vector<PoolStats> GetPoolStats() const;
     ~GC();
 
 private:
-    GC() = default;
+    static constexpr size_t kAlignment = alignof(std::max_align_t);
+    static constexpr size_t kNurserySize = 4 << 20;
+    static constexpr size_t kMinorTrigger = kNurserySize / 4;
+    static constexpr size_t kMinHeapBytes = 8 << 20;
+    static constexpr size_t kDefaultMarkChunkSize = 1 << 12;
+    static constexpr std::chrono::microseconds kDefaultMaxPause{500};
+    static constexpr double kDefaultGrowthFactor = 2.0;
+    // Bytes allocated between slices and bytes per unit of work: a traced reference, an
+    // object taken from the grey stack or a swept table slot. Slices are paced by bytes,
+    // with the external ones, so a few huge objects advance the cycle as much as many
+    // small ones. Slices are bounded by the max pause too: the work they leave is owed to
+    // the next ones, which come after fewer bytes until the debt is paid.
+    static constexpr size_t kSliceBytes = 64 << 10;
+    static constexpr size_t kMinSliceBytes = 1 << 10;
+    static constexpr size_t kBytesPerWork = 4;
+    // Parts of a large object traced at once, see Object::TraceParts.
+    static constexpr size_t kTracePartsChunk = 256;
+    // Size classes are multiples of the alignment up to kMaxPooledSize.
+    static constexpr size_t kMaxPooledSize = 256;
+    static constexpr size_t kDefaultSlabSize = 64 << 10;
+
+    enum class Phase { Idle, Marking, Sweeping };
+
+    using RelocateFn = ObjectPtr (*)(ObjectPtr, void*);
+
+    struct alignas(kAlignment) YoungHeader {
+        size_t size;
+        // Moves the object into the given old storage, nullptr if construction failed.
+        RelocateFn relocate;
+        ObjectPtr forward;
+    };
+
+    struct OldObject {
+        ObjectPtr obj;
+        size_t size;
+        // Last known result of GetExternalSize, counted in old_bytes_.
+        size_t external;
+    };
+
+    class Evacuator;
+    class Marker;
+    class YoungFinder;
+
+    template <class T>
+    static ObjectPtr Relocate(ObjectPtr obj, void* storage) {
+        return new (storage) T(std::move(*static_cast<T*>(obj)));
+    }
+
+    static YoungHeader* HeaderOf(ObjectPtr obj) {
+        return reinterpret_cast<YoungHeader*>(obj) - 1;
+    }
+
     GC(const GC&) = delete;
     GC& operator=(const GC&) = delete;
+
+    template <DerivedFrom T, typename... Args>
+    T* AllocateOld(size_t size, Args&&... args) {
+        void* storage = AllocateStorage(size);
+        T* ptr;
+        try {
+            ptr = new (storage) T(std::forward<Args>(args)...);
+        } catch (...) {
+            FreeStorage(storage, size);
+            throw;
+        }
+        ptr->owns_storage = kOwnsStorage<T>;
+        AddOld(ptr, size);
+        allocated_since_slice_ += old_[ptr->heap_index].external;
+        // The constructor may have stored young references without the barrier.
+        RememberIfYoungReferrer(ptr);
+        return ptr;
+    }
+
+    // Called before allocating size bytes. Cycles start before the allocation, so objects
+    // allocated during them are marked. External bytes are added to the next slice.
+    void OnAllocation(size_t size) {
+        if (phase_ == Phase::Idle) {
+            if (old_bytes_ > cycle_trigger_) {
+                StartCycle();
+            }
+        } else if ((allocated_since_slice_ += size) >= slice_bytes_) {
+            RunAllocationSlice();
+        }
+    }
+
+    YoungHeader* AllocateYoung(size_t size);
+    // Storage for an old object of the given size, from the pool of its size class.
+    void* AllocateStorage(size_t size);
+    void FreeStorage(void* ptr, size_t size);
+    // Destroys the old object and frees its slot in the table.
+    void DestroyOld(size_t index);
+    void AddOld(ObjectPtr obj, size_t size);
+    void Remember(ObjectPtr obj) {
+        if (!obj->remembered) {
+            obj->remembered = true;
+            remembered_.push_back(obj);
+        }
+    }
+    void RememberIfYoungReferrer(ObjectPtr obj);
+    // Old copy of the young object, copying it on the first visit.
+    ObjectPtr Evacuate(ObjectPtr obj);
+    void DestroyNursery();
+
+    bool IsMarked(size_t index) const {
+        return (mark_bits_[index / 64] >> (index % 64) & 1) != 0;
+    }
+    // Sets the mark bit of an old object, returns false if it was already set.
+    bool TryMark(ObjectPtr obj);
+    void Shade(ObjectPtr obj) {
+        if (TryMark(obj)) {
+            grey_.Push(obj);
+        }
+    }
+    void TraceStackRoots(Tracer& tracer);
+    void StartCycle();
+    // Traces a chunk of the parts of the grey object being traced, taking the next one from
+    // the grey stack first if there is none. Returns the work done.
+    size_t MarkChunk(Marker& marker);
+    // Advances the current cycle until it ends, work_limit units of work are done or the
+    // deadline passes. Returns the work done.
+    size_t Step(size_t work_limit, Clock::time_point deadline);
+    void RunAllocationSlice();
+
+    inline static thread_local GC* current_ = nullptr;
+
     std::vector<ObjectPtr> roots_;
-    std::vector<ObjectPtr> allocations_;
+    // Innermost root on the native stack.
+    StackRoot* stack_roots_ = nullptr;
+    friend StackRoot;
+    std::unique_ptr<std::byte[]> nursery_;
+    std::byte* top_;
+    std::vector<ObjectPtr> remembered_;
+    // Young objects which own storage, the only ones destroyed with the nursery.
+    std::vector<ObjectPtr> young_owners_;
+    // External bytes of the young owners. The nursery counts as full once they reach its
+    // size, so huge young buffers are tenured and accounted for by the old generation.
+    size_t young_external_bytes_ = 0;
+    // Promoted objects whose fields are not evacuated yet.
+    std::vector<ObjectPtr> promoted_;
+
+    // Old generation table, freed slots are reused.
+    std::vector<OldObject> old_;
+    std::vector<size_t> free_slots_;
+    std::vector<SlabPool> pools_;
+    // Sizes of the old objects with their external bytes.
+    size_t old_bytes_ = 0;
+    // Size of the old generation that starts the next cycle.
+    size_t cycle_trigger_ = kMinHeapBytes;
+
+    Phase phase_ = Phase::Idle;
+    std::vector<uint64_t> mark_bits_;
+    MarkStack grey_{kDefaultMarkChunkSize};
+    // Grey object traced in parts, the parts it had when tracing started and the next part.
+    ObjectPtr tracing_ = nullptr;
+    size_t tracing_parts_ = 0;
+    size_t tracing_pos_ = 0;
+    size_t sweep_pos_ = 0;
+    size_t sweep_end_ = 0;
+    size_t allocated_since_slice_ = 0;
+    // Allocated bytes which start the next slice and work left by earlier slices.
+    size_t slice_bytes_ = kSliceBytes;
+    size_t work_debt_ = 0;
+
+    size_t mark_chunk_size_ = kDefaultMarkChunkSize;
+    std::chrono::microseconds max_pause_ = kDefaultMaxPause;
+    double growth_factor_ = kDefaultGrowthFactor;
 };
 
 namespace runtime {
 template <DerivedFrom T, typename... Args>
 T* New(Args&&... args) {
-    return GC::GetInstance().New<T>(std::forward<Args>(args)...);
+    return GC::GetCurrent().New<T>(std::forward<Args>(args)...);
+}
+
+template <DerivedFrom T, typename... Args>
+T* NewTenured(Args&&... args) {
+    return GC::GetCurrent().NewTenured<T>(std::forward<Args>(args)...);
 }
 }  // namespace runtime
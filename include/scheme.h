@@ -1,10 +1,113 @@
 #pragma once
 
+#include <functional>
+#include <istream>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
+#include "runtime.h"
+#include "scope.h"
 
+enum class EvalMode {
+    TreeWalk,  // reference evaluator walking the AST
+    Bytecode,  // compile each expression and run it on the VM
+};
+
+class FrozenEnvironment;
+
+// Every interpreter has its own heap and scope stack, made current on the calling thread
+// while one of its methods runs. Interpreters may run on different threads concurrently,
+// one interpreter must not be used by two threads at once. Values passed to callbacks
+// belong to the heap of the interpreter and die with it.
 class Interpreter {
 public:
-    Interpreter();
+    // The global bindings of environment are visible to the interpreter without copying
+    // them into its heap.
+    explicit Interpreter(EvalMode mode = EvalMode::Bytecode,
+                         std::shared_ptr<const FrozenEnvironment> environment = nullptr);
     ~Interpreter();
+    Interpreter(const Interpreter&) = delete;
+    Interpreter& operator=(const Interpreter&) = delete;
     std::string Run(const std::string&);
+    // Passes the value to on_value while it is valid, before the collector may move it,
+    // e.g. to write it straight to a stream.
+    void Run(const std::string&, const std::function<void(ObjectPtr)>& on_value);
+    // Evaluate every top-level form in turn, passing each value to on_value if it is set.
+    // Stop at the first error.
+    void RunStream(std::istream& in, const std::function<void(ObjectPtr)>& on_value = {});
+    void RunFile(const std::string& path, const std::function<void(ObjectPtr)>& on_value = {});
+    // Heap images of the global bindings, see image.h. Loading one replaces running
+    // the code which created them, e.g. a prelude.
+    void SaveImage(const std::string& path);
+    void LoadImage(const std::string& path);
+    // RunFile keeps the parsed forms of each file in a code cache, see image.h: next to
+    // the file with a "c" appended to its name, or in dir named by the hash of the source.
+    void EnableCodeCache(const std::string& dir = {});
+    std::vector<PoolStats> GetPoolStats() const;
+    // Runs body with the interpreter current, passing its global scope, e.g. to run tasks
+    // on a worker thread. The collector may run after body returns.
+    void Enter(const std::function<void(GlobalScopePtr global_scope)>& body);
+    const std::shared_ptr<const FrozenEnvironment>& GetEnvironment() const {
+        return environment_;
+    }
+    // Interpreter running on the calling thread.
+    static Interpreter& GetCurrent() {
+        return *current_;
+    }
+    EvalMode GetMode() const {
+        return mode_;
+    }
+    void SetMode(EvalMode mode) {
+        mode_ = mode;
+    }
+
+private:
+    // Makes the heap and the scope stack of an interpreter current while it lives.
+    class Activation;
+
+    std::string GetCodeCachePath(const std::string& path, std::string_view source) const;
+    void RunCached(const std::string& path, const std::function<void(ObjectPtr)>& on_value);
+    void RunForm(ObjectPtr ast, const std::function<void(ObjectPtr)>& on_value);
+    ObjectPtr Evaluate(ObjectPtr ast);
+
+    inline static thread_local Interpreter* current_ = nullptr;
+
+    EvalMode mode_;
+    std::shared_ptr<const FrozenEnvironment> environment_;
+    std::unique_ptr<GC> heap_;
+    std::unique_ptr<ScopeStack> scopes_;
+    GlobalScopePtr global_scope_;
+    bool code_cache_ = false;
+    std::string code_cache_dir_;
+};
+
+// Global bindings frozen into a heap of their own, which is never collected or changed
+// afterwards, e.g. a prelude shared by many interpreters. Their global scopes look names
+// up in the environment when they have no binding of their own, define and set! of such
+// a name bind it in the global scope of the interpreter, shadowing the frozen one. Other
+// changes of frozen objects, e.g. vector-set! of a frozen vector, raise RuntimeError.
+// An environment lives while the interpreters created with it do.
+class FrozenEnvironment {
+public:
+    // Bindings of the heap image at path, see Interpreter::LoadImage.
+    static std::shared_ptr<const FrozenEnvironment> LoadImage(const std::string& path);
+    // Copy of the global bindings of interpreter, which refers to its environment.
+    static std::shared_ptr<const FrozenEnvironment> Freeze(Interpreter* interpreter);
+    GlobalScopePtr GetGlobalScope() const {
+        return global_scope_;
+    }
+    // Copies of frozen scopes changed before the environment was frozen.
+    const ScopeStack::Shadows& GetShadows() const {
+        return shadows_;
+    }
+
+private:
+    explicit FrozenEnvironment(std::shared_ptr<const FrozenEnvironment> base);
+    // Freezes the heap once the bindings are in place.
+    void Seal();
+
+    std::unique_ptr<Interpreter> interpreter_;
+    GlobalScopePtr global_scope_ = nullptr;
+    ScopeStack::Shadows shadows_;
 };
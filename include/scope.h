@@ -1,18 +1,31 @@
 #pragma once
 
 #include "object.h"
-#include <stack>
 #include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 class Scope;
 using ScopePtr = Scope*;
+class GlobalScope;
+using GlobalScopePtr = GlobalScope*;
+class Frame;
+using FramePtr = Frame*;
 
+// Link of the chain of scopes code is evaluated in: frames of calls, innermost first, and
+// the global scope at the end. Frames hold resolved local variables in slots, names are
+// bound only in global scopes.
 class Scope : public Object {
 public:
-    explicit Scope(ScopePtr parent = nullptr);
-    void Define(const std::string& name, ObjectPtr obj);
-    void Set(const std::string& name, ObjectPtr obj);
-    ObjectPtr Get(const std::string& name);
+    static constexpr TypeRange kTypes{ObjectType::GlobalScope, ObjectType::Frame};
+
+    ScopePtr GetParent() const {
+        return parent_;
+    }
+    // Global scope at the end of the chain. Frozen global scopes stand for the global scope
+    // of the running interpreter.
+    GlobalScopePtr GetGlobal();
     ObjectPtr Eval() override {
         return this;
     }
@@ -20,42 +33,192 @@ public:
         return "Scope";
     }
 
-private:
+protected:
+    Scope(ObjectType type, ScopePtr parent) : Object(type), parent_(parent) {
+    }
+
     ScopePtr parent_;
-    std::unordered_map<std::string, ObjectPtr> mapping_;
 };
 
+class GlobalScope : public Scope {
+public:
+    static constexpr TypeRange kTypes = ObjectType::GlobalScope;
+
+    GlobalScope();
+    void Define(SymbolPtr name, ObjectPtr obj);
+    // Setting a binding of the base defines it here, shadowing the frozen one.
+    void Set(SymbolPtr name, ObjectPtr obj);
+    ObjectPtr Get(SymbolPtr name);
+    // Binding of name in this scope or its base, nullptr if there is none.
+    ObjectPtr* Find(SymbolPtr name);
+    // Frozen global scope whose bindings a global scope has unless it defines its own,
+    // see FrozenEnvironment. It is kept alive by the environment, not traced.
+    void SetBase(GlobalScopePtr base) {
+        base_ = base;
+    }
+    GlobalScopePtr GetBase() const {
+        return base_;
+    }
+    // Own bindings, without the ones of the base.
+    const std::unordered_map<SymbolPtr, ObjectPtr>& GetBindings() const {
+        return mapping_;
+    }
+    void Trace(Tracer& tracer) override;
+    // Parts are buckets of the mapping, so they change when it rehashes.
+    size_t GetTraceParts() const override {
+        return mapping_.bucket_count();
+    }
+    void TraceParts(Tracer& tracer, size_t begin, size_t end) override;
+    size_t GetExternalSize() const override;
+
+private:
+    GlobalScopePtr base_ = nullptr;
+    std::unordered_map<SymbolPtr, ObjectPtr> mapping_;
+};
+
+// Frame of a call. Its slots follow the fields in the same heap block, so a call makes
+// a single allocation of the size of its frame.
+class Frame final : public Scope {
+public:
+    static constexpr TypeRange kTypes = ObjectType::Frame;
+
+    // Frame with slots_count slots set to init, in the old generation if tenured.
+    static FramePtr Make(ScopePtr parent, size_t slots_count, ObjectPtr init,
+                         bool tenured = false);
+    // Moves the slots with the frame, used by the collector.
+    Frame(Frame&& other);
+    ObjectPtr GetSlot(size_t index) const {
+        return GetSlots()[index];
+    }
+    void SetSlot(size_t index, ObjectPtr obj);
+    size_t GetSlotsCount() const {
+        return slots_count_;
+    }
+    // Frame holding the slots of this one for the running interpreter: this one unless it
+    // is frozen and the interpreter has changed it, see ScopeStack::Shadow.
+    FramePtr ForReading();
+    // Same, copying a frozen frame on the first change.
+    FramePtr ForWriting();
+    // Tenured copy, with the same parent and slots.
+    FramePtr Copy() const;
+    void Trace(Tracer& tracer) override;
+
+private:
+    Frame(ScopePtr parent, size_t slots_count, ObjectPtr init);
+    friend GC;
+
+    ObjectPtr* GetSlots() {
+        return reinterpret_cast<ObjectPtr*>(this + 1);
+    }
+    const ObjectPtr* GetSlots() const {
+        return reinterpret_cast<const ObjectPtr*>(this + 1);
+    }
+
+    uint32_t slots_count_;
+};
+
+template <>
+inline constexpr bool kOwnsStorage<Frame> = false;
+
+// Scopes being evaluated, one stack per interpreter like the heap.
 class ScopeStack {
 public:
-    static ScopeStack& GetInstance() {
-        static ScopeStack instance;
-        return instance;
+    ScopeStack() = default;
+    static ScopeStack& GetCurrent() {
+        return *current_;
+    }
+    // Makes stack current on the calling thread, returns the previous one.
+    static ScopeStack* SetCurrent(ScopeStack* stack) {
+        return std::exchange(current_, stack);
     }
 
     ScopePtr Current();
+    // Scope at the bottom: the global scope of the interpreter.
+    GlobalScopePtr GetGlobal();
 
     void Push(ScopePtr scope);
 
     void Pop();
 
+    void Replace(ScopePtr scope);
+
+    // Frozen frames are shared, so a frame captured by a frozen closure which an interpreter
+    // changes, e.g. the count of a counter, is copied into its heap on the first change
+    // and read from the copy from then on. Copies come from the interpreter, then from its
+    // environment, which keeps the ones made before it was frozen.
+    using Shadows = std::unordered_map<FramePtr, FramePtr>;
+
+    // Copy of the frozen frame, or the frame itself if no one has changed it.
+    FramePtr GetShadow(FramePtr frozen) const;
+    // Copy of the frozen frame owned by the interpreter, made on the first call.
+    FramePtr Shadow(FramePtr frozen);
+    // Makes copy, a tenured frame, the copy of frozen, e.g. one made by another interpreter.
+    void SetShadow(FramePtr frozen, FramePtr copy);
+    // Copies made by the interpreter.
+    const Shadows& GetShadows() const {
+        return shadows_;
+    }
+    // Copies made before the environment was frozen, which must outlive the stack.
+    void SetEnvironmentShadows(const Shadows* shadows) {
+        environment_shadows_ = shadows;
+    }
+
 private:
-    ScopeStack() = default;
-    std::stack<ScopePtr> scopes_;
+    inline static thread_local ScopeStack* current_ = nullptr;
+
+    std::vector<ScopePtr> scopes_;
+    Shadows shadows_;
+    const Shadows* environment_shadows_ = nullptr;
 };
 
-class ScopeGuard {
+inline FramePtr Frame::ForReading() {
+    return IsFrozen() ? ScopeStack::GetCurrent().GetShadow(this) : this;
+}
+
+inline FramePtr Frame::ForWriting() {
+    return IsFrozen() ? ScopeStack::GetCurrent().Shadow(this) : this;
+}
+
+// Makes a scope current and roots it while the guard lives. An empty guard enters
+// scopes later, each one replacing the previous: a call in tail position replaces
+// the frame of its caller.
+class ScopeGuard final : public StackRoot {
 public:
-    explicit ScopeGuard(ScopePtr scope) {
-        ScopeStack::GetInstance().Push(scope);
+    ScopeGuard() : scope_(nullptr) {
+    }
+
+    explicit ScopeGuard(ScopePtr scope) : scope_(scope) {
+        ScopeStack::GetCurrent().Push(scope);
     }
 
     ~ScopeGuard() {
-        ScopeStack::GetInstance().Pop();
+        if (scope_ != nullptr) {
+            ScopeStack::GetCurrent().Pop();
+        }
+    }
+
+    void Enter(ScopePtr scope) {
+        if (scope_ == nullptr) {
+            ScopeStack::GetCurrent().Push(scope);
+        } else {
+            ScopeStack::GetCurrent().Replace(scope);
+        }
+        scope_ = scope;
     }
 
     ScopePtr CurrentScope() {
-        return ScopeStack::GetInstance().Current();
+        return ScopeStack::GetCurrent().Current();
+    }
+
+    void Trace(Tracer& tracer) override {
+        tracer(scope_);
     }
+
+private:
+    ScopePtr scope_;
 };
 
-ScopePtr CreateGlobalScope();
\ No newline at end of file
+// Value of a frame slot whose define has not been executed yet.
+SymbolPtr UnboundSlot();
+
+GlobalScopePtr CreateGlobalScope();
\ No newline at end of file
@@ -1,15 +1,15 @@
 #pragma once
 
-#include <unordered_map>
 #include <variant>
-#include <istream>
-#include <cstdio>
-#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
 
 #include "tokenizer_utils.h"
 
+// Names and literals are views into the input of the tokenizer.
 struct SymbolToken {
-    std::string name;
+    std::string_view name;
 
     bool operator==(const SymbolToken& other) const;
 };
@@ -22,26 +22,32 @@ struct DotToken {
     bool operator==(const DotToken&) const;
 };
 
-enum class BracketToken { OPEN, CLOSE };
+// OPEN_VECTOR is the '#(' starting a vector literal.
+enum class BracketToken { OPEN, OPEN_VECTOR, CLOSE };
 
 struct ConstantToken {
-    int value;
+    int64_t value;
+    // Signed decimal literal if it doesn't fit into value, empty otherwise.
+    std::string_view big_value;
 
     bool operator==(const ConstantToken& other) const;
 };
 
-using Token = std::variant<ConstantToken, BracketToken, SymbolToken, QuoteToken, DotToken>;
+// Literal with a fraction or an exponent.
+struct FlonumToken {
+    double value;
 
-const std::unordered_map<char, Token> kOneSymbolMapping = {
-    {'(', Token{BracketToken::OPEN}},
-    {')', Token{BracketToken::CLOSE}},
-    {'.', Token{DotToken{}}},
-    {'\'', Token{QuoteToken{}}},
+    bool operator==(const FlonumToken& other) const;
 };
 
+using Token =
+    std::variant<ConstantToken, FlonumToken, BracketToken, SymbolToken, QuoteToken, DotToken>;
+
+// Splits a contiguous buffer into tokens without copying it. The buffer must outlive
+// the tokenizer and the tokens read from it.
 class Tokenizer {
 public:
-    Tokenizer(std::istream* in);
+    explicit Tokenizer(std::string_view input);
 
     bool IsEnd();
 
@@ -49,22 +55,20 @@ public:
 
     Token GetToken();
 
+    // Offset in the input of the next token not read yet.
+    size_t GetPosition() const {
+        return pos_;
+    }
+
 private:
+    // Current character, '\0' at the end.
+    char Peek() const;
     Token GetTokenMove();
+    // Reads the fraction and the exponent of the literal which started at start.
+    Token ReadFlonum(size_t start);
 
-    std::istream* in_;
+    std::string_view input_;
+    size_t pos_ = 0;
     Token last_token_;
     bool empty_;
 };
-
-bool IsValidTokenStart(char symbol);
-
-bool IsAlphabet(char symbol);
-
-bool IsDigit(char symbol);
-
-bool IsOneSymbolToken(char symbol);
-
-bool IsMathOp(char symbol);
-
-bool IsSpecialSymbolStart(char symbol);
\ No newline at end of file
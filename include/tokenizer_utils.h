@@ -1,3 +1,8 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
 namespace token_symbols {
 
 namespace alphabet {
@@ -51,8 +56,106 @@ enum class TokenTypes {
     None,
 };
 
-bool IsValidTokenSymbol(char symbol);
+constexpr bool IsAlphabet(char symbol) {
+    return (symbol >= token_symbols::alphabet::kLowLettersStart &&
+            symbol <= token_symbols::alphabet::kLowLettersEnd) ||
+           (symbol >= token_symbols::alphabet::kBigLettersStart &&
+            symbol <= token_symbols::alphabet::kBigLettersEnd);
+}
+
+constexpr bool IsSign(char symbol) {
+    return symbol == token_symbols::signs::kPlus || symbol == token_symbols::signs::kMinus;
+}
+
+constexpr bool IsMathOp(char symbol) {
+    switch (symbol) {
+        case token_symbols::math_ops::kDiv:
+        case token_symbols::math_ops::kMultiply:
+        case token_symbols::math_ops::kPlus:
+        case token_symbols::math_ops::kMinus:
+        case token_symbols::math_ops::kLess:
+        case token_symbols::math_ops::kGreater:
+        case token_symbols::math_ops::kEqual:
+            return true;
+        default:
+            return false;
+    }
+}
+
+constexpr bool IsSpecialSymbolStart(char symbol) {
+    return symbol == token_symbols::special_symbols::kHash;
+}
+
+constexpr bool IsSpecialSymbol(char symbol) {
+    switch (symbol) {
+        case token_symbols::special_symbols::kHash:
+        case token_symbols::special_symbols::kQuestionMark:
+        case token_symbols::special_symbols::kExclamation:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Character classes
+
+// Bits of kCharClasses, one lookup per character instead of a chain of comparisons.
+namespace char_classes {
+constexpr uint8_t kDigit = 1;
+constexpr uint8_t kOneSymbolToken = 2;
+constexpr uint8_t kTokenStart = 4;
+constexpr uint8_t kTokenSymbol = 8;
+}  // namespace char_classes
+
+constexpr std::array<uint8_t, 256> MakeCharClasses() {
+    std::array<uint8_t, 256> classes{};
+    for (int code = 0; code < 256; ++code) {
+        char symbol = static_cast<char>(code);
+        bool is_digit = symbol >= token_symbols::digits::kDigitsStart &&
+                        symbol <= token_symbols::digits::kDigitsEnd;
+        bool is_one_symbol = symbol == token_symbols::one_symbol_tokens::kOpenParen ||
+                             symbol == token_symbols::one_symbol_tokens::kCloseParen ||
+                             symbol == token_symbols::one_symbol_tokens::kDot ||
+                             symbol == token_symbols::one_symbol_tokens::kQuote;
+        bool is_common = IsAlphabet(symbol) || is_digit || IsMathOp(symbol);
+        uint8_t bits = 0;
+        if (is_digit) {
+            bits |= char_classes::kDigit;
+        }
+        if (is_one_symbol) {
+            bits |= char_classes::kOneSymbolToken;
+        }
+        if (is_common || is_one_symbol || IsSpecialSymbolStart(symbol)) {
+            bits |= char_classes::kTokenStart;
+        }
+        if (is_common || IsSpecialSymbol(symbol)) {
+            bits |= char_classes::kTokenSymbol;
+        }
+        classes[code] = bits;
+    }
+    return classes;
+}
+
+inline constexpr std::array<uint8_t, 256> kCharClasses = MakeCharClasses();
+
+inline bool HasCharClass(char symbol, uint8_t char_class) {
+    return (kCharClasses[static_cast<uint8_t>(symbol)] & char_class) != 0;
+}
+
+inline bool IsDigit(char symbol) {
+    return HasCharClass(symbol, char_classes::kDigit);
+}
+
+inline bool IsOneSymbolToken(char symbol) {
+    return HasCharClass(symbol, char_classes::kOneSymbolToken);
+}
+
+inline bool IsValidTokenStart(char symbol) {
+    return HasCharClass(symbol, char_classes::kTokenStart);
+}
 
-bool IsDigit(char symbol);
+inline bool IsValidTokenSymbol(char symbol) {
+    return HasCharClass(symbol, char_classes::kTokenSymbol);
+}
 
-bool IsSign(char symbol);
+// End of Character classes
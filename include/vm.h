@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "bytecode.h"
+#include "object.h"
+#include "scope.h"
+
+// Procedure created by the bytecode VM for lambda expressions.
+class Closure : public Procedure {
+public:
+    static constexpr TypeRange kTypes = ObjectType::Closure;
+
+    Closure(PrototypePtr proto, ScopePtr scope);
+    ObjectPtr Apply(const Args&) override;
+    PrototypePtr GetPrototype() const {
+        return proto_;
+    }
+    ScopePtr GetScope() const {
+        return captured_scope_;
+    }
+    std::string ToString() override {
+        return "lambda_func";
+    }
+    void Trace(Tracer& tracer) override {
+        tracer(proto_);
+        tracer(captured_scope_);
+    }
+
+private:
+    PrototypePtr proto_;
+    ScopePtr captured_scope_;
+};
+
+template <>
+inline constexpr bool kOwnsStorage<Closure> = false;
+
+// Stack machine executing prototypes produced by Compiler.
+// Calls of closures don't consume native stack, tail calls reuse the caller frame.
+// The value stack and the frames are roots while the machine exists.
+class VirtualMachine final : public StackRoot {
+public:
+    explicit VirtualMachine(GlobalScopePtr global_scope);
+
+    // Runs top-level prototype in the global scope.
+    ObjectPtr Execute(PrototypePtr proto);
+
+    ObjectPtr Call(Closure* closure, const Args& args);
+
+    void Trace(Tracer& tracer) override;
+
+private:
+    struct CallFrame {
+        PrototypePtr proto;
+        size_t pc;
+        ScopePtr scope;
+        size_t base;
+    };
+
+    // Frame for the closure with arguments taken from the top of the stack.
+    FramePtr MakeFrame(Closure* closure, size_t args_count);
+    ObjectPtr Run();
+
+    GlobalScopePtr global_scope_;
+    std::vector<ObjectPtr> stack_;
+    std::vector<CallFrame> frames_;
+};
@@ -0,0 +1,388 @@
+#include "bignum.h"
+#include <algorithm>
+#include <bit>
+#include <span>
+#include <utility>
+#include "runtime.h"
+
+namespace {
+
+using Limbs = std::vector<uint32_t>;
+using LimbSpan = std::span<const uint32_t>;
+
+constexpr uint64_t kBase = uint64_t{1} << 32;
+// Operands shorter than this are multiplied by the schoolbook method.
+constexpr size_t kKaratsubaThreshold = 32;
+// Largest power of ten in a limb and its number of digits, used for decimal conversion.
+constexpr uint32_t kDecimalBase = 1000000000;
+constexpr size_t kDecimalDigits = 9;
+
+LimbSpan Trimmed(LimbSpan limbs) {
+    while (!limbs.empty() && limbs.back() == 0) {
+        limbs = limbs.first(limbs.size() - 1);
+    }
+    return limbs;
+}
+
+void Trim(Limbs* limbs) {
+    while (!limbs->empty() && limbs->back() == 0) {
+        limbs->pop_back();
+    }
+}
+
+int CompareMagnitudes(LimbSpan lhs, LimbSpan rhs) {
+    if (lhs.size() != rhs.size()) {
+        return lhs.size() < rhs.size() ? -1 : 1;
+    }
+    for (size_t i = lhs.size(); i > 0; --i) {
+        if (lhs[i - 1] != rhs[i - 1]) {
+            return lhs[i - 1] < rhs[i - 1] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+Limbs AddMagnitudes(LimbSpan lhs, LimbSpan rhs) {
+    if (lhs.size() < rhs.size()) {
+        std::swap(lhs, rhs);
+    }
+    Limbs res(lhs.size() + 1);
+    uint64_t carry = 0;
+    for (size_t i = 0; i < lhs.size(); ++i) {
+        uint64_t sum = carry + lhs[i] + (i < rhs.size() ? rhs[i] : 0);
+        res[i] = static_cast<uint32_t>(sum);
+        carry = sum >> 32;
+    }
+    res.back() = static_cast<uint32_t>(carry);
+    Trim(&res);
+    return res;
+}
+
+// lhs must not be less than rhs.
+Limbs SubtractMagnitudes(LimbSpan lhs, LimbSpan rhs) {
+    Limbs res(lhs.size());
+    uint64_t borrow = 0;
+    for (size_t i = 0; i < lhs.size(); ++i) {
+        uint64_t diff = uint64_t{lhs[i]} - (i < rhs.size() ? rhs[i] : 0) - borrow;
+        res[i] = static_cast<uint32_t>(diff);
+        borrow = diff >> 63;
+    }
+    Trim(&res);
+    return res;
+}
+
+// Adds value shifted by offset limbs to *acc, which must be long enough for the sum.
+void AddShifted(Limbs* acc, LimbSpan value, size_t offset) {
+    value = Trimmed(value);
+    uint64_t carry = 0;
+    for (size_t i = 0; i < value.size() || carry != 0; ++i) {
+        uint64_t sum = carry + (*acc)[offset + i] + (i < value.size() ? value[i] : 0);
+        (*acc)[offset + i] = static_cast<uint32_t>(sum);
+        carry = sum >> 32;
+    }
+}
+
+// Subtracts value from *acc, which must not become negative.
+void SubtractFrom(Limbs* acc, LimbSpan value) {
+    value = Trimmed(value);
+    uint64_t borrow = 0;
+    for (size_t i = 0; i < value.size() || borrow != 0; ++i) {
+        uint64_t diff = uint64_t{(*acc)[i]} - (i < value.size() ? value[i] : 0) - borrow;
+        (*acc)[i] = static_cast<uint32_t>(diff);
+        borrow = diff >> 63;
+    }
+}
+
+Limbs MultiplySchoolbook(LimbSpan lhs, LimbSpan rhs) {
+    Limbs res(lhs.size() + rhs.size());
+    for (size_t i = 0; i < lhs.size(); ++i) {
+        uint64_t carry = 0;
+        for (size_t j = 0; j < rhs.size(); ++j) {
+            uint64_t cur = uint64_t{lhs[i]} * rhs[j] + res[i + j] + carry;
+            res[i + j] = static_cast<uint32_t>(cur);
+            carry = cur >> 32;
+        }
+        res[i + rhs.size()] = static_cast<uint32_t>(carry);
+    }
+    return res;
+}
+
+// Product of the magnitudes, may have leading zero limbs.
+Limbs MultiplyMagnitudes(LimbSpan lhs, LimbSpan rhs) {
+    lhs = Trimmed(lhs);
+    rhs = Trimmed(rhs);
+    if (lhs.size() < rhs.size()) {
+        std::swap(lhs, rhs);
+    }
+    if (rhs.size() < kKaratsubaThreshold) {
+        return MultiplySchoolbook(lhs, rhs);
+    }
+    Limbs res(lhs.size() + rhs.size());
+    if (lhs.size() >= 2 * rhs.size()) {
+        // Unbalanced operands: multiplies rhs by slices of lhs of the same length.
+        for (size_t offset = 0; offset < lhs.size(); offset += rhs.size()) {
+            size_t count = std::min(rhs.size(), lhs.size() - offset);
+            AddShifted(&res, MultiplyMagnitudes(lhs.subspan(offset, count), rhs), offset);
+        }
+        return res;
+    }
+    // (a1 B + a0)(b1 B + b0) = z2 B^2 + z1 B + z0 with z1 = (a1 + a0)(b1 + b0) - z2 - z0.
+    size_t half = lhs.size() / 2;
+    LimbSpan lhs_low = lhs.first(half);
+    LimbSpan lhs_high = lhs.subspan(half);
+    LimbSpan rhs_low = rhs.first(half);
+    LimbSpan rhs_high = rhs.subspan(half);
+    Limbs low = MultiplyMagnitudes(lhs_low, rhs_low);
+    Limbs high = MultiplyMagnitudes(lhs_high, rhs_high);
+    Limbs middle = MultiplyMagnitudes(AddMagnitudes(Trimmed(lhs_low), lhs_high),
+                                      AddMagnitudes(Trimmed(rhs_low), rhs_high));
+    SubtractFrom(&middle, low);
+    SubtractFrom(&middle, high);
+    AddShifted(&res, low, 0);
+    AddShifted(&res, middle, half);
+    AddShifted(&res, high, 2 * half);
+    return res;
+}
+
+// Divides the magnitude in place, returns the remainder.
+uint32_t DivideSmall(Limbs* limbs, uint32_t divisor) {
+    uint64_t rem = 0;
+    for (size_t i = limbs->size(); i > 0; --i) {
+        uint64_t cur = (rem << 32) | (*limbs)[i - 1];
+        (*limbs)[i - 1] = static_cast<uint32_t>(cur / divisor);
+        rem = cur % divisor;
+    }
+    Trim(limbs);
+    return static_cast<uint32_t>(rem);
+}
+
+// Multiplies the magnitude by factor and adds addend in place.
+void MultiplyAddSmall(Limbs* limbs, uint32_t factor, uint32_t addend) {
+    uint64_t carry = addend;
+    for (uint32_t& limb : *limbs) {
+        uint64_t cur = uint64_t{limb} * factor + carry;
+        limb = static_cast<uint32_t>(cur);
+        carry = cur >> 32;
+    }
+    if (carry != 0) {
+        limbs->push_back(static_cast<uint32_t>(carry));
+    }
+}
+
+// Quotient of the magnitudes by Knuth's algorithm D, divisor must not be zero.
+Limbs DivideMagnitudes(LimbSpan dividend, LimbSpan divisor) {
+    if (CompareMagnitudes(dividend, divisor) < 0) {
+        return {};
+    }
+    if (divisor.size() == 1) {
+        Limbs quotient(dividend.begin(), dividend.end());
+        DivideSmall(&quotient, divisor[0]);
+        return quotient;
+    }
+    // Normalizes so the top limb of the divisor has its high bit set.
+    size_t n = divisor.size();
+    size_t m = dividend.size() - n;
+    int shift = std::countl_zero(divisor.back());
+    Limbs v(n);
+    for (size_t i = n - 1; i > 0; --i) {
+        v[i] = static_cast<uint32_t>((uint64_t{divisor[i]} << shift) |
+                                     (uint64_t{divisor[i - 1]} >> (32 - shift)));
+    }
+    v[0] = divisor[0] << shift;
+    Limbs u(dividend.size() + 1);
+    u.back() = static_cast<uint32_t>(uint64_t{dividend.back()} >> (32 - shift));
+    for (size_t i = dividend.size() - 1; i > 0; --i) {
+        u[i] = static_cast<uint32_t>((uint64_t{dividend[i]} << shift) |
+                                     (uint64_t{dividend[i - 1]} >> (32 - shift)));
+    }
+    u[0] = dividend[0] << shift;
+
+    Limbs quotient(m + 1);
+    for (size_t j = m + 1; j > 0;) {
+        --j;
+        uint64_t top = (uint64_t{u[j + n]} << 32) | u[j + n - 1];
+        uint64_t qhat = top / v[n - 1];
+        uint64_t rhat = top % v[n - 1];
+        while (qhat >= kBase || qhat * v[n - 2] > ((rhat << 32) | u[j + n - 2])) {
+            --qhat;
+            rhat += v[n - 1];
+            if (rhat >= kBase) {
+                break;
+            }
+        }
+        // Multiplies and subtracts, then adds back if qhat was still one too large.
+        int64_t borrow = 0;
+        int64_t diff;
+        for (size_t i = 0; i < n; ++i) {
+            uint64_t product = qhat * v[i];
+            diff = u[i + j] - borrow - static_cast<int64_t>(product & 0xffffffff);
+            u[i + j] = static_cast<uint32_t>(diff);
+            borrow = static_cast<int64_t>(product >> 32) - (diff >> 32);
+        }
+        diff = u[j + n] - borrow;
+        u[j + n] = static_cast<uint32_t>(diff);
+        if (diff < 0) {
+            --qhat;
+            uint64_t carry = 0;
+            for (size_t i = 0; i < n; ++i) {
+                uint64_t sum = uint64_t{u[i + j]} + v[i] + carry;
+                u[i + j] = static_cast<uint32_t>(sum);
+                carry = sum >> 32;
+            }
+            u[j + n] += static_cast<uint32_t>(carry);
+        }
+        quotient[j] = static_cast<uint32_t>(qhat);
+    }
+    Trim(&quotient);
+    return quotient;
+}
+
+}  // namespace
+
+// BigInteger
+
+BigInteger::BigInteger(int64_t value) : negative_(value < 0) {
+    uint64_t magnitude = negative_ ? 0 - static_cast<uint64_t>(value) : value;
+    for (; magnitude != 0; magnitude >>= 32) {
+        limbs_.push_back(static_cast<uint32_t>(magnitude));
+    }
+}
+
+BigInteger::BigInteger(bool negative, Limbs limbs) : limbs_(std::move(limbs)) {
+    Trim(&limbs_);
+    negative_ = negative && !limbs_.empty();
+}
+
+BigInteger BigInteger::Parse(std::string_view text) {
+    bool negative = !text.empty() && text.front() == '-';
+    if (!text.empty() && (text.front() == '-' || text.front() == '+')) {
+        text.remove_prefix(1);
+    }
+    Limbs limbs;
+    // The first chunk takes the digits above a multiple of the chunk length.
+    size_t chunk = text.size() % kDecimalDigits;
+    if (chunk == 0) {
+        chunk = kDecimalDigits;
+    }
+    while (!text.empty()) {
+        uint32_t factor = 1;
+        uint32_t value = 0;
+        for (char digit : text.substr(0, chunk)) {
+            factor *= 10;
+            value = value * 10 + (digit - '0');
+        }
+        MultiplyAddSmall(&limbs, factor, value);
+        text.remove_prefix(chunk);
+        chunk = kDecimalDigits;
+    }
+    return BigInteger{negative, std::move(limbs)};
+}
+
+bool BigInteger::ToInt64(int64_t* value) const {
+    if (limbs_.size() > 2) {
+        return false;
+    }
+    uint64_t magnitude = 0;
+    for (size_t i = limbs_.size(); i > 0; --i) {
+        magnitude = (magnitude << 32) | limbs_[i - 1];
+    }
+    uint64_t limit = uint64_t{1} << 63;
+    if (negative_ ? magnitude > limit : magnitude >= limit) {
+        return false;
+    }
+    *value = negative_ ? static_cast<int64_t>(0 - magnitude) : static_cast<int64_t>(magnitude);
+    return true;
+}
+
+double BigInteger::ToDouble() const {
+    double res = 0;
+    for (size_t i = limbs_.size(); i > 0; --i) {
+        res = res * static_cast<double>(kBase) + limbs_[i - 1];
+    }
+    return negative_ ? -res : res;
+}
+
+std::string BigInteger::ToString() const {
+    if (limbs_.empty()) {
+        return "0";
+    }
+    std::vector<uint32_t> chunks;
+    Limbs rest = limbs_;
+    while (!rest.empty()) {
+        chunks.push_back(DivideSmall(&rest, kDecimalBase));
+    }
+    std::string res = negative_ ? "-" : "";
+    res += std::to_string(chunks.back());
+    for (size_t i = chunks.size() - 1; i > 0; --i) {
+        std::string chunk = std::to_string(chunks[i - 1]);
+        res.append(kDecimalDigits - chunk.size(), '0');
+        res += chunk;
+    }
+    return res;
+}
+
+BigInteger BigInteger::operator-() const {
+    return BigInteger{!negative_, limbs_};
+}
+
+BigInteger operator+(const BigInteger& lhs, const BigInteger& rhs) {
+    if (lhs.negative_ == rhs.negative_) {
+        return BigInteger{lhs.negative_, AddMagnitudes(lhs.limbs_, rhs.limbs_)};
+    }
+    if (CompareMagnitudes(lhs.limbs_, rhs.limbs_) >= 0) {
+        return BigInteger{lhs.negative_, SubtractMagnitudes(lhs.limbs_, rhs.limbs_)};
+    }
+    return BigInteger{rhs.negative_, SubtractMagnitudes(rhs.limbs_, lhs.limbs_)};
+}
+
+BigInteger operator-(const BigInteger& lhs, const BigInteger& rhs) {
+    return lhs + -rhs;
+}
+
+BigInteger operator*(const BigInteger& lhs, const BigInteger& rhs) {
+    return BigInteger{lhs.negative_ != rhs.negative_,
+                      MultiplyMagnitudes(lhs.limbs_, rhs.limbs_)};
+}
+
+BigInteger operator/(const BigInteger& lhs, const BigInteger& rhs) {
+    return BigInteger{lhs.negative_ != rhs.negative_, DivideMagnitudes(lhs.limbs_, rhs.limbs_)};
+}
+
+std::strong_ordering operator<=>(const BigInteger& lhs, const BigInteger& rhs) {
+    if (lhs.negative_ != rhs.negative_) {
+        return lhs.negative_ ? std::strong_ordering::less : std::strong_ordering::greater;
+    }
+    int res = CompareMagnitudes(lhs.limbs_, rhs.limbs_);
+    if (lhs.negative_) {
+        res = -res;
+    }
+    return res <=> 0;
+}
+
+// End of BigInteger
+
+// Bignum
+
+Bignum::Bignum(BigInteger value) : Object(ObjectType::Bignum), value_(std::move(value)) {
+}
+
+// End of Bignum
+
+// Integers
+
+ObjectPtr MakeInteger(const BigInteger& value) {
+    int64_t small;
+    if (value.ToInt64(&small) && Number::Fits(small)) {
+        return Number::Make(small);
+    }
+    return runtime::New<Bignum>(value);
+}
+
+BigInteger ToBigInteger(ObjectPtr integer) {
+    if (IsFixnum(integer)) {
+        return BigInteger{Number::GetValue(integer)};
+    }
+    return As<Bignum>(integer)->GetValue();
+}
+
+// End of Integers
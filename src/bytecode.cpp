@@ -0,0 +1,42 @@
+#include "bytecode.h"
+#include "error.h"
+#include "runtime.h"
+
+[[noreturn]] void Raise(ErrorKind kind, const std::string& message) {
+    switch (kind) {
+        case ErrorKind::Syntax:
+            throw SyntaxError{message};
+        case ErrorKind::Name:
+            throw NameError{message};
+        default:
+            throw RuntimeError{message};
+    }
+}
+
+Prototype::Prototype(size_t params_count)
+    : Object(ObjectType::Prototype), params_count_(params_count), slots_count_(params_count) {
+}
+
+size_t Prototype::Emit(OpCode op, uint32_t arg, uint16_t depth) {
+    code_.push_back(Instruction{op, depth, arg});
+    return code_.size() - 1;
+}
+
+void Prototype::Patch(size_t index, uint32_t arg) {
+    code_[index].arg = arg;
+}
+
+void Prototype::Truncate(size_t size) {
+    code_.resize(size);
+}
+
+uint32_t Prototype::AddConstant(ObjectPtr obj) {
+    GC::GetCurrent().WriteBarrier(this, nullptr, obj);
+    constants_.push_back(obj);
+    return constants_.size() - 1;
+}
+
+uint32_t Prototype::AddError(const std::string& message) {
+    errors_.push_back(message);
+    return errors_.size() - 1;
+}
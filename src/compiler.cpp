@@ -0,0 +1,240 @@
+#include "compiler.h"
+#include <cstddef>
+#include <type_traits>
+#include "error.h"
+#include "lambda.h"
+#include "lib.h"
+#include "parallel.h"
+#include "runtime.h"
+
+Compiler::Compiler(GlobalScopePtr global_scope) : global_scope_(global_scope) {
+}
+
+PrototypePtr Compiler::Compile(ObjectPtr ast) {
+    Local<Prototype> proto{runtime::New<Prototype>(0)};
+    proto_ = proto;
+    layout_ = nullptr;
+    CompileExpr(ast, true);
+    proto_->Emit(OpCode::Return);
+    proto_ = nullptr;
+    return proto;
+}
+
+// Expressions
+
+void Compiler::CompileExpr(ObjectPtr expr, bool tail) {
+    if (expr == nullptr) {
+        proto_->Emit(OpCode::Nil);
+    } else if (Is<Symbol>(expr)) {
+        CompileSymbol(As<Symbol>(expr));
+    } else if (Is<Cell>(expr)) {
+        CompileCombination(As<Cell>(expr), tail);
+    } else {
+        proto_->Emit(OpCode::Const, proto_->AddConstant(expr));
+    }
+}
+
+void Compiler::CompileSymbol(SymbolPtr symbol) {
+    auto address = ResolveLocal(layout_, symbol);
+    if (!address) {
+        proto_->Emit(OpCode::Global, proto_->AddConstant(symbol));
+    } else if (address->is_param) {
+        proto_->Emit(OpCode::Local, address->slot, address->depth);
+    } else {
+        proto_->Emit(OpCode::CheckedLocal, address->slot, address->depth);
+        proto_->Emit(OpCode::Raise, proto_->AddError("Symbol " + symbol->GetName() + " not defined"),
+                     static_cast<uint16_t>(ErrorKind::Name));
+    }
+}
+
+// Errors of malformed forms are raised when the form is executed, as in the tree-walker.
+void Compiler::CompileCombination(CellPtr form, bool tail) {
+    size_t start = proto_->Size();
+    try {
+        SpecialForm* special = FindSpecialForm(form->GetFirst(), layout_, global_scope_);
+        ObjectPtr args = form->GetSecond();
+        if (special == nullptr) {
+            CompileCall(form, tail);
+        } else if (Is<Quote>(special)) {
+            CompileQuote(args);
+        } else if (Is<If>(special)) {
+            CompileIf(args, tail);
+        } else if (Is<Define>(special)) {
+            CompileDefine(args);
+        } else if (Is<Set>(special)) {
+            CompileSet(args);
+        } else if (Is<Lambda>(special)) {
+            CompileLambda(args);
+        } else if (Is<FutureForm>(special)) {
+            CompileFuture(args);
+        } else if (Is<LogicalAnd>(special)) {
+            CompileLogical(args, tail, true);
+        } else if (Is<LogicalOr>(special)) {
+            CompileLogical(args, tail, false);
+        } else {
+            throw SyntaxError{"Unsupported special form " + special->ToString()};
+        }
+    } catch (const SyntaxError& error) {
+        EmitRaise(start, ErrorKind::Syntax, error.what());
+    } catch (const NameError& error) {
+        EmitRaise(start, ErrorKind::Name, error.what());
+    } catch (const RuntimeError& error) {
+        EmitRaise(start, ErrorKind::Runtime, error.what());
+    }
+}
+
+void Compiler::CompileCall(CellPtr form, bool tail) {
+    if (form->GetFirst() == nullptr) {
+        throw RuntimeError{"Nothing to calculate"};
+    }
+    CompileExpr(form->GetFirst(), false);
+    Args args = GetArgsVector<false>(form->GetSecond());
+    for (ObjectPtr arg : args) {
+        CompileExpr(arg, false);
+    }
+    proto_->Emit(tail ? OpCode::TailCall : OpCode::Call, args.size());
+}
+
+// Special forms
+
+void Compiler::CompileQuote(ObjectPtr args) {
+    if (args == nullptr) {
+        throw RuntimeError{"Invalid args for quote"};
+    }
+    if (!Is<Cell>(args)) {
+        throw RuntimeError{"Invalid args type for quote"};
+    }
+    ObjectPtr value = As<Cell>(args)->GetFirst();
+    if (value == nullptr) {
+        proto_->Emit(OpCode::Nil);
+    } else {
+        proto_->Emit(OpCode::Const, proto_->AddConstant(value));
+    }
+}
+
+void Compiler::CompileIf(ObjectPtr args, bool tail) {
+    Args list = GetSafeArgs<false, std::false_type, false, SyntaxError>(args, 2, 3);
+    CompileExpr(list[0], false);
+    size_t to_else = proto_->Emit(OpCode::JumpIfFalse);
+    CompileExpr(list[1], tail);
+    size_t to_end = proto_->Emit(OpCode::Jump);
+    proto_->Patch(to_else, proto_->Size());
+    if (list.size() > 2) {
+        CompileExpr(list[2], tail);
+    } else {
+        proto_->Emit(OpCode::Nil);
+    }
+    proto_->Patch(to_end, proto_->Size());
+}
+
+void Compiler::CompileDefine(ObjectPtr args) {
+    Args list = GetSafeArgs<false, std::false_type, false, SyntaxError>(args, 2, kMaxArgs);
+    if (!Is<Symbol>(list[0])) {
+        auto [name, syntax] = ParseDefineLambda(args);
+        PrototypePtr proto = CompileProcedure(syntax.params, syntax.body);
+        proto_->Emit(OpCode::Closure, proto_->AddConstant(proto));
+        EmitDefine(name);
+        return;
+    }
+    if (list.size() > 2) {
+        throw SyntaxError{"Not correct args count define"};
+    }
+    CompileExpr(list[1], false);
+    proto_->Emit(OpCode::DeepCopy);
+    EmitDefine(As<Symbol>(list[0]));
+}
+
+void Compiler::CompileSet(ObjectPtr args) {
+    Args list = GetSafeArgs<false, std::false_type, false, SyntaxError>(args, 2, 2);
+    if (!Is<Symbol>(list[0])) {
+        throw SyntaxError{"You cannot set not Symbol"};
+    }
+    CompileExpr(list[1], false);
+    proto_->Emit(OpCode::DeepCopy);
+    auto address = ResolveLocal(layout_, As<Symbol>(list[0]));
+    if (address) {
+        proto_->Emit(OpCode::SetLocal, address->slot, address->depth);
+    } else {
+        proto_->Emit(OpCode::SetGlobal, proto_->AddConstant(list[0]));
+    }
+    proto_->Emit(OpCode::Nil);
+}
+
+void Compiler::CompileLambda(ObjectPtr args) {
+    auto [params, body] = ParseLambda(args);
+    PrototypePtr proto = CompileProcedure(params, body);
+    proto_->Emit(OpCode::Closure, proto_->AddConstant(proto));
+}
+
+void Compiler::CompileFuture(ObjectPtr args) {
+    if (!Is<Cell>(args)) {
+        throw SyntaxError{"Future wrong syntax"};
+    }
+    PrototypePtr proto = CompileProcedure({}, args);
+    proto_->Emit(OpCode::Closure, proto_->AddConstant(proto));
+    proto_->Emit(OpCode::Future);
+}
+
+void Compiler::CompileLogical(ObjectPtr args, bool tail, bool is_and) {
+    Args list = GetArgsVector<false>(args);
+    if (list.empty()) {
+        proto_->Emit(OpCode::Const, proto_->AddConstant(Symbol::Boolean(is_and)));
+        return;
+    }
+    std::vector<size_t> jumps;
+    for (size_t i = 0; i < list.size(); ++i) {
+        bool is_last = i + 1 == list.size();
+        CompileExpr(list[i], tail && is_last);
+        if (!is_last) {
+            jumps.push_back(proto_->Emit(is_and ? OpCode::JumpIfFalseKeep : OpCode::JumpIfTrueKeep));
+        }
+    }
+    for (size_t jump : jumps) {
+        proto_->Patch(jump, proto_->Size());
+    }
+}
+
+PrototypePtr Compiler::CompileProcedure(const std::vector<SymbolPtr>& params, ObjectPtr body) {
+    Local<Prototype> proto{runtime::New<Prototype>(params.size())};
+    FrameLayout layout{params, params.size(), layout_};
+    PrototypePtr outer_proto = proto_;
+    FrameLayout* outer_layout = layout_;
+    proto_ = proto;
+    layout_ = &layout;
+    try {
+        Args forms = GetArgsVector<false>(body);
+        for (ObjectPtr form : forms) {
+            CollectDefines(form, layout_, global_scope_);
+        }
+        for (size_t i = 0; i < forms.size(); ++i) {
+            bool is_last = i + 1 == forms.size();
+            CompileExpr(forms[i], is_last);
+            if (!is_last) {
+                proto_->Emit(OpCode::Pop);
+            }
+        }
+        proto_->Emit(OpCode::Return);
+    } catch (...) {
+        proto_ = outer_proto;
+        layout_ = outer_layout;
+        throw;
+    }
+    proto->SetSlotsCount(layout.names.size());
+    proto_ = outer_proto;
+    layout_ = outer_layout;
+    return proto;
+}
+
+void Compiler::EmitDefine(SymbolPtr name) {
+    if (layout_ == nullptr) {
+        proto_->Emit(OpCode::DefineGlobal, proto_->AddConstant(name));
+    } else {
+        proto_->Emit(OpCode::SetLocal, layout_->AddLocal(name));
+    }
+    proto_->Emit(OpCode::Nil);
+}
+
+void Compiler::EmitRaise(size_t start, ErrorKind kind, const std::string& message) {
+    proto_->Truncate(start);
+    proto_->Emit(OpCode::Raise, proto_->AddError(message), static_cast<uint16_t>(kind));
+}
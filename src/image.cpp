@@ -0,0 +1,1318 @@
+#include "image.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <typeinfo>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "bignum.h"
+#include "bytecode.h"
+#include "error.h"
+#include "lambda.h"
+#include "number.h"
+#include "parallel.h"
+#include "resolver.h"
+#include "runtime.h"
+#include "vm.h"
+
+// Layout of an image, all integers in native byte order:
+//   magic, version, build, see GetBuildId
+//   symbols: count, then names
+//   segments: count, then each segment: reference to its root, count of objects, then
+//   a record per object
+// A record is the type, the data of the object which are not references, then its
+// references in the order Trace visits them. Global scopes also have their bindings at the
+// end.
+// The global scope of the writer is written as a bare kGlobalScopeRecord, unless it is
+// the root of the segment, and loaded as the global scope of the reader. Frozen global
+// scopes are written as the global scope of the writer, which includes their bindings.
+// Images read in the same process write frozen objects as kFrozenRecord and the address.
+// A future is written with its value or its error. Images read in the same process write
+// futures which have a task as the index of the task, see ObjectsImage.
+// A reference is a word: 0 for the empty list, a fixnum as it is, (index << 2) | 2 for
+// the symbol at index and (index + 1) << 2 for the object at index in its segment.
+// Segments are loaded one at a time, objects are shared only within a segment.
+
+namespace {
+
+constexpr char kImageMagic[8] = {'S', 'C', 'M', 'I', 'M', 'A', 'G', 'E'};
+constexpr uint32_t kImageVersion = 6;
+constexpr uint64_t kSymbolRefTag = 2;
+constexpr auto kGlobalScopeRecord = static_cast<ObjectType>(0xff);
+constexpr auto kFrozenRecord = static_cast<ObjectType>(0xfe);
+
+enum class FutureRecord : uint8_t { Value, Error, Task };
+
+// Builtins and special forms have no state, so images refer to them by type.
+bool IsStateless(ObjectPtr obj) {
+    ObjectType type = obj->GetType();
+    return type == ObjectType::Builtin ||
+           TypeRange{ObjectType::Quote, ObjectType::FutureForm}.Contains(type);
+}
+
+const char* GetTypeName(ObjectPtr obj) {
+    return typeid(*obj).name();
+}
+
+[[noreturn]] void ThrowCorrupted() {
+    throw RuntimeError{"Corrupted image"};
+}
+
+// Images are read only by the build which wrote them: builtins are written by the type
+// names of their compiler and code by the layout of its instructions, and this file is
+// rebuilt whenever the headers describing them change.
+uint64_t GetBuildId() {
+    static const uint64_t kBuildId =
+        HashSource(__VERSION__ " " __DATE__ " " __TIME__) ^ kImageVersion;
+    return kBuildId;
+}
+
+// Magic, version and build.
+constexpr size_t kImageHeaderSize =
+    sizeof(kImageMagic) + sizeof(kImageVersion) + sizeof(uint64_t);
+
+bool HasImageHeader(const std::byte* data, size_t size) {
+    if (size < kImageHeaderSize) {
+        return false;
+    }
+    uint32_t version;
+    std::memcpy(&version, data + sizeof(kImageMagic), sizeof(version));
+    uint64_t build_id;
+    std::memcpy(&build_id, data + sizeof(kImageMagic) + sizeof(version), sizeof(build_id));
+    return std::memcmp(data, kImageMagic, sizeof(kImageMagic)) == 0 &&
+           version == kImageVersion && build_id == GetBuildId();
+}
+
+// A code cache is the build which wrote it, the size and the hash of its source and the
+// hash of the image which follows, with a segment per form.
+struct CodeCacheHeader {
+    uint64_t build_id;
+    uint64_t source_size;
+    uint64_t source_hash;
+    uint64_t image_hash;
+};
+
+void WriteFile(const std::string& path, std::string_view data) {
+    std::ofstream out{path, std::ios::binary};
+    if (!out.is_open()) {
+        throw RuntimeError{"Can't open " + path};
+    }
+    out.write(data.data(), data.size());
+    if (!out) {
+        throw RuntimeError{"Can't write " + path};
+    }
+}
+
+}  // namespace
+
+// Saving
+
+class ImageWriter {
+public:
+    // An image read in_process refers to frozen objects and to the tasks of futures instead
+    // of copying them. Otherwise futures are waited for.
+    explicit ImageWriter(GlobalScopePtr global_scope = nullptr, bool in_process = false)
+        : global_scope_(global_scope), in_process_(in_process) {
+    }
+
+    // Writes root and everything reachable from it. Objects are written before anything
+    // may move them.
+    void AddSegment(ObjectPtr root) {
+        root_ = root;
+        objects_index_.clear();
+        objects_.clear();
+        std::string records;
+        out_ = &records;
+        uint64_t root_ref = EncodeRef(root);
+        for (size_t i = 0; i < objects_.size(); ++i) {
+            WriteObject(objects_[i]);
+        }
+        out_ = &segments_;
+        Put(root_ref);
+        Put<uint64_t>(objects_.size());
+        segments_ += records;
+        ++segments_count_;
+    }
+
+    // Symbols are collected while writing segments, so the header comes last.
+    std::string Finish() {
+        std::string image{kImageMagic, sizeof(kImageMagic)};
+        out_ = &image;
+        Put(kImageVersion);
+        Put(GetBuildId());
+        Put<uint64_t>(symbols_.size());
+        for (SymbolPtr symbol : symbols_) {
+            PutString(symbol->GetName());
+        }
+        Put(segments_count_);
+        return image + segments_;
+    }
+
+    // Only the own bindings of the global scope with these names are written.
+    void SetBindingsFilter(std::unordered_set<SymbolPtr> names) {
+        bindings_filter_ = std::move(names);
+    }
+
+    // Tasks of the futures written in process.
+    std::vector<std::shared_ptr<Task>> TakeTasks() {
+        return std::move(tasks_);
+    }
+
+private:
+    template <class T>
+    void Put(T value) {
+        out_->append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void PutString(std::string_view str) {
+        Put<uint64_t>(str.size());
+        out_->append(str);
+    }
+
+    uint64_t GetSymbolIndex(SymbolPtr symbol) {
+        auto [it, inserted] = symbols_index_.emplace(symbol, symbols_.size());
+        if (inserted) {
+            symbols_.push_back(symbol);
+        }
+        return it->second;
+    }
+
+    void PutSymbol(SymbolPtr symbol) {
+        Put(GetSymbolIndex(symbol));
+    }
+
+    // Objects get their index on the first reference and are written after the ones
+    // before them.
+    uint64_t EncodeRef(ObjectPtr obj) {
+        if (!IsHeapObject(obj)) {
+            return reinterpret_cast<uint64_t>(obj);
+        }
+        if (obj->IsFrozen() && !in_process_ && global_scope_ != nullptr &&
+            Is<GlobalScope>(obj)) {
+            obj = global_scope_;
+        }
+        if (Is<Symbol>(obj)) {
+            return GetSymbolIndex(As<Symbol>(obj)) << 2 | kSymbolRefTag;
+        }
+        auto [it, inserted] = objects_index_.emplace(obj, objects_.size());
+        if (inserted) {
+            objects_.push_back(obj);
+        }
+        return (it->second + 1) << 2;
+    }
+
+    void PutRef(ObjectPtr obj) {
+        Put(EncodeRef(obj));
+    }
+
+    class RefCollector final : public Tracer {
+    public:
+        void Visit(ObjectPtr& slot) override {
+            refs.push_back(slot);
+        }
+
+        Args refs;
+    };
+
+    void WriteObject(ObjectPtr obj) {
+        if (obj == global_scope_ && obj != root_) {
+            Put(kGlobalScopeRecord);
+            return;
+        }
+        if (obj->IsFrozen() && in_process_) {
+            Put(kFrozenRecord);
+            Put(reinterpret_cast<uint64_t>(obj));
+            return;
+        }
+        Put(obj->GetType());
+        switch (obj->GetType()) {
+            case ObjectType::Vector:
+                Put<uint64_t>(As<Vector>(obj)->GetSize());
+                break;
+            case ObjectType::Frame:
+                Put<uint64_t>(As<Frame>(obj)->GetSlotsCount());
+                break;
+            case ObjectType::Prototype:
+                WritePrototype(As<Prototype>(obj));
+                break;
+            case ObjectType::LocalRef: {
+                auto* ref = As<LocalRef>(obj);
+                PutSymbol(ref->GetName());
+                Put(ref->GetAddress().depth);
+                Put(ref->GetAddress().slot);
+                Put(ref->GetAddress().is_param);
+                break;
+            }
+            case ObjectType::Bignum:
+                PutString(As<Bignum>(obj)->GetValue().ToString());
+                break;
+            case ObjectType::Flonum:
+                Put(As<Flonum>(obj)->GetValue());
+                break;
+            case ObjectType::Future:
+                WriteFuture(As<Future>(obj));
+                return;
+            case ObjectType::LambdaTemplate: {
+                const FrameLayout& layout = As<LambdaTemplate>(obj)->GetLayout();
+                Put<uint64_t>(layout.params_count);
+                Put<uint64_t>(layout.names.size());
+                for (SymbolPtr name : layout.names) {
+                    PutSymbol(name);
+                }
+                break;
+            }
+            default:
+                if (IsStateless(obj)) {
+                    PutString(GetTypeName(obj));
+                }
+                break;
+        }
+        WriteRefs(obj);
+    }
+
+    void WritePrototype(PrototypePtr proto) {
+        Put<uint64_t>(proto->GetParamsCount());
+        Put<uint64_t>(proto->GetSlotsCount());
+        Put<uint64_t>(proto->Size());
+        for (size_t i = 0; i < proto->Size(); ++i) {
+            const Instruction& instruction = proto->GetCode()[i];
+            Put(instruction.op);
+            Put(instruction.depth);
+            Put(instruction.arg);
+        }
+        Put<uint64_t>(proto->GetConstantsCount());
+        Put<uint64_t>(proto->GetErrorsCount());
+        for (size_t i = 0; i < proto->GetErrorsCount(); ++i) {
+            PutString(proto->GetError(i));
+        }
+    }
+
+    // Touching a future could block or raise: in process its task is shared, otherwise it
+    // is waited for and written with its value or its error. The value is its only reference.
+    void WriteFuture(Future* future) {
+        ObjectPtr value = nullptr;
+        if (future->GetTask() != nullptr && in_process_) {
+            Put(FutureRecord::Task);
+            Put<uint64_t>(tasks_.size());
+            tasks_.push_back(future->GetTask());
+        } else {
+            future->Wait();
+            if (future->HasValue()) {
+                Put(FutureRecord::Value);
+                value = future->GetValue();
+            } else {
+                Put(FutureRecord::Error);
+                Put(future->GetErrorKind());
+                PutString(future->GetError());
+            }
+        }
+        Put<uint64_t>(1);
+        PutRef(value);
+    }
+
+    void WriteRefs(ObjectPtr obj) {
+        if (IsStateless(obj)) {
+            Put<uint64_t>(0);
+            return;
+        }
+        if (auto* frame = As<Frame>(obj)) {
+            // Frozen frames which the interpreter has changed are written as it sees them.
+            obj = frame->ForReading();
+        }
+        if (auto* scope = As<GlobalScope>(obj)) {
+            // Bindings are restored by name: the order of a hash map isn't.
+            Put<uint64_t>(0);
+            std::vector<std::pair<SymbolPtr, ObjectPtr>> bindings;
+            for (const auto& [name, value] : scope->GetBindings()) {
+                if (scope != global_scope_ || !bindings_filter_ ||
+                    bindings_filter_->contains(name)) {
+                    bindings.emplace_back(name, value);
+                }
+            }
+            if (!in_process_ && scope == global_scope_) {
+                // Frozen bindings the scope doesn't shadow.
+                for (GlobalScopePtr base = scope->GetBase(); base != nullptr;
+                     base = base->GetBase()) {
+                    for (const auto& [name, value] : base->GetBindings()) {
+                        if (scope->Find(name) == &value) {
+                            bindings.emplace_back(name, value);
+                        }
+                    }
+                }
+            }
+            Put<uint64_t>(bindings.size());
+            for (const auto& [name, value] : bindings) {
+                PutSymbol(name);
+                PutRef(value);
+            }
+            return;
+        }
+        RefCollector collector;
+        obj->Trace(collector);
+        Put<uint64_t>(collector.refs.size());
+        for (ObjectPtr ref : collector.refs) {
+            PutRef(ref);
+        }
+    }
+
+    GlobalScopePtr global_scope_;
+    bool in_process_;
+    ObjectPtr root_ = nullptr;
+    std::string* out_ = nullptr;
+    std::string segments_;
+    uint64_t segments_count_ = 0;
+    // Objects of the current segment.
+    std::unordered_map<ObjectPtr, uint64_t> objects_index_;
+    std::vector<ObjectPtr> objects_;
+    std::unordered_map<SymbolPtr, uint64_t> symbols_index_;
+    std::vector<SymbolPtr> symbols_;
+    std::vector<std::shared_ptr<Task>> tasks_;
+    std::optional<std::unordered_set<SymbolPtr>> bindings_filter_;
+};
+
+// End of Saving
+
+namespace {
+
+// Loading
+
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw RuntimeError{"Can't open " + path};
+        }
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            size_ = info.st_size;
+            void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            data_ = data == MAP_FAILED ? nullptr : static_cast<const std::byte*>(data);
+        }
+        close(fd);
+        if (data_ == nullptr) {
+            throw RuntimeError{"Can't map " + path};
+        }
+    }
+    ~MappedFile() {
+        munmap(const_cast<std::byte*>(data_), size_);
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const std::byte* GetData() const {
+        return data_;
+    }
+    size_t GetSize() const {
+        return size_;
+    }
+
+private:
+    const std::byte* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Bounds-checked cursor over the image.
+class ImageReader {
+public:
+    ImageReader(const std::byte* data, size_t size) : data_(data), size_(size) {
+    }
+
+    template <class T>
+    T Get() {
+        Need(sizeof(T));
+        T value;
+        std::memcpy(&value, data_ + pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return value;
+    }
+
+    std::string_view GetString() {
+        auto size = Get<uint64_t>();
+        Need(size);
+        std::string_view str{reinterpret_cast<const char*>(data_ + pos_), size};
+        pos_ += size;
+        return str;
+    }
+
+    // Reads the count of items which take at least item_size bytes each further on, so a
+    // damaged count can't make the loader allocate far more than the image holds.
+    uint64_t GetCount(size_t item_size) {
+        auto count = Get<uint64_t>();
+        if (count > (size_ - pos_) / item_size) {
+            ThrowCorrupted();
+        }
+        return count;
+    }
+
+    void Skip(uint64_t size) {
+        Need(size);
+        pos_ += size;
+    }
+
+    size_t GetPosition() const {
+        return pos_;
+    }
+    void SetPosition(size_t pos) {
+        pos_ = pos;
+    }
+
+private:
+    void Need(uint64_t size) const {
+        if (size > size_ - pos_) {
+            ThrowCorrupted();
+        }
+    }
+
+    const std::byte* data_;
+    size_t size_;
+    size_t pos_ = 0;
+};
+
+}  // namespace
+
+class ImageLoader {
+public:
+    // Builtins are taken from global_scope.
+    // Only images written in process come with tasks, and may refer to frozen objects.
+    ImageLoader(GlobalScopePtr global_scope, const std::byte* data, size_t size,
+                const std::vector<std::shared_ptr<Task>>* tasks = nullptr)
+        : global_scope_(global_scope), reader_(data, size), tasks_(tasks) {
+        for (const auto& [name, value] : global_scope->GetBindings()) {
+            if (IsHeapObject(value) && !Is<Symbol>(value) && IsStateless(value)) {
+                builtins_.emplace(GetTypeName(value), value);
+            }
+        }
+        if (!HasImageHeader(data, size)) {
+            throw RuntimeError{"Not a heap image of this build"};
+        }
+        reader_.Skip(kImageHeaderSize);
+        auto symbols_count = reader_.Get<uint64_t>();
+        for (uint64_t i = 0; i < symbols_count; ++i) {
+            symbols_.push_back(Symbol::Intern(reader_.GetString()));
+        }
+        segments_left_ = reader_.Get<uint64_t>();
+    }
+
+    bool IsEnd() const {
+        return segments_left_ == 0;
+    }
+
+    // Allocates the objects of the next segment, in the old generation if tenured, and
+    // returns its root. The root stays rooted until the next segment is loaded.
+    // With into_global_scope the root must be a scope, its bindings are defined in the
+    // global scope instead.
+    ObjectPtr LoadSegment(bool tenured, bool into_global_scope) {
+        if (IsEnd()) {
+            ThrowCorrupted();
+        }
+        --segments_left_;
+        tenured_ = tenured;
+        objects_.clear();
+        uint64_t root_ref = reader_.Get<uint64_t>();
+        auto objects_count = reader_.Get<uint64_t>();
+        uint64_t global_scope_ref = into_global_scope ? root_ref : 0;
+        std::vector<std::pair<ObjectType, size_t>> records;
+        for (uint64_t i = 0; i < objects_count; ++i) {
+            auto type = reader_.Get<ObjectType>();
+            if (type == kGlobalScopeRecord) {
+                objects_.push_back(global_scope_);
+                records.emplace_back(type, reader_.GetPosition());
+                continue;
+            }
+            if (type == kFrozenRecord) {
+                if (tasks_ == nullptr) {
+                    ThrowCorrupted();
+                }
+                objects_.push_back(reinterpret_cast<ObjectPtr>(reader_.Get<uint64_t>()));
+                records.emplace_back(type, reader_.GetPosition());
+                continue;
+            }
+            if (type > ObjectType::LambdaTemplate || type == ObjectType::Symbol) {
+                ThrowCorrupted();
+            }
+            bool is_global_scope = (i + 1) << 2 == global_scope_ref;
+            objects_.push_back(Allocate(type, is_global_scope));
+            records.emplace_back(type, reader_.GetPosition());
+            SkipRefs(type);
+        }
+        size_t end = reader_.GetPosition();
+        for (size_t i = 0; i < records.size(); ++i) {
+            reader_.SetPosition(records[i].second);
+            FixUp(objects_[i], records[i].first, objects_[i] == global_scope_);
+        }
+        outer_slots_.clear();
+        for (size_t i = 0; i < records.size(); ++i) {
+            if (records[i].first == ObjectType::Closure) {
+                auto* closure = As<Closure>(objects_[i]);
+                CheckCapturedScope(closure->GetPrototype(), closure->GetScope());
+            } else if (records[i].first == ObjectType::LambdaFunction) {
+                auto* function = As<LambdaFunction>(objects_[i]);
+                CheckCapturedScope(function->GetTemplate(), function->GetScope());
+            }
+        }
+        reader_.SetPosition(end);
+        ObjectPtr root = DecodeRef(root_ref);
+        if (into_global_scope && root != global_scope_) {
+            ThrowCorrupted();
+        }
+        return root;
+    }
+
+private:
+    // Fills the references of an allocated object, in the order of its Trace.
+    class FixUpTracer final : public Tracer {
+    public:
+        FixUpTracer(ImageLoader* loader, ObjectPtr holder, ObjectType type)
+            : loader_(loader), holder_(holder), type_(type) {
+        }
+        void Visit(ObjectPtr& slot) override {
+            ObjectPtr value = loader_->GetRef();
+            // Typed slots are checked before they are written, the object is used as their
+            // type right away.
+            if (!FitsSlot(type_, count, value)) {
+                ThrowCorrupted();
+            }
+            GC::GetCurrent().WriteBarrier(holder_, slot, value);
+            slot = value;
+            ++count;
+        }
+
+        uint64_t count = 0;
+
+    private:
+        ImageLoader* loader_;
+        ObjectPtr holder_;
+        ObjectType type_;
+    };
+
+    // Whether value may be in the index-th traced slot of an object of type holder.
+    static bool FitsSlot(ObjectType holder, uint64_t index, ObjectPtr value) {
+        switch (holder) {
+            case ObjectType::Frame:
+                // Chains of scopes end with a global scope.
+                return index != 0 || Is<Scope>(value);
+            case ObjectType::Closure:
+                return index == 0 ? Is<Prototype>(value) : Is<Scope>(value);
+            case ObjectType::LambdaFunction:
+                return index == 0 ? Is<LambdaTemplate>(value) : Is<Scope>(value);
+            default:
+                return true;
+        }
+    }
+
+    SymbolPtr GetSymbol() {
+        auto index = reader_.Get<uint64_t>();
+        if (index >= symbols_.size()) {
+            ThrowCorrupted();
+        }
+        return symbols_[index];
+    }
+
+    ObjectPtr GetRef() {
+        return DecodeRef(reader_.Get<uint64_t>());
+    }
+
+    ObjectPtr DecodeRef(uint64_t ref) {
+        if ((ref & kFixnumTag) != 0 || ref == 0) {
+            return reinterpret_cast<ObjectPtr>(ref);
+        }
+        uint64_t index = ref >> 2;
+        if ((ref & kSymbolRefTag) != 0) {
+            if (index >= symbols_.size()) {
+                ThrowCorrupted();
+            }
+            return symbols_[index];
+        }
+        if (index > objects_.size()) {
+            ThrowCorrupted();
+        }
+        return objects_[index - 1];
+    }
+
+    template <DerivedFrom T, typename... Args>
+    T* New(Args&&... args) {
+        if (tenured_) {
+            return runtime::NewTenured<T>(std::forward<Args>(args)...);
+        }
+        return runtime::New<T>(std::forward<Args>(args)...);
+    }
+
+    // Reads the data of the record and allocates the object with empty references.
+    ObjectPtr Allocate(ObjectType type, bool is_global_scope) {
+        if (is_global_scope) {
+            if (type != ObjectType::GlobalScope) {
+                ThrowCorrupted();
+            }
+            return global_scope_;
+        }
+        switch (type) {
+            case ObjectType::Cell:
+                return New<Cell>();
+            case ObjectType::Vector:
+                return Vector::Make(reader_.GetCount(sizeof(uint64_t)), nullptr, tenured_);
+            case ObjectType::GlobalScope:
+                return New<GlobalScope>();
+            case ObjectType::Frame:
+                return Frame::Make(nullptr, reader_.GetCount(sizeof(uint64_t)), nullptr,
+                                   tenured_);
+            case ObjectType::Prototype:
+                return AllocatePrototype();
+            case ObjectType::LocalRef: {
+                SymbolPtr name = GetSymbol();
+                LocalAddress address;
+                address.depth = reader_.Get<uint16_t>();
+                address.slot = reader_.Get<uint32_t>();
+                auto is_param = reader_.Get<uint8_t>();
+                if (is_param > 1) {
+                    ThrowCorrupted();
+                }
+                address.is_param = is_param != 0;
+                return New<LocalRef>(name, address);
+            }
+            case ObjectType::Bignum:
+                return New<Bignum>(BigInteger::Parse(reader_.GetString()));
+            case ObjectType::Flonum:
+                return New<Flonum>(reader_.Get<double>());
+            case ObjectType::Future:
+                return AllocateFuture();
+            case ObjectType::LambdaFunction:
+                return New<LambdaFunction>(nullptr, nullptr);
+            case ObjectType::Closure:
+                return New<Closure>(nullptr, nullptr);
+            case ObjectType::LambdaTemplate: {
+                FrameLayout layout;
+                layout.params_count = reader_.Get<uint64_t>();
+                auto names_count = reader_.GetCount(sizeof(uint64_t));
+                // Parameters take the first slots of the frame.
+                if (layout.params_count > names_count) {
+                    ThrowCorrupted();
+                }
+                for (uint64_t i = 0; i < names_count; ++i) {
+                    layout.names.push_back(GetSymbol());
+                }
+                return New<LambdaTemplate>(std::move(layout), nullptr);
+            }
+            default: {
+                auto it = builtins_.find(reader_.GetString());
+                if (it == builtins_.end()) {
+                    throw RuntimeError{"Image refers to an unknown builtin"};
+                }
+                return it->second;
+            }
+        }
+    }
+
+    // The VM trusts code, so the arguments of every instruction are checked here, and the
+    // types of the constants they use once they are fixed up, see CheckConstants.
+    ObjectPtr AllocatePrototype() {
+        auto params_count = reader_.Get<uint64_t>();
+        auto slots_count = reader_.Get<uint64_t>();
+        if (slots_count < params_count || slots_count > UINT32_MAX) {
+            ThrowCorrupted();
+        }
+        PrototypePtr proto = New<Prototype>(params_count);
+        proto->SetSlotsCount(slots_count);
+        constexpr size_t kInstructionSize =
+            sizeof(OpCode) + sizeof(Instruction::depth) + sizeof(Instruction::arg);
+        auto code_size = reader_.GetCount(kInstructionSize);
+        for (uint64_t i = 0; i < code_size; ++i) {
+            auto op = reader_.Get<OpCode>();
+            auto depth = reader_.Get<uint16_t>();
+            proto->Emit(op, reader_.Get<uint32_t>(), depth);
+        }
+        // Each constant is a reference of the record.
+        auto constants_count = reader_.GetCount(sizeof(uint64_t));
+        for (uint64_t i = 0; i < constants_count; ++i) {
+            proto->AddConstant(nullptr);
+        }
+        auto errors_count = reader_.GetCount(sizeof(uint64_t));
+        for (uint64_t i = 0; i < errors_count; ++i) {
+            proto->AddError(std::string{reader_.GetString()});
+        }
+        CheckCode(proto);
+        return proto;
+    }
+
+    static void CheckCode(PrototypePtr proto) {
+        const Instruction* code = proto->GetCode();
+        size_t size = proto->Size();
+        for (size_t i = 0; i < size; ++i) {
+            const Instruction& ins = code[i];
+            bool valid = true;
+            switch (ins.op) {
+                case OpCode::Const:
+                case OpCode::Global:
+                case OpCode::SetGlobal:
+                case OpCode::DefineGlobal:
+                case OpCode::Closure:
+                    valid = ins.arg < proto->GetConstantsCount();
+                    break;
+                case OpCode::Local:
+                case OpCode::CheckedLocal:
+                case OpCode::SetLocal:
+                    // Frames further up are checked with the closures, see CheckCapturedScope.
+                    valid = ins.depth != 0 || ins.arg < proto->GetSlotsCount();
+                    break;
+                case OpCode::Jump:
+                case OpCode::JumpIfFalse:
+                case OpCode::JumpIfFalseKeep:
+                case OpCode::JumpIfTrueKeep:
+                    valid = ins.arg < size;
+                    break;
+                case OpCode::Raise:
+                    valid = ins.arg < proto->GetErrorsCount() &&
+                            ins.depth <= static_cast<uint16_t>(ErrorKind::Name);
+                    break;
+                case OpCode::Nil:
+                case OpCode::DeepCopy:
+                case OpCode::Future:
+                case OpCode::Pop:
+                case OpCode::Call:
+                case OpCode::TailCall:
+                case OpCode::Return:
+                    break;
+                default:
+                    valid = false;
+                    break;
+            }
+            if (!valid) {
+                ThrowCorrupted();
+            }
+        }
+        CheckStack(proto);
+    }
+
+    // Control never runs past the end of the code, the stack has the same depth on every
+    // path to an instruction, and no instruction pops more than the call pushed.
+    static void CheckStack(PrototypePtr proto) {
+        const Instruction* code = proto->GetCode();
+        size_t size = proto->Size();
+        std::vector<int64_t> depths(size, -1);
+        std::vector<size_t> pending;
+        auto reach = [&](size_t target, int64_t depth) {
+            if (target >= size) {
+                ThrowCorrupted();
+            }
+            if (depths[target] < 0) {
+                depths[target] = depth;
+                pending.push_back(target);
+            } else if (depths[target] != depth) {
+                ThrowCorrupted();
+            }
+        };
+        reach(0, 0);
+        while (!pending.empty()) {
+            size_t i = pending.back();
+            pending.pop_back();
+            const Instruction& ins = code[i];
+            int64_t depth = depths[i];
+            auto pop = [depth](int64_t count) {
+                if (depth < count) {
+                    ThrowCorrupted();
+                }
+                return depth - count;
+            };
+            switch (ins.op) {
+                case OpCode::Const:
+                case OpCode::Nil:
+                case OpCode::Local:
+                case OpCode::Global:
+                case OpCode::Closure:
+                    reach(i + 1, depth + 1);
+                    break;
+                case OpCode::CheckedLocal:
+                    // The next instruction raises, a bound slot skips it.
+                    reach(i + 1, depth);
+                    reach(i + 2, depth + 1);
+                    break;
+                case OpCode::SetLocal:
+                case OpCode::SetGlobal:
+                case OpCode::DefineGlobal:
+                case OpCode::Pop:
+                    reach(i + 1, pop(1));
+                    break;
+                case OpCode::DeepCopy:
+                case OpCode::Future:
+                    reach(i + 1, pop(1) + 1);
+                    break;
+                case OpCode::Jump:
+                    reach(ins.arg, depth);
+                    break;
+                case OpCode::JumpIfFalse:
+                    reach(ins.arg, pop(1));
+                    reach(i + 1, pop(1));
+                    break;
+                case OpCode::JumpIfFalseKeep:
+                case OpCode::JumpIfTrueKeep:
+                    reach(ins.arg, pop(1) + 1);
+                    reach(i + 1, pop(1));
+                    break;
+                case OpCode::Call:
+                    reach(i + 1, pop(ins.arg + int64_t{1}) + 1);
+                    break;
+                case OpCode::TailCall:
+                    pop(ins.arg + int64_t{1});
+                    break;
+                case OpCode::Return:
+                    pop(1);
+                    break;
+                case OpCode::Raise:
+                    break;
+            }
+        }
+    }
+
+    // Global variables are named by symbol constants and closures made of prototype ones.
+    static void CheckConstants(PrototypePtr proto) {
+        for (size_t i = 0; i < proto->Size(); ++i) {
+            const Instruction& ins = proto->GetCode()[i];
+            switch (ins.op) {
+                case OpCode::Global:
+                case OpCode::SetGlobal:
+                case OpCode::DefineGlobal:
+                    if (!Is<Symbol>(proto->GetConstants()[ins.arg])) {
+                        ThrowCorrupted();
+                    }
+                    break;
+                case OpCode::Closure:
+                    if (!Is<Prototype>(proto->GetConstants()[ins.arg])) {
+                        ThrowCorrupted();
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    // The frames a closure or a lambda function captured have the slots its code reads.
+    void CheckCapturedScope(ObjectPtr code, ObjectPtr scope) {
+        if (!Is<Scope>(scope)) {
+            ThrowCorrupted();
+        }
+        for (size_t slots_count : GetOuterSlots(code)) {
+            auto* frame = As<Frame>(scope);
+            if (frame == nullptr || frame->GetSlotsCount() < slots_count) {
+                ThrowCorrupted();
+            }
+            scope = frame->GetParent();
+        }
+    }
+
+    // Local variables of code, a prototype or a lambda template, as their depth and the
+    // count of slots the frame there must have, and the code of the lambdas it makes.
+    struct CodeFrames {
+        size_t slots_count = 0;
+        std::vector<std::pair<size_t, size_t>> locals;
+        Args inner;
+    };
+
+    static CodeFrames GetCodeFrames(ObjectPtr code) {
+        CodeFrames frames;
+        if (auto* proto = As<Prototype>(code)) {
+            frames.slots_count = proto->GetSlotsCount();
+            for (size_t i = 0; i < proto->Size(); ++i) {
+                const Instruction& ins = proto->GetCode()[i];
+                switch (ins.op) {
+                    case OpCode::Local:
+                    case OpCode::CheckedLocal:
+                    case OpCode::SetLocal:
+                        frames.locals.emplace_back(ins.depth, ins.arg + size_t{1});
+                        break;
+                    case OpCode::Closure:
+                        frames.inner.push_back(proto->GetConstants()[ins.arg]);
+                        break;
+                    default:
+                        break;
+                }
+            }
+            return frames;
+        }
+        auto* lambda = As<LambdaTemplate>(code);
+        if (lambda == nullptr) {
+            ThrowCorrupted();
+        }
+        frames.slots_count = lambda->GetLayout().names.size();
+        // The body is a tree of cells with LocalRefs in it, and lambdas as their templates.
+        std::unordered_set<ObjectPtr> visited;
+        Args pending{lambda->GetBody()};
+        while (!pending.empty()) {
+            ObjectPtr obj = pending.back();
+            pending.pop_back();
+            if (!IsHeapObject(obj) || !visited.insert(obj).second) {
+                continue;
+            }
+            if (auto* cell = As<Cell>(obj)) {
+                pending.push_back(cell->GetFirst());
+                pending.push_back(cell->GetSecond());
+            } else if (auto* ref = As<LocalRef>(obj)) {
+                frames.locals.emplace_back(ref->GetAddress().depth,
+                                           ref->GetAddress().slot + size_t{1});
+            } else if (Is<LambdaTemplate>(obj)) {
+                frames.inner.push_back(obj);
+            }
+        }
+        return frames;
+    }
+
+    // Counts of slots which code and the lambdas it makes read from the frames around its
+    // own, 1, 2, ... levels up. Code nests without cycles.
+    const std::vector<size_t>& GetOuterSlots(ObjectPtr root) {
+        struct Pending {
+            ObjectPtr code;
+            std::optional<CodeFrames> frames;
+        };
+        std::vector<Pending> pending{{root, std::nullopt}};
+        while (!pending.empty()) {
+            if (!pending.back().frames) {
+                auto [it, inserted] = outer_slots_.try_emplace(pending.back().code);
+                if (!inserted) {
+                    // Code expanded but not done yet encloses this one.
+                    if (!it->second) {
+                        ThrowCorrupted();
+                    }
+                    pending.pop_back();
+                    continue;
+                }
+                pending.back().frames = GetCodeFrames(pending.back().code);
+                Args inner = pending.back().frames->inner;
+                for (ObjectPtr code : inner) {
+                    pending.push_back({code, std::nullopt});
+                }
+                continue;
+            }
+            Pending done = std::move(pending.back());
+            pending.pop_back();
+            std::vector<size_t> slots;
+            auto need = [&slots](size_t level, size_t count) {
+                if (slots.size() < level) {
+                    slots.resize(level);
+                }
+                slots[level - 1] = std::max(slots[level - 1], count);
+            };
+            for (auto [depth, count] : done.frames->locals) {
+                if (depth == 0) {
+                    if (count > done.frames->slots_count) {
+                        ThrowCorrupted();
+                    }
+                } else {
+                    need(depth, count);
+                }
+            }
+            // The frames of inner lambdas are one level down.
+            for (ObjectPtr code : done.frames->inner) {
+                const auto& inner = *outer_slots_[code];
+                if (!inner.empty() && inner[0] > done.frames->slots_count) {
+                    ThrowCorrupted();
+                }
+                for (size_t level = 1; level < inner.size(); ++level) {
+                    need(level, inner[level]);
+                }
+            }
+            outer_slots_[done.code] = std::move(slots);
+        }
+        return *outer_slots_[root];
+    }
+
+    ObjectPtr AllocateFuture() {
+        switch (reader_.Get<FutureRecord>()) {
+            case FutureRecord::Value:
+                return New<Future>(ObjectPtr{nullptr});
+            case FutureRecord::Error: {
+                auto kind = reader_.Get<ErrorKind>();
+                if (kind > ErrorKind::Name) {
+                    ThrowCorrupted();
+                }
+                return New<Future>(kind, std::string{reader_.GetString()});
+            }
+            case FutureRecord::Task: {
+                auto index = reader_.Get<uint64_t>();
+                if (tasks_ == nullptr || index >= tasks_->size()) {
+                    ThrowCorrupted();
+                }
+                return New<Future>((*tasks_)[index]);
+            }
+        }
+        ThrowCorrupted();
+    }
+
+    void SkipRefs(ObjectType type) {
+        reader_.Skip(reader_.Get<uint64_t>() * sizeof(uint64_t));
+        if (type == ObjectType::GlobalScope) {
+            reader_.Skip(reader_.Get<uint64_t>() * 2 * sizeof(uint64_t));
+        }
+    }
+
+    void FixUp(ObjectPtr obj, ObjectType type, bool is_global_scope) {
+        if (type == kGlobalScopeRecord || type == kFrozenRecord) {
+            return;
+        }
+        auto count = reader_.Get<uint64_t>();
+        if (is_global_scope || IsStateless(obj)) {
+            reader_.Skip(count * sizeof(uint64_t));
+        } else {
+            FixUpTracer tracer{this, obj, type};
+            obj->Trace(tracer);
+            if (tracer.count != count) {
+                ThrowCorrupted();
+            }
+        }
+        if (type == ObjectType::Prototype) {
+            CheckConstants(As<Prototype>(obj));
+        }
+        if (type == ObjectType::GlobalScope) {
+            auto bindings_count = reader_.Get<uint64_t>();
+            for (uint64_t i = 0; i < bindings_count; ++i) {
+                SymbolPtr name = GetSymbol();
+                As<GlobalScope>(obj)->Define(name, GetRef());
+            }
+        }
+    }
+
+    GlobalScopePtr global_scope_;
+    ImageReader reader_;
+    std::unordered_map<std::string_view, ObjectPtr> builtins_;
+    std::vector<SymbolPtr> symbols_;
+    uint64_t segments_left_ = 0;
+    const std::vector<std::shared_ptr<Task>>* tasks_;
+    bool tenured_ = true;
+    // Memo of GetOuterSlots for the current segment, nullopt while it is computed.
+    std::unordered_map<ObjectPtr, std::optional<std::vector<size_t>>> outer_slots_;
+    // Objects of the current segment, rooted until the next one is loaded.
+    Args objects_;
+    LocalArgs root_{objects_};
+};
+
+// End of Loading
+
+void SaveImage(GlobalScopePtr global_scope, const std::string& path) {
+    ImageWriter writer{global_scope};
+    writer.AddSegment(global_scope);
+    WriteFile(path, writer.Finish());
+}
+
+void LoadImage(GlobalScopePtr global_scope, const std::string& path) {
+    MappedFile file{path};
+    ImageLoader loader{global_scope, file.GetData(), file.GetSize()};
+    // Loaded code is long-lived, so objects go straight to the old generation.
+    loader.LoadSegment(true, true);
+    if (!loader.IsEnd()) {
+        ThrowCorrupted();
+    }
+}
+
+// Images in memory
+
+namespace {
+
+// Names of the own bindings of global_scope which code reachable from roots may look up,
+// nullopt if that can't be told. Code looks globals up by symbol, so the values bound to
+// the symbols reached are followed as well, frozen ones included: frozen code sees the
+// bindings which shadow its own.
+std::optional<std::unordered_set<SymbolPtr>> CollectGlobalNames(GlobalScopePtr global_scope,
+                                                               const Args& roots) {
+    class Collector final : public Tracer {
+    public:
+        void Visit(ObjectPtr& slot) override {
+            if (IsHeapObject(slot) && visited.insert(slot).second) {
+                pending.push_back(slot);
+            }
+        }
+
+        std::unordered_set<ObjectPtr> visited;
+        Args pending;
+    };
+
+    Collector collector;
+    for (ObjectPtr root : roots) {
+        collector.Visit(root);
+    }
+    // Copies of frozen scopes go with the bindings.
+    for (auto [frozen, copy] : ScopeStack::GetCurrent().GetShadows()) {
+        ObjectPtr obj = copy;
+        collector.Visit(obj);
+    }
+    std::unordered_set<SymbolPtr> names;
+    while (!collector.pending.empty()) {
+        ObjectPtr obj = collector.pending.back();
+        collector.pending.pop_back();
+        if (auto* symbol = As<Symbol>(obj)) {
+            if (ObjectPtr* binding = global_scope->Find(symbol)) {
+                if (global_scope->GetBindings().contains(symbol)) {
+                    names.insert(symbol);
+                }
+                ObjectPtr value = *binding;
+                collector.Visit(value);
+            }
+        } else if (Is<GlobalScope>(obj)) {
+            // Their bindings are reached by name.
+            continue;
+        } else if (Is<Future>(obj) && As<Future>(obj)->GetTask() != nullptr) {
+            // The value of a task may use any global.
+            return std::nullopt;
+        } else if (Is<Frame>(obj)) {
+            As<Frame>(obj)->ForReading()->Trace(collector);
+        } else {
+            obj->Trace(collector);
+        }
+    }
+    return names;
+}
+
+}  // namespace
+
+ObjectsWriter::ObjectsWriter(GlobalScopePtr global_scope)
+    : global_scope_(global_scope), writer_(std::make_unique<ImageWriter>(global_scope, true)) {
+}
+
+ObjectsWriter::~ObjectsWriter() = default;
+
+void ObjectsWriter::AddBindings() {
+    writer_->AddSegment(global_scope_);
+    AddShadows();
+}
+
+void ObjectsWriter::AddBindings(const Args& roots) {
+    if (auto names = CollectGlobalNames(global_scope_, roots)) {
+        writer_->SetBindingsFilter(std::move(*names));
+    }
+    writer_->AddSegment(global_scope_);
+    AddShadows();
+}
+
+void ObjectsWriter::AddShadows() {
+    Local<Object> shadows;
+    for (const auto& [frozen, copy] : ScopeStack::GetCurrent().GetShadows()) {
+        Local<Cell> shadow{runtime::New<Cell>(frozen, copy)};
+        shadows = runtime::New<Cell>(shadow, shadows);
+    }
+    writer_->AddSegment(shadows);
+}
+
+void ObjectsWriter::Add(ObjectPtr obj) {
+    writer_->AddSegment(obj);
+}
+
+ObjectsImage ObjectsWriter::Finish() {
+    std::string data = writer_->Finish();
+    return ObjectsImage{std::move(data), writer_->TakeTasks()};
+}
+
+ObjectsReader::ObjectsReader(GlobalScopePtr global_scope, const ObjectsImage& image)
+    : loader_(std::make_unique<ImageLoader>(global_scope,
+                                            reinterpret_cast<const std::byte*>(image.data.data()),
+                                            image.data.size(), &image.tasks)) {
+}
+
+ObjectsReader::~ObjectsReader() = default;
+
+bool ObjectsReader::IsEnd() const {
+    return loader_->IsEnd();
+}
+
+void ObjectsReader::ReadBindings() {
+    loader_->LoadSegment(true, true);
+    for (ObjectPtr shadows = loader_->LoadSegment(true, false); shadows != nullptr;
+         shadows = As<Cell>(shadows)->GetSecond()) {
+        auto* shadow = As<Cell>(As<Cell>(shadows)->GetFirst());
+        ScopeStack::GetCurrent().SetShadow(As<Frame>(shadow->GetFirst()),
+                                           As<Frame>(shadow->GetSecond()));
+    }
+}
+
+ObjectPtr ObjectsReader::Read() {
+    return loader_->LoadSegment(false, false);
+}
+
+// End of Images in memory
+
+// Code caches
+
+uint64_t HashSource(std::string_view source) {
+    // 64-bit FNV-1a.
+    uint64_t hash = 0xcbf29ce484222325;
+    for (char c : source) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3;
+    }
+    return hash;
+}
+
+bool ReadCodeCache(GlobalScopePtr global_scope, const std::string& path,
+                   std::string_view source, Args* forms) {
+    if (access(path.c_str(), R_OK) != 0) {
+        return false;
+    }
+    try {
+        MappedFile file{path};
+        CodeCacheHeader header;
+        if (file.GetSize() < sizeof(header)) {
+            return false;
+        }
+        std::memcpy(&header, file.GetData(), sizeof(header));
+        const std::byte* image = file.GetData() + sizeof(header);
+        size_t image_size = file.GetSize() - sizeof(header);
+        if (header.build_id != GetBuildId() || header.source_size != source.size() ||
+            header.source_hash != HashSource(source) ||
+            header.image_hash !=
+                HashSource({reinterpret_cast<const char*>(image), image_size})) {
+            return false;
+        }
+        ImageLoader loader{global_scope, image, image_size};
+        while (!loader.IsEnd()) {
+            // Forms are evaluated and dropped one by one, so they start in the nursery.
+            forms->push_back(loader.LoadSegment(false, false));
+        }
+    } catch (const std::exception&) {
+        // A cache which passes the checks and still can't be loaded is as good as none.
+        forms->clear();
+        return false;
+    }
+    return true;
+}
+
+CodeCacheWriter::CodeCacheWriter(std::string_view source)
+    : source_size_(source.size()), source_hash_(HashSource(source)),
+      writer_(std::make_unique<ImageWriter>()) {
+}
+
+CodeCacheWriter::~CodeCacheWriter() = default;
+
+void CodeCacheWriter::Add(ObjectPtr form) {
+    writer_->AddSegment(form);
+}
+
+void CodeCacheWriter::Save(const std::string& path) {
+    std::string image = writer_->Finish();
+    CodeCacheHeader header{GetBuildId(), source_size_, source_hash_, HashSource(image)};
+    std::string data{reinterpret_cast<const char*>(&header), sizeof(header)};
+    data += image;
+    // Readers never see a partly written cache, concurrent writers race harmlessly.
+    std::string temp_path = path + ".tmp" + std::to_string(getpid());
+    try {
+        WriteFile(temp_path, data);
+    } catch (...) {
+        std::remove(temp_path.c_str());
+        throw;
+    }
+    if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        std::remove(temp_path.c_str());
+        throw RuntimeError{"Can't write " + path};
+    }
+}
+
+// End of Code caches
@@ -0,0 +1,533 @@
+#include "kernels.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define KERNELS_AVX2 1
+#include <immintrin.h>
+#endif
+
+namespace kernels {
+
+namespace {
+
+bool simd_enabled = true;
+
+intptr_t WordOf(ObjectPtr obj) {
+    return reinterpret_cast<intptr_t>(obj);
+}
+
+template <typename T>
+bool Holds(CompareOp op, T lhs, T rhs) {
+    switch (op) {
+        case CompareOp::Equal:
+            return lhs == rhs;
+        case CompareOp::Less:
+            return lhs < rhs;
+        case CompareOp::Greater:
+            return lhs > rhs;
+        case CompareOp::LessEq:
+            return lhs <= rhs;
+        case CompareOp::GreaterEq:
+            return lhs >= rhs;
+    }
+    return false;
+}
+
+// Scalar versions, also used for the tails shorter than a SIMD register.
+
+bool AllFixnumsScalar(const ObjectPtr* data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        if (!IsFixnum(data[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+__int128 SumWordsScalar(const ObjectPtr* data, size_t size) {
+    __int128 total = 0;
+    for (size_t i = 0; i < size; ++i) {
+        total += WordOf(data[i]);
+    }
+    return total;
+}
+
+template <bool IsMax>
+intptr_t ExtremeWordFrom(const ObjectPtr* data, size_t size, intptr_t acc) {
+    for (size_t i = 0; i < size; ++i) {
+        intptr_t word = WordOf(data[i]);
+        if (IsMax ? word > acc : word < acc) {
+            acc = word;
+        }
+    }
+    return acc;
+}
+
+template <bool IsMax>
+intptr_t ExtremeWordScalar(const ObjectPtr* data, size_t size) {
+    return ExtremeWordFrom<IsMax>(data + 1, size - 1, WordOf(data[0]));
+}
+
+bool AddFixnumsScalar(const ObjectPtr* lhs, const ObjectPtr* rhs, ObjectPtr* out, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        // (2a + 1) - 1 + (2b + 1) is the word of a + b.
+        intptr_t res;
+        if (__builtin_add_overflow(WordOf(lhs[i]) - 1, WordOf(rhs[i]), &res)) {
+            return false;
+        }
+        out[i] = reinterpret_cast<ObjectPtr>(res);
+    }
+    return true;
+}
+
+void CompareFixnumsScalar(const ObjectPtr* lhs, const ObjectPtr* rhs, uint8_t* out, size_t size,
+                          CompareOp op) {
+    for (size_t i = 0; i < size; ++i) {
+        out[i] = Holds(op, WordOf(lhs[i]), WordOf(rhs[i]));
+    }
+}
+
+double SumDoublesScalar(const double* data, size_t size) {
+    double acc = 0;
+    for (size_t i = 0; i < size; ++i) {
+        acc += data[i];
+    }
+    return acc;
+}
+
+double DotDoublesScalar(const double* lhs, const double* rhs, size_t size) {
+    double acc = 0;
+    for (size_t i = 0; i < size; ++i) {
+        acc += lhs[i] * rhs[i];
+    }
+    return acc;
+}
+
+// NaN wins, as in min and max: once the accumulator is NaN it stays NaN.
+template <bool IsMax>
+double ExtremeDoubleFrom(const double* data, size_t size, double acc) {
+    for (size_t i = 0; i < size; ++i) {
+        acc = std::isnan(acc) || (IsMax ? acc > data[i] : acc < data[i]) ? acc : data[i];
+    }
+    return acc;
+}
+
+template <bool IsMax>
+double ExtremeDoubleScalar(const double* data, size_t size) {
+    return ExtremeDoubleFrom<IsMax>(data + 1, size - 1, data[0]);
+}
+
+void AddDoublesScalar(const double* lhs, const double* rhs, double* out, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        out[i] = lhs[i] + rhs[i];
+    }
+}
+
+void ScaleDoublesScalar(const double* data, double factor, double* out, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        out[i] = data[i] * factor;
+    }
+}
+
+void CompareDoublesScalar(const double* lhs, const double* rhs, uint8_t* out, size_t size,
+                          CompareOp op) {
+    for (size_t i = 0; i < size; ++i) {
+        out[i] = Holds(op, lhs[i], rhs[i]);
+    }
+}
+
+// End of scalar versions
+
+#ifdef KERNELS_AVX2
+
+// AVX2 versions process four words or doubles per step.
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+constexpr size_t kLanes = 4;
+
+AVX2_TARGET __m256i LoadWords(const ObjectPtr* data) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+}
+
+AVX2_TARGET void StoreMask(int bits, uint8_t* out) {
+    for (size_t lane = 0; lane < kLanes; ++lane) {
+        out[lane] = bits >> lane & 1;
+    }
+}
+
+AVX2_TARGET bool AllFixnumsAvx2(const ObjectPtr* data, size_t size) {
+    __m256i tags = _mm256_set1_epi64x(1);
+    size_t i = 0;
+    for (; i + kLanes <= size; i += kLanes) {
+        tags = _mm256_and_si256(tags, LoadWords(data + i));
+    }
+    // Every lane keeps its tag bit only if all of its words are fixnums.
+    int all = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_slli_epi64(tags, 63)));
+    return all == 0xf && AllFixnumsScalar(data + i, size - i);
+}
+
+// Each word is split into its unsigned 32-bit halves and its sign, so the lanes can't
+// overflow for fewer than 2^32 words.
+AVX2_TARGET __int128 SumWordsAvx2(const ObjectPtr* data, size_t size) {
+    const __m256i low_mask = _mm256_set1_epi64x(0xffffffff);
+    __m256i low = _mm256_setzero_si256();
+    __m256i high = _mm256_setzero_si256();
+    __m256i negative = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + kLanes <= size; i += kLanes) {
+        __m256i words = LoadWords(data + i);
+        low = _mm256_add_epi64(low, _mm256_and_si256(words, low_mask));
+        high = _mm256_add_epi64(high, _mm256_srli_epi64(words, 32));
+        negative = _mm256_add_epi64(negative, _mm256_srli_epi64(words, 63));
+    }
+    alignas(32) uint64_t lanes[3][kLanes];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[0]), low);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[1]), high);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[2]), negative);
+    __int128 total = SumWordsScalar(data + i, size - i);
+    for (size_t lane = 0; lane < kLanes; ++lane) {
+        total += static_cast<__int128>(lanes[0][lane]);
+        total += static_cast<__int128>(lanes[1][lane]) << 32;
+        total -= static_cast<__int128>(lanes[2][lane]) << 64;
+    }
+    return total;
+}
+
+template <bool IsMax>
+AVX2_TARGET __m256i ExtremeWords(__m256i acc, __m256i words) {
+    __m256i replace = IsMax ? _mm256_cmpgt_epi64(words, acc) : _mm256_cmpgt_epi64(acc, words);
+    return _mm256_blendv_epi8(acc, words, replace);
+}
+
+// Two accumulators hide the latency of the compare and blend chain.
+template <bool IsMax>
+AVX2_TARGET intptr_t ExtremeWordAvx2(const ObjectPtr* data, size_t size) {
+    if (size < 2 * kLanes) {
+        return ExtremeWordScalar<IsMax>(data, size);
+    }
+    __m256i first = LoadWords(data);
+    __m256i second = LoadWords(data + kLanes);
+    size_t i = 2 * kLanes;
+    for (; i + 2 * kLanes <= size; i += 2 * kLanes) {
+        first = ExtremeWords<IsMax>(first, LoadWords(data + i));
+        second = ExtremeWords<IsMax>(second, LoadWords(data + i + kLanes));
+    }
+    alignas(32) intptr_t lanes[kLanes];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), ExtremeWords<IsMax>(first, second));
+    intptr_t res = lanes[0];
+    for (size_t lane = 1; lane < kLanes; ++lane) {
+        res = IsMax ? std::max(res, lanes[lane]) : std::min(res, lanes[lane]);
+    }
+    return ExtremeWordFrom<IsMax>(data + i, size - i, res);
+}
+
+AVX2_TARGET bool AddFixnumsAvx2(const ObjectPtr* lhs, const ObjectPtr* rhs, ObjectPtr* out,
+                                size_t size) {
+    const __m256i one = _mm256_set1_epi64x(1);
+    __m256i overflow = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + kLanes <= size; i += kLanes) {
+        __m256i lhs_words = _mm256_sub_epi64(LoadWords(lhs + i), one);
+        __m256i rhs_words = LoadWords(rhs + i);
+        __m256i res = _mm256_add_epi64(lhs_words, rhs_words);
+        // Signed overflow: the sign of the sum differs from the signs of both operands.
+        overflow = _mm256_or_si256(overflow,
+                                   _mm256_and_si256(_mm256_xor_si256(lhs_words, res),
+                                                    _mm256_xor_si256(rhs_words, res)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), res);
+    }
+    if (_mm256_movemask_pd(_mm256_castsi256_pd(overflow)) != 0) {
+        return false;
+    }
+    return AddFixnumsScalar(lhs + i, rhs + i, out + i, size - i);
+}
+
+AVX2_TARGET void CompareFixnumsAvx2(const ObjectPtr* lhs, const ObjectPtr* rhs, uint8_t* out,
+                                    size_t size, CompareOp op) {
+    size_t i = 0;
+    for (; i + kLanes <= size; i += kLanes) {
+        __m256i lhs_words = LoadWords(lhs + i);
+        __m256i rhs_words = LoadWords(rhs + i);
+        __m256i mask = _mm256_setzero_si256();
+        // LessEq and GreaterEq are the negations of Greater and Less.
+        int invert = 0;
+        switch (op) {
+            case CompareOp::Equal:
+                mask = _mm256_cmpeq_epi64(lhs_words, rhs_words);
+                break;
+            case CompareOp::Less:
+                mask = _mm256_cmpgt_epi64(rhs_words, lhs_words);
+                break;
+            case CompareOp::Greater:
+                mask = _mm256_cmpgt_epi64(lhs_words, rhs_words);
+                break;
+            case CompareOp::LessEq:
+                mask = _mm256_cmpgt_epi64(lhs_words, rhs_words);
+                invert = 0xf;
+                break;
+            case CompareOp::GreaterEq:
+                mask = _mm256_cmpgt_epi64(rhs_words, lhs_words);
+                invert = 0xf;
+                break;
+        }
+        StoreMask(_mm256_movemask_pd(_mm256_castsi256_pd(mask)) ^ invert, out + i);
+    }
+    CompareFixnumsScalar(lhs + i, rhs + i, out + i, size - i, op);
+}
+
+AVX2_TARGET double SumLanes(__m256d acc) {
+    alignas(32) double lanes[kLanes];
+    _mm256_store_pd(lanes, acc);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+AVX2_TARGET double SumDoublesAvx2(const double* data, size_t size) {
+    __m256d acc = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + kLanes <= size; i += kLanes) {
+        acc = _mm256_add_pd(acc, _mm256_loadu_pd(data + i));
+    }
+    return SumLanes(acc) + SumDoublesScalar(data + i, size - i);
+}
+
+AVX2_TARGET double DotDoublesAvx2(const double* lhs, const double* rhs, size_t size) {
+    __m256d acc = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + kLanes <= size; i += kLanes) {
+        acc = _mm256_add_pd(acc, _mm256_mul_pd(_mm256_loadu_pd(lhs + i), _mm256_loadu_pd(rhs + i)));
+    }
+    return SumLanes(acc) + DotDoublesScalar(lhs + i, rhs + i, size - i);
+}
+
+template <bool IsMax>
+AVX2_TARGET double ExtremeDoubleAvx2(const double* data, size_t size) {
+    if (size < kLanes) {
+        return ExtremeDoubleScalar<IsMax>(data, size);
+    }
+    __m256d acc = _mm256_loadu_pd(data);
+    // minpd and maxpd return their second operand when either is NaN, so lanes which met
+    // NaN are kept in a mask.
+    __m256d nans = _mm256_cmp_pd(acc, acc, _CMP_UNORD_Q);
+    size_t i = kLanes;
+    for (; i + kLanes <= size; i += kLanes) {
+        __m256d values = _mm256_loadu_pd(data + i);
+        nans = _mm256_or_pd(nans, _mm256_cmp_pd(values, values, _CMP_UNORD_Q));
+        acc = IsMax ? _mm256_max_pd(acc, values) : _mm256_min_pd(acc, values);
+    }
+    if (_mm256_movemask_pd(nans) != 0) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    alignas(32) double lanes[kLanes];
+    _mm256_store_pd(lanes, acc);
+    double res = ExtremeDoubleScalar<IsMax>(lanes, kLanes);
+    return ExtremeDoubleFrom<IsMax>(data + i, size - i, res);
+}
+
+AVX2_TARGET void AddDoublesAvx2(const double* lhs, const double* rhs, double* out, size_t size) {
+    size_t i = 0;
+    for (; i + kLanes <= size; i += kLanes) {
+        _mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_loadu_pd(lhs + i), _mm256_loadu_pd(rhs + i)));
+    }
+    AddDoublesScalar(lhs + i, rhs + i, out + i, size - i);
+}
+
+AVX2_TARGET void ScaleDoublesAvx2(const double* data, double factor, double* out, size_t size) {
+    const __m256d factors = _mm256_set1_pd(factor);
+    size_t i = 0;
+    for (; i + kLanes <= size; i += kLanes) {
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(data + i), factors));
+    }
+    ScaleDoublesScalar(data + i, factor, out + i, size - i);
+}
+
+// The predicate of vcmppd must be a constant.
+template <int Predicate>
+AVX2_TARGET size_t CompareDoublesAvx2(const double* lhs, const double* rhs, uint8_t* out,
+                                      size_t size) {
+    size_t i = 0;
+    for (; i + kLanes <= size; i += kLanes) {
+        __m256d mask = _mm256_cmp_pd(_mm256_loadu_pd(lhs + i), _mm256_loadu_pd(rhs + i), Predicate);
+        StoreMask(_mm256_movemask_pd(mask), out + i);
+    }
+    return i;
+}
+
+AVX2_TARGET void CompareDoublesAvx2(const double* lhs, const double* rhs, uint8_t* out,
+                                    size_t size, CompareOp op) {
+    size_t done = 0;
+    switch (op) {
+        case CompareOp::Equal:
+            done = CompareDoublesAvx2<_CMP_EQ_OQ>(lhs, rhs, out, size);
+            break;
+        case CompareOp::Less:
+            done = CompareDoublesAvx2<_CMP_LT_OQ>(lhs, rhs, out, size);
+            break;
+        case CompareOp::Greater:
+            done = CompareDoublesAvx2<_CMP_GT_OQ>(lhs, rhs, out, size);
+            break;
+        case CompareOp::LessEq:
+            done = CompareDoublesAvx2<_CMP_LE_OQ>(lhs, rhs, out, size);
+            break;
+        case CompareOp::GreaterEq:
+            done = CompareDoublesAvx2<_CMP_GE_OQ>(lhs, rhs, out, size);
+            break;
+    }
+    CompareDoublesScalar(lhs + done, rhs + done, out + done, size - done, op);
+}
+
+#undef AVX2_TARGET
+
+#endif  // KERNELS_AVX2
+
+bool UseAvx2() {
+#ifdef KERNELS_AVX2
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return simd_enabled && supported;
+#else
+    return false;
+#endif
+}
+
+}  // namespace
+
+void SetSimdEnabled(bool enabled) {
+    simd_enabled = enabled;
+}
+
+bool IsSimdEnabled() {
+    return UseAvx2();
+}
+
+bool AllFixnums(const ObjectPtr* data, size_t size) {
+#ifdef KERNELS_AVX2
+    if (UseAvx2()) {
+        return AllFixnumsAvx2(data, size);
+    }
+#endif
+    return AllFixnumsScalar(data, size);
+}
+
+__int128 SumFixnums(const ObjectPtr* data, size_t size) {
+    // Words are 2 * value + 1.
+    __int128 words;
+#ifdef KERNELS_AVX2
+    if (UseAvx2()) {
+        words = SumWordsAvx2(data, size);
+    } else {
+        words = SumWordsScalar(data, size);
+    }
+#else
+    words = SumWordsScalar(data, size);
+#endif
+    return (words - static_cast<__int128>(size)) / 2;
+}
+
+ObjectPtr MinFixnum(const ObjectPtr* data, size_t size) {
+#ifdef KERNELS_AVX2
+    if (UseAvx2()) {
+        return reinterpret_cast<ObjectPtr>(ExtremeWordAvx2<false>(data, size));
+    }
+#endif
+    return reinterpret_cast<ObjectPtr>(ExtremeWordScalar<false>(data, size));
+}
+
+ObjectPtr MaxFixnum(const ObjectPtr* data, size_t size) {
+#ifdef KERNELS_AVX2
+    if (UseAvx2()) {
+        return reinterpret_cast<ObjectPtr>(ExtremeWordAvx2<true>(data, size));
+    }
+#endif
+    return reinterpret_cast<ObjectPtr>(ExtremeWordScalar<true>(data, size));
+}
+
+bool AddFixnums(const ObjectPtr* lhs, const ObjectPtr* rhs, ObjectPtr* out, size_t size) {
+#ifdef KERNELS_AVX2
+    if (UseAvx2()) {
+        return AddFixnumsAvx2(lhs, rhs, out, size);
+    }
+#endif
+    return AddFixnumsScalar(lhs, rhs, out, size);
+}
+
+void CompareFixnums(const ObjectPtr* lhs, const ObjectPtr* rhs, uint8_t* out, size_t size,
+                    CompareOp op) {
+#ifdef KERNELS_AVX2
+    if (UseAvx2()) {
+        CompareFixnumsAvx2(lhs, rhs, out, size, op);
+        return;
+    }
+#endif
+    CompareFixnumsScalar(lhs, rhs, out, size, op);
+}
+
+double SumDoubles(const double* data, size_t size) {
+#ifdef KERNELS_AVX2
+    if (UseAvx2()) {
+        return SumDoublesAvx2(data, size);
+    }
+#endif
+    return SumDoublesScalar(data, size);
+}
+
+double DotDoubles(const double* lhs, const double* rhs, size_t size) {
+#ifdef KERNELS_AVX2
+    if (UseAvx2()) {
+        return DotDoublesAvx2(lhs, rhs, size);
+    }
+#endif
+    return DotDoublesScalar(lhs, rhs, size);
+}
+
+double MinDouble(const double* data, size_t size) {
+#ifdef KERNELS_AVX2
+    if (UseAvx2()) {
+        return ExtremeDoubleAvx2<false>(data, size);
+    }
+#endif
+    return ExtremeDoubleScalar<false>(data, size);
+}
+
+double MaxDouble(const double* data, size_t size) {
+#ifdef KERNELS_AVX2
+    if (UseAvx2()) {
+        return ExtremeDoubleAvx2<true>(data, size);
+    }
+#endif
+    return ExtremeDoubleScalar<true>(data, size);
+}
+
+void AddDoubles(const double* lhs, const double* rhs, double* out, size_t size) {
+#ifdef KERNELS_AVX2
+    if (UseAvx2()) {
+        AddDoublesAvx2(lhs, rhs, out, size);
+        return;
+    }
+#endif
+    AddDoublesScalar(lhs, rhs, out, size);
+}
+
+void ScaleDoubles(const double* data, double factor, double* out, size_t size) {
+#ifdef KERNELS_AVX2
+    if (UseAvx2()) {
+        ScaleDoublesAvx2(data, factor, out, size);
+        return;
+    }
+#endif
+    ScaleDoublesScalar(data, factor, out, size);
+}
+
+void CompareDoubles(const double* lhs, const double* rhs, uint8_t* out, size_t size,
+                    CompareOp op) {
+#ifdef KERNELS_AVX2
+    if (UseAvx2()) {
+        CompareDoublesAvx2(lhs, rhs, out, size, op);
+        return;
+    }
+#endif
+    CompareDoublesScalar(lhs, rhs, out, size, op);
+}
+
+}  // namespace kernels
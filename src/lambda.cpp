@@ -7,37 +7,101 @@
 #include "runtime.h"
 #include "scope.h"
 
-LambdaFunction::LambdaFunction(const std::vector<std::string>& params, ObjectPtr body,
-                               ScopePtr scope)
-    : params_(params), body_(body), captured_scope_(scope) {
-    AddDependency(scope);
-    AddDependency(body);
+LambdaTemplate::LambdaTemplate(const std::vector<SymbolPtr>& params, ObjectPtr body,
+                               const FrameLayout* parent, GlobalScopePtr global_scope)
+    : SpecialForm(ObjectType::LambdaTemplate) {
+    layout_.names = params;
+    layout_.params_count = params.size();
+    layout_.parent = parent;
+    for (ObjectPtr form : GetArgsVector<false>(body)) {
+        CollectDefines(form, &layout_, global_scope);
+    }
+    body_ = ResolveExpr(body, &layout_, global_scope);
+    layout_.parent = nullptr;
+}
+
+LambdaTemplate::LambdaTemplate(FrameLayout layout, ObjectPtr body)
+    : SpecialForm(ObjectType::LambdaTemplate), layout_(std::move(layout)), body_(body) {
+}
+
+ObjectPtr LambdaTemplate::operator()(ObjectPtr) {
+    return runtime::New<LambdaFunction>(this, ScopeStack::GetCurrent().Current());
+}
+
+LambdaFunction::LambdaFunction(LambdaTemplatePtr lambda, ScopePtr scope)
+    : Procedure(ObjectType::LambdaFunction), template_(lambda), captured_scope_(scope) {
 }
 
-ObjectPtr LambdaFunction::operator()(ObjectPtr obj) {
-    auto args = GetSafeArgs(obj, params_.size(), params_.size());
-    ScopePtr scope = runtime::New<Scope>(captured_scope_);
-    ScopeGuard guard{scope};
-    for (size_t i = 0; i < params_.size(); ++i) {
-        scope->Define(params_[i], args[i]);
+ObjectPtr LambdaFunction::Apply(const Args& args) {
+    ScopeGuard guard{MakeFrame(args)};
+    return EvalObject(EvalLeadingForms());
+}
+
+bool LambdaFunction::EvalTail(ObjectPtr obj, ScopeGuard& frame, ObjectPtr& res) {
+    Args args = GetArgsVector(obj);
+    LocalArgs root{args};
+    frame.Enter(MakeFrame(args));
+    res = EvalLeadingForms();
+    return true;
+}
+
+FramePtr LambdaFunction::MakeFrame(const Args& args) {
+    const FrameLayout& layout = template_->GetLayout();
+    EnsureArgs(args, layout.params_count, layout.params_count);
+    FramePtr frame = Frame::Make(captured_scope_, layout.names.size(), UnboundSlot());
+    for (size_t i = 0; i < args.size(); ++i) {
+        frame->SetSlot(i, args[i]);
     }
-    ObjectPtr res = GetArgsVector(body_).back();
-    return res;
+    return frame;
 }
 
-ObjectPtr Lambda::operator()(ObjectPtr obj) {
+ObjectPtr LambdaFunction::EvalLeadingForms() {
+    ObjectPtr body = template_->GetBody();
+    while (Is<Cell>(body) && As<Cell>(body)->GetSecond() != nullptr) {
+        EvalObject(As<Cell>(body)->GetFirst());
+        body = As<Cell>(body)->GetSecond();
+    }
+    return Is<Cell>(body) ? As<Cell>(body)->GetFirst() : body;
+}
+
+LambdaSyntax ParseLambda(ObjectPtr obj) {
     if (!Is<Cell>(obj)) {
         throw SyntaxError{"Lambda wrong syntax"};
     }
     auto args = GetSafeArgs<true, Symbol, false>(As<Cell>(obj)->GetFirst(), 0, kMaxArgs);
-    std::vector<std::string> params;
+    std::vector<SymbolPtr> params;
     for (const auto& symb : args) {
-        params.push_back(As<Symbol>(symb)->GetName());
+        params.push_back(As<Symbol>(symb));
+    }
+    ObjectPtr body = As<Cell>(obj)->GetSecond();
+    if (body == nullptr) {
+        throw SyntaxError{"Lambda wrong syntax"};
+    }
+    return {params, body};
+}
+
+std::pair<SymbolPtr, LambdaSyntax> ParseDefineLambda(ObjectPtr obj) {
+    if (!Is<Cell>(obj)) {
+        throw SyntaxError{"Not correct defining lambda"};
+    }
+    Args args =
+        (GetSafeArgs<true, Symbol, false, SyntaxError>(As<Cell>(obj)->GetFirst(), 1, kMaxArgs));
+    SymbolPtr name = As<Symbol>(args[0]);
+    std::vector<SymbolPtr> params;
+    for (size_t i = 1; i < args.size(); ++i) {
+        params.push_back(As<Symbol>(args[i]));
     }
     ObjectPtr body = As<Cell>(obj)->GetSecond();
     if (body == nullptr) {
         throw SyntaxError{"Lambda wrong syntax"};
     }
-    ScopePtr current_scope = ScopeStack::GetInstance().Current();
-    return runtime::New<LambdaFunction>(params, body, current_scope);
-}
\ No newline at end of file
+    return {name, {params, body}};
+}
+
+ObjectPtr Lambda::operator()(ObjectPtr obj) {
+    auto [params, body] = ParseLambda(obj);
+    ScopePtr current_scope = ScopeStack::GetCurrent().Current();
+    Local<LambdaTemplate> lambda{
+        runtime::New<LambdaTemplate>(params, body, nullptr, current_scope->GetGlobal())};
+    return runtime::New<LambdaFunction>(lambda, current_scope);
+}
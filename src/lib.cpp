@@ -1,11 +1,15 @@
 #include "lib.h"
+#include <algorithm>
+#include <cmath>
 #include <cstddef>
 #include <functional>
 #include <limits>
 #include <type_traits>
+#include <utility>
 #include <vector>
 #include "error.h"
 #include "lambda.h"
+#include "resolver.h"
 #include "object.h"
 #include "runtime.h"
 #include "scope.h"
@@ -26,63 +30,83 @@ ObjectPtr Quote::operator()(ObjectPtr obj) {
 
 // NumPredicate
 
-ObjectPtr NumPredicate::operator()(ObjectPtr obj) {
-    auto arg = GetSafeArgs(obj, 1, 1)[0];
-    return runtime::New<Symbol>(Is<Number>(arg));
+ObjectPtr NumPredicate::Apply(const Args& args) {
+    EnsureArgs(args, 1, 1);
+    auto arg = args[0];
+    return Symbol::Boolean(Is<Number>(arg));
 }
 
 // End of NumPredicate
 
 // Abs
 
-ObjectPtr Abs::operator()(ObjectPtr obj) {
-    auto arg = GetSafeArgs<true, Number>(obj, 1, 1)[0];
-    return runtime::New<Number>(std::abs(As<Number>(arg)->GetValue()));
+ObjectPtr Abs::Apply(const Args& args) {
+    EnsureArgs<true, Number>(args, 1, 1);
+    auto arg = args[0];
+    if (Is<Flonum>(arg)) {
+        return runtime::New<Flonum>(std::fabs(As<Flonum>(arg)->GetValue()));
+    }
+    if (CompareNumbers(arg, Number::Make(0)) < 0) {
+        return SubtractNumbers(Number::Make(0), arg);
+    }
+    return arg;
 }
 
 // End of Abs
 
 // Boolean
-ObjectPtr BoolPredicate::operator()(ObjectPtr obj) {
-    auto arg = GetSafeArgs(obj, 1, 1)[0];
-    // return runtime::New<Symbol>(Is<True>(arg) || Is<False>(arg));
-    bool res = Is<Symbol>(arg);
-    if (!res) {
-        return runtime::New<Symbol>(false);
-    }
-    const std::string& name = As<Symbol>(arg)->GetName();
-    return runtime::New<Symbol>(name == kTrueSymbol || name == kFalseSymbol);
+ObjectPtr BoolPredicate::Apply(const Args& args) {
+    EnsureArgs(args, 1, 1);
+    auto arg = args[0];
+    return Symbol::Boolean(arg == Symbol::Boolean(true) || arg == Symbol::Boolean(false));
 }
 
-ObjectPtr LogicalNot::operator()(ObjectPtr obj) {
-    auto arg = GetSafeArgs(obj, 1, 1)[0];
-    return runtime::New<Symbol>(!ToBoolean(arg));
+ObjectPtr LogicalNot::Apply(const Args& args) {
+    EnsureArgs(args, 1, 1);
+    auto arg = args[0];
+    return Symbol::Boolean(!ToBoolean(arg));
 }
 
 ObjectPtr LogicalAnd::operator()(ObjectPtr obj) {
+    return EvalThroughTail(obj);
+}
+
+bool LogicalAnd::EvalTail(ObjectPtr obj, ScopeGuard&, ObjectPtr& res) {
     auto args =
         GetSafeArgs<false, std::false_type, false>(obj, 0, std::numeric_limits<size_t>::max());
-    ObjectPtr res = runtime::New<Symbol>(true);
-    for (size_t i = 0; i < args.size(); ++i) {
-        res = args[i]->Eval();
+    res = Symbol::Boolean(true);
+    for (size_t i = 0; i + 1 < args.size(); ++i) {
+        res = EvalObject(args[i]);
         if (!ToBoolean(res)) {
-            return res;
+            return false;
         }
     }
-    return res;
+    if (args.empty()) {
+        return false;
+    }
+    res = args.back();
+    return true;
 }
 
 ObjectPtr LogicalOr::operator()(ObjectPtr obj) {
+    return EvalThroughTail(obj);
+}
+
+bool LogicalOr::EvalTail(ObjectPtr obj, ScopeGuard&, ObjectPtr& res) {
     auto args =
         GetSafeArgs<false, std::false_type, false>(obj, 0, std::numeric_limits<size_t>::max());
-    ObjectPtr res = runtime::New<Symbol>(false);
-    for (size_t i = 0; i < args.size(); ++i) {
-        res = args[i]->Eval();
+    res = Symbol::Boolean(false);
+    for (size_t i = 0; i + 1 < args.size(); ++i) {
+        res = EvalObject(args[i]);
         if (ToBoolean(res)) {
-            return res;
+            return false;
         }
     }
-    return res;
+    if (args.empty()) {
+        return false;
+    }
+    res = args.back();
+    return true;
 }
 
 // List functions
@@ -101,157 +125,518 @@ std::pair<int, bool> GetListInfo(CellPtr arg) {
     return {cnt_levels, sec_non_null};
 }
 
-ObjectPtr PairPredicate::operator()(ObjectPtr obj) {
-    auto arg = As<Cell>(GetSafeArgs(obj, 1, 1)[0]);
+ObjectPtr PairPredicate::Apply(const Args& args) {
+    EnsureArgs(args, 1, 1);
+    auto arg = As<Cell>(args[0]);
     const auto [cnt_levels, sec_non_null] = GetListInfo(arg);
-    return runtime::New<Symbol>(cnt_levels == 2 || (sec_non_null && cnt_levels == 1));
+    return Symbol::Boolean(cnt_levels == 2 || (sec_non_null && cnt_levels == 1));
 }
 
-ObjectPtr NullPredicate::operator()(ObjectPtr obj) {
-    auto arg = As<Cell>(GetSafeArgs(obj, 1, 1)[0]);
-    return runtime::New<Symbol>(arg == nullptr);
+ObjectPtr NullPredicate::Apply(const Args& args) {
+    EnsureArgs(args, 1, 1);
+    auto arg = As<Cell>(args[0]);
+    return Symbol::Boolean(arg == nullptr);
 }
 
-ObjectPtr ListPredicate::operator()(ObjectPtr obj) {
-    auto arg = As<Cell>(GetSafeArgs(obj, 1, 1)[0]);
+ObjectPtr ListPredicate::Apply(const Args& args) {
+    EnsureArgs(args, 1, 1);
+    auto arg = As<Cell>(args[0]);
     const auto [cnt_levels, sec_non_null] = GetListInfo(arg);
-    return runtime::New<Symbol>(arg == nullptr || !sec_non_null);
+    return Symbol::Boolean(arg == nullptr || !sec_non_null);
 }
 
-ObjectPtr PairCons::operator()(ObjectPtr obj) {
-    auto args = GetSafeArgs(obj, 2, 2);
+ObjectPtr PairCons::Apply(const Args& args) {
+    EnsureArgs(args, 2, 2);
     return runtime::New<Cell>(args[0], args[1]);
 }
 
-ObjectPtr PairCar::operator()(ObjectPtr obj) {
-    auto first = As<Cell>(GetSafeArgs<true, Cell>(obj, 1, 1)[0])->GetFirst();
+ObjectPtr PairCar::Apply(const Args& args) {
+    EnsureArgs<true, Cell>(args, 1, 1);
+    auto first = As<Cell>(args[0])->GetFirst();
     return first;
 }
 
-ObjectPtr PairCdr::operator()(ObjectPtr obj) {
-    auto second = As<Cell>(GetSafeArgs<true, Cell>(obj, 1, 1)[0])->GetSecond();
+ObjectPtr PairCdr::Apply(const Args& args) {
+    EnsureArgs<true, Cell>(args, 1, 1);
+    auto second = As<Cell>(args[0])->GetSecond();
     return second;
 }
 
-ObjectPtr ListCtor::operator()(ObjectPtr obj) {
-    return obj;
+ObjectPtr ListCtor::Apply(const Args& args) {
+    Local<Object> res;
+    for (auto it = args.rbegin(); it != args.rend(); ++it) {
+        res = runtime::New<Cell>(*it, res);
+    }
+    return res;
+}
+
+// The list after count pairs, reached without copying them.
+ObjectPtr DropPairs(ObjectPtr list, int64_t count) {
+    for (; count > 0; --count) {
+        if (!Is<Cell>(list)) {
+            throw RuntimeError{"Wrong argument number"};
+        }
+        list = As<Cell>(list)->GetSecond();
+    }
+    return list;
 }
 
-ObjectPtr ListRef::operator()(ObjectPtr obj) {
-    auto args = GetSafeArgs(obj, 2, 2);
-    if (!Is<Cell>(args[0]) || !Is<Number>(args[1])) {
+ObjectPtr ListRef::Apply(const Args& args) {
+    EnsureArgs(args, 2, 2);
+    if (!Is<Cell>(args[0]) || !IsFixnum(args[1]) || Number::GetValue(args[1]) < 0) {
         throw RuntimeError{"Wrong types for list-ref"};
     }
-    size_t index = As<Number>(args[1])->GetValue();
-    auto element = GetSafeArgs(args[0], index + 1, kMaxArgs)[index];
-    return element;
+    ObjectPtr rest = DropPairs(args[0], Number::GetValue(args[1]));
+    if (!Is<Cell>(rest)) {
+        throw RuntimeError{"Wrong argument number"};
+    }
+    return As<Cell>(rest)->GetFirst();
 }
 
-ObjectPtr ListTail::operator()(ObjectPtr obj) {
-    auto args = GetSafeArgs(obj, 2, 2);
-    if (!Is<Cell>(args[0]) || !Is<Number>(args[1])) {
+// The tail is shared with the list, as in Scheme.
+ObjectPtr ListTail::Apply(const Args& args) {
+    EnsureArgs(args, 2, 2);
+    if (!Is<Cell>(args[0]) || !IsFixnum(args[1]) || Number::GetValue(args[1]) < 0) {
         throw RuntimeError{"Wrong types for list-tail"};
     }
-    size_t index = As<Number>(args[1])->GetValue();
-    auto full_list = GetSafeArgs(args[0], index, kMaxArgs);
-    if (index == full_list.size()) {
-        return nullptr;
+    return DropPairs(args[0], Number::GetValue(args[1]));
+}
+
+// Vectors
+
+// Index of an element of the vector.
+size_t GetVectorIndex(ObjectPtr vector, ObjectPtr index) {
+    if (!IsFixnum(index) || Number::GetValue(index) < 0 ||
+        static_cast<uint64_t>(Number::GetValue(index)) >= As<Vector>(vector)->GetSize()) {
+        throw RuntimeError{"Vector index out of range"};
+    }
+    return Number::GetValue(index);
+}
+
+ObjectPtr VectorPredicate::Apply(const Args& args) {
+    EnsureArgs(args, 1, 1);
+    return Symbol::Boolean(Is<Vector>(args[0]));
+}
+
+ObjectPtr MakeVector::Apply(const Args& args) {
+    EnsureArgs(args, 1, 2);
+    if (!IsFixnum(args[0]) || Number::GetValue(args[0]) < 0) {
+        throw RuntimeError{"Wrong types for make-vector"};
+    }
+    ObjectPtr fill = args.size() > 1 ? args[1] : Number::Make(0);
+    return Vector::Make(Number::GetValue(args[0]), fill);
+}
+
+ObjectPtr VectorCtor::Apply(const Args& args) {
+    return Vector::Make(args);
+}
+
+ObjectPtr VectorLength::Apply(const Args& args) {
+    EnsureArgs<true, Vector>(args, 1, 1);
+    return Number::Make(As<Vector>(args[0])->GetSize());
+}
+
+ObjectPtr VectorRef::Apply(const Args& args) {
+    EnsureArgs(args, 2, 2);
+    if (!Is<Vector>(args[0])) {
+        throw RuntimeError{"Wrong types for vector-ref"};
     }
-    CellPtr main_tail = runtime::New<Cell>();
-    CellPtr cur_tail = main_tail;
-    for (size_t i = index; i < full_list.size(); ++i) {
-        cur_tail->SetFirst(full_list[i]);
-        if (i < full_list.size() - 1) {
-            cur_tail->SetSecond(runtime::New<Cell>());
-            cur_tail = As<Cell>(cur_tail->GetSecond());
+    return As<Vector>(args[0])->Get(GetVectorIndex(args[0], args[1]));
+}
+
+ObjectPtr VectorSet::Apply(const Args& args) {
+    EnsureArgs(args, 3, 3);
+    if (!Is<Vector>(args[0])) {
+        throw RuntimeError{"Wrong types for vector-set!"};
+    }
+    As<Vector>(args[0])->Set(GetVectorIndex(args[0], args[1]), args[2]);
+    return nullptr;
+}
+
+ObjectPtr VectorToList::Apply(const Args& args) {
+    EnsureArgs<true, Vector>(args, 1, 1);
+    VectorPtr vector = As<Vector>(args[0]);
+    Local<Object> res;
+    for (size_t i = vector->GetSize(); i > 0; --i) {
+        res = runtime::New<Cell>(vector->Get(i - 1), res);
+    }
+    return res;
+}
+
+ObjectPtr ListToVector::Apply(const Args& args) {
+    EnsureArgs(args, 1, 1);
+    // The elements stay reachable from the list, which the caller roots.
+    Args elements;
+    ObjectPtr list = args[0];
+    while (Is<Cell>(list)) {
+        elements.push_back(As<Cell>(list)->GetFirst());
+        list = As<Cell>(list)->GetSecond();
+    }
+    if (list != nullptr) {
+        throw RuntimeError{"Wrong types for list->vector"};
+    }
+    return Vector::Make(elements);
+}
+
+// End of Vectors
+
+// Vector kernels
+
+// Representation the elements of numeric vectors are processed in, from the fastest.
+enum class NumericElements { Fixnums, Doubles, Generic };
+
+// SumFixnums requires fewer than 2^32 elements.
+constexpr size_t kMaxSummedFixnums = size_t{1} << 32;
+
+NumericElements ClassifyElements(VectorPtr vector) {
+    if (kernels::AllFixnums(vector->GetData(), vector->GetSize())) {
+        return NumericElements::Fixnums;
+    }
+    auto res = NumericElements::Fixnums;
+    for (size_t i = 0; i < vector->GetSize(); ++i) {
+        ObjectPtr element = vector->Get(i);
+        if (IsFixnum(element)) {
+            continue;
+        }
+        if (!Is<Number>(element)) {
+            throw RuntimeError{"Wrong argument types"};
         }
+        res = Is<Flonum>(element) ? std::max(res, NumericElements::Doubles)
+                                  : NumericElements::Generic;
     }
-    return main_tail;
+    return res;
 }
 
+NumericElements ClassifyNumber(ObjectPtr number) {
+    if (IsFixnum(number)) {
+        return NumericElements::Fixnums;
+    }
+    return Is<Flonum>(number) ? NumericElements::Doubles : NumericElements::Generic;
+}
+
+// Checks that both arguments are vectors of the same length.
+void EnsureVectorPair(const Args& args) {
+    EnsureArgs<true, Vector>(args, 2, 2);
+    if (As<Vector>(args[0])->GetSize() != As<Vector>(args[1])->GetSize()) {
+        throw RuntimeError{"Vectors of different lengths"};
+    }
+}
+
+std::vector<double> UnboxElements(VectorPtr vector) {
+    std::vector<double> res(vector->GetSize());
+    for (size_t i = 0; i < res.size(); ++i) {
+        res[i] = ToDouble(vector->Get(i));
+    }
+    return res;
+}
+
+ObjectPtr BoxElements(const std::vector<double>& values) {
+    Local<Vector> res{Vector::Make(values.size(), nullptr)};
+    for (size_t i = 0; i < values.size(); ++i) {
+        res->Set(i, runtime::New<Flonum>(values[i]));
+    }
+    return res;
+}
+
+ObjectPtr MakeInteger(__int128 value) {
+    auto low = static_cast<int64_t>(value);
+    if (low == value) {
+        return MakeInteger(low);
+    }
+    constexpr int kShift = 62;
+    BigInteger high{static_cast<int64_t>(value >> kShift)};
+    BigInteger rest{static_cast<int64_t>(value & ((__int128{1} << kShift) - 1))};
+    return MakeInteger(high * BigInteger{int64_t{1} << kShift} + rest);
+}
+
+ObjectPtr VectorSum::Apply(const Args& args) {
+    EnsureArgs<true, Vector>(args, 1, 1);
+    VectorPtr vector = As<Vector>(args[0]);
+    NumericElements elements = ClassifyElements(vector);
+    if (elements == NumericElements::Fixnums && vector->GetSize() < kMaxSummedFixnums) {
+        return MakeInteger(kernels::SumFixnums(vector->GetData(), vector->GetSize()));
+    }
+    if (elements == NumericElements::Doubles) {
+        std::vector<double> values = UnboxElements(vector);
+        return runtime::New<Flonum>(kernels::SumDoubles(values.data(), values.size()));
+    }
+    Local<Object> res{Number::Make(0)};
+    for (size_t i = 0; i < vector->GetSize(); ++i) {
+        res = AddNumbers(res, vector->Get(i));
+    }
+    return res;
+}
+
+// Smallest or largest element, inexact if any element is.
+ObjectPtr VectorExtreme(const Args& args, bool is_max) {
+    EnsureArgs<true, Vector>(args, 1, 1);
+    VectorPtr vector = As<Vector>(args[0]);
+    if (vector->GetSize() == 0) {
+        throw RuntimeError{"Empty vector"};
+    }
+    switch (ClassifyElements(vector)) {
+        case NumericElements::Fixnums:
+            return is_max ? kernels::MaxFixnum(vector->GetData(), vector->GetSize())
+                          : kernels::MinFixnum(vector->GetData(), vector->GetSize());
+        case NumericElements::Doubles: {
+            std::vector<double> values = UnboxElements(vector);
+            return runtime::New<Flonum>(is_max ? kernels::MaxDouble(values.data(), values.size())
+                                               : kernels::MinDouble(values.data(), values.size()));
+        }
+        case NumericElements::Generic:
+            break;
+    }
+    ObjectPtr res = vector->Get(0);
+    bool inexact = false;
+    for (size_t i = 0; i < vector->GetSize(); ++i) {
+        ObjectPtr element = vector->Get(i);
+        inexact = inexact || Is<Flonum>(element);
+        if (Is<Flonum>(element) && std::isnan(As<Flonum>(element)->GetValue())) {
+            return element;
+        }
+        int order = CompareNumbers(element, res);
+        if (is_max ? order > 0 : order < 0) {
+            res = element;
+        }
+    }
+    if (inexact && !Is<Flonum>(res)) {
+        return runtime::New<Flonum>(ToDouble(res));
+    }
+    return res;
+}
+
+ObjectPtr VectorMin::Apply(const Args& args) {
+    return VectorExtreme(args, false);
+}
+
+ObjectPtr VectorMax::Apply(const Args& args) {
+    return VectorExtreme(args, true);
+}
+
+ObjectPtr VectorDot::Apply(const Args& args) {
+    EnsureVectorPair(args);
+    VectorPtr lhs = As<Vector>(args[0]);
+    VectorPtr rhs = As<Vector>(args[1]);
+    NumericElements elements = std::max(ClassifyElements(lhs), ClassifyElements(rhs));
+    if (elements == NumericElements::Doubles) {
+        std::vector<double> lhs_values = UnboxElements(lhs);
+        std::vector<double> rhs_values = UnboxElements(rhs);
+        return runtime::New<Flonum>(
+            kernels::DotDoubles(lhs_values.data(), rhs_values.data(), lhs_values.size()));
+    }
+    // AVX2 has no 64-bit multiplication, fixnums take the inline paths of the arithmetic.
+    Local<Object> res{Number::Make(0)};
+    Local<Object> product;
+    for (size_t i = 0; i < lhs->GetSize(); ++i) {
+        product = MultiplyNumbers(lhs->Get(i), rhs->Get(i));
+        res = AddNumbers(res, product);
+    }
+    return res;
+}
+
+ObjectPtr VectorAdd::Apply(const Args& args) {
+    EnsureVectorPair(args);
+    VectorPtr lhs = As<Vector>(args[0]);
+    VectorPtr rhs = As<Vector>(args[1]);
+    NumericElements elements = std::max(ClassifyElements(lhs), ClassifyElements(rhs));
+    if (elements == NumericElements::Fixnums) {
+        // The sums are fixnums, the new vector references no heap objects.
+        Args sums(lhs->GetSize());
+        if (kernels::AddFixnums(lhs->GetData(), rhs->GetData(), sums.data(), sums.size())) {
+            return Vector::Make(sums);
+        }
+    } else if (elements == NumericElements::Doubles) {
+        std::vector<double> lhs_values = UnboxElements(lhs);
+        std::vector<double> rhs_values = UnboxElements(rhs);
+        kernels::AddDoubles(lhs_values.data(), rhs_values.data(), lhs_values.data(),
+                            lhs_values.size());
+        return BoxElements(lhs_values);
+    }
+    Args sums;
+    LocalArgs root{sums};
+    for (size_t i = 0; i < lhs->GetSize(); ++i) {
+        sums.push_back(AddNumbers(lhs->Get(i), rhs->Get(i)));
+    }
+    return Vector::Make(sums);
+}
+
+ObjectPtr VectorScale::Apply(const Args& args) {
+    EnsureArgs(args, 2, 2);
+    if (!Is<Vector>(args[0]) || !Is<Number>(args[1])) {
+        throw RuntimeError{"Wrong argument types"};
+    }
+    VectorPtr vector = As<Vector>(args[0]);
+    ObjectPtr factor = args[1];
+    NumericElements elements = std::max(ClassifyElements(vector), ClassifyNumber(factor));
+    if (elements == NumericElements::Doubles) {
+        std::vector<double> values = UnboxElements(vector);
+        kernels::ScaleDoubles(values.data(), ToDouble(factor), values.data(), values.size());
+        return BoxElements(values);
+    }
+    Args products;
+    LocalArgs root{products};
+    for (size_t i = 0; i < vector->GetSize(); ++i) {
+        products.push_back(MultiplyNumbers(vector->Get(i), factor));
+    }
+    return Vector::Make(products);
+}
+
+// Whether op holds for operands which CompareNumbers orders as order.
+bool HoldsForOrder(kernels::CompareOp op, int order) {
+    switch (op) {
+        case kernels::CompareOp::Equal:
+            return order == 0;
+        case kernels::CompareOp::Less:
+            return order < 0;
+        case kernels::CompareOp::Greater:
+            return order > 0;
+        case kernels::CompareOp::LessEq:
+            return order <= 0;
+        case kernels::CompareOp::GreaterEq:
+            return order >= 0;
+    }
+    return false;
+}
+
+ObjectPtr CompareVectors(const Args& args, kernels::CompareOp op) {
+    EnsureVectorPair(args);
+    VectorPtr lhs = As<Vector>(args[0]);
+    VectorPtr rhs = As<Vector>(args[1]);
+    size_t size = lhs->GetSize();
+    std::vector<uint8_t> holds(size);
+    switch (std::max(ClassifyElements(lhs), ClassifyElements(rhs))) {
+        case NumericElements::Fixnums:
+            kernels::CompareFixnums(lhs->GetData(), rhs->GetData(), holds.data(), size, op);
+            break;
+        case NumericElements::Doubles: {
+            std::vector<double> lhs_values = UnboxElements(lhs);
+            std::vector<double> rhs_values = UnboxElements(rhs);
+            kernels::CompareDoubles(lhs_values.data(), rhs_values.data(), holds.data(), size, op);
+            break;
+        }
+        case NumericElements::Generic:
+            for (size_t i = 0; i < size; ++i) {
+                ObjectPtr lhs_element = lhs->Get(i);
+                ObjectPtr rhs_element = rhs->Get(i);
+                if (Is<Flonum>(lhs_element) || Is<Flonum>(rhs_element)) {
+                    double lhs_value = ToDouble(lhs_element);
+                    double rhs_value = ToDouble(rhs_element);
+                    holds[i] = !std::isnan(lhs_value) && !std::isnan(rhs_value) &&
+                               HoldsForOrder(op, (lhs_value > rhs_value) - (lhs_value < rhs_value));
+                } else {
+                    holds[i] = HoldsForOrder(op, CompareNumbers(lhs_element, rhs_element));
+                }
+            }
+            break;
+    }
+    // Booleans are interned symbols outside the heap.
+    Args res(size);
+    for (size_t i = 0; i < size; ++i) {
+        res[i] = Symbol::Boolean(holds[i] != 0);
+    }
+    return Vector::Make(res);
+}
+
+// End of Vector kernels
+
 // If
 
 ObjectPtr If::operator()(ObjectPtr obj) {
+    return EvalThroughTail(obj);
+}
+
+bool If::EvalTail(ObjectPtr obj, ScopeGuard&, ObjectPtr& res) {
     Args args;
     args = GetSafeArgs<false, std::false_type, false, SyntaxError>(obj, 2, 3);
-    bool value = ToBoolean(args[0]->Eval());
+    bool value = ToBoolean(EvalObject(args[0]));
     if (value) {
-        return args[1]->Eval();
+        res = args[1];
+        return true;
     } else if (args.size() > 2) {
-        return args[2]->Eval();
+        res = args[2];
+        return true;
     }
-    return nullptr;
+    res = nullptr;
+    return false;
 }
 
 // Variables
 
-ObjectPtr SymbolPredicate::operator()(ObjectPtr obj) {
-    ObjectPtr arg = GetSafeArgs(obj, 1, 1)[0];
-    return runtime::New<Symbol>(Is<Symbol>(arg));
+ObjectPtr SymbolPredicate::Apply(const Args& args) {
+    EnsureArgs(args, 1, 1);
+    ObjectPtr arg = args[0];
+    return Symbol::Boolean(Is<Symbol>(arg));
 }
 
+namespace {
+
+// Scope of a define which wasn't resolved to a slot. Defines in lambda bodies are resolved
+// to slots of their frames, frames have no names.
+GlobalScopePtr GetDefineScope(SymbolPtr name) {
+    auto global_scope = As<GlobalScope>(ScopeStack::GetCurrent().Current());
+    if (global_scope == nullptr) {
+        throw RuntimeError{"Can't define " + name->GetName() + " in a local scope"};
+    }
+    return global_scope;
+}
+
+}  // namespace
+
 ObjectPtr Define::operator()(ObjectPtr obj) {
     Args args = GetSafeArgs<false, std::false_type, false, SyntaxError>(obj, 2, kMaxArgs);
-    if (!Is<Symbol>(args[0])) {
+    if (!Is<Symbol>(args[0]) && !Is<LocalRef>(args[0])) {
         return DefineLambda(obj);
     }
     if (args.size() > 2) {
         throw SyntaxError{"Not correct args count define"};
     }
-    ScopeStack::GetInstance().Current()->Define(As<Symbol>(args[0])->GetName(),
-                                                DeepCopy(args[1]->Eval()));
+    ObjectPtr value = DeepCopy(EvalObject(args[1]));
+    if (Is<LocalRef>(args[0])) {
+        As<LocalRef>(args[0])->Assign(value);
+    } else {
+        GetDefineScope(As<Symbol>(args[0]))->Define(As<Symbol>(args[0]), value);
+    }
     return nullptr;
 }
 
 ObjectPtr Define::DefineLambda(ObjectPtr obj) {
-    if (!Is<Cell>(obj)) {
-        throw SyntaxError{"Not correct defining lambda"};
-    }
-    Args args =
-        (GetSafeArgs<true, Symbol, false, SyntaxError>(As<Cell>(obj)->GetFirst(), 1, kMaxArgs));
-    std::string name = As<Symbol>(args[0])->GetName();
-    std::vector<std::string> params;
-    for (size_t i = 1; i < args.size(); ++i) {
-        params.push_back(As<Symbol>(args[i])->GetName());
-    }
-    ObjectPtr body = As<Cell>(obj)->GetSecond();
-    if (body == nullptr) {
-        throw SyntaxError{"Lambda wrong syntax"};
-    }
-    ScopeStack::GetInstance().Current()->Define(
-        name, runtime::New<LambdaFunction>(params, body, ScopeStack::GetInstance().Current()));
+    auto [name, syntax] = ParseDefineLambda(obj);
+    GlobalScopePtr global_scope = GetDefineScope(name);
+    Local<LambdaTemplate> lambda{
+        runtime::New<LambdaTemplate>(syntax.params, syntax.body, nullptr, global_scope)};
+    global_scope->Define(name, runtime::New<LambdaFunction>(lambda, global_scope));
     return nullptr;
 }
 
+
 ObjectPtr Set::operator()(ObjectPtr obj) {
     Args args = GetSafeArgs<false, std::false_type, false, SyntaxError>(obj, 2, 2);
+    if (Is<LocalRef>(args[0])) {
+        As<LocalRef>(args[0])->Assign(DeepCopy(EvalObject(args[1])));
+        return nullptr;
+    }
     if (!Is<Symbol>(args[0])) {
         throw SyntaxError{"You cannot set not Symbol"};
     }
-    ScopeStack::GetInstance().Current()->Set(As<Symbol>(args[0])->GetName(),
-                                             DeepCopy(args[1]->Eval()));
+    ScopeStack::GetCurrent().Current()->GetGlobal()->Set(As<Symbol>(args[0]),
+                                                          DeepCopy(EvalObject(args[1])));
     return nullptr;
 }
 
-ObjectPtr SetCar::operator()(ObjectPtr obj) {
-    Args args = GetSafeArgs<false, std::false_type, false, SyntaxError>(obj, 2, 2);
-    ObjectPtr var = args[0]->Eval();
-    if (!Is<Cell>(var)) {
+ObjectPtr SetCar::Apply(const Args& args) {
+    EnsureArgs<false, std::false_type, SyntaxError>(args, 2, 2);
+    if (!Is<Cell>(args[0])) {
         throw SyntaxError{"This command only for pairs"};
     }
-    CellPtr cell = As<Cell>(var);
-    // cell->SetFirst(DeepCopy(args[1]->Eval()));
-    cell->SetFirst(args[1]->Eval());
+    As<Cell>(args[0])->SetFirst(args[1]);
     return nullptr;
 }
 
-ObjectPtr SetCdr::operator()(ObjectPtr obj) {
-    Args args = GetSafeArgs<false, std::false_type, false, SyntaxError>(obj, 2, 2);
-    ObjectPtr var = args[0]->Eval();
-    if (!Is<Cell>(var)) {
+ObjectPtr SetCdr::Apply(const Args& args) {
+    EnsureArgs<false, std::false_type, SyntaxError>(args, 2, 2);
+    if (!Is<Cell>(args[0])) {
         throw SyntaxError{"This command only for pairs"};
     }
-    // As<Cell>(var)->SetSecond(DeepCopy(args[1]->Eval()));
-    As<Cell>(var)->SetSecond(args[1]->Eval());
+    As<Cell>(args[0])->SetSecond(args[1]);
     return nullptr;
 }
\ No newline at end of file
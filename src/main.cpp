@@ -1,10 +1,171 @@
+#include <charconv>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <string>
 
 #include <error.h>
+#include <kernels.h>
+#include <parallel.h>
+#include <parser.h>
+#include <printer.h>
+#include <runtime.h>
 #include <scheme.h>
 
-int main() {
-    Interpreter interpreter;
+namespace {
+
+void PrintPoolStats(const Interpreter& interpreter) {
+    std::cerr << "slot_size slabs capacity used" << std::endl;
+    for (const PoolStats& stats : interpreter.GetPoolStats()) {
+        if (stats.slabs != 0) {
+            std::cerr << stats.slot_size << ' ' << stats.slabs << ' ' << stats.capacity << ' '
+                      << stats.used << std::endl;
+        }
+    }
+}
+
+// Reports the exception being handled.
+void PrintError() {
+    try {
+        throw;
+    } catch (const SyntaxError& syntax_error) {
+        std::cerr << "Caught SyntaxError: " << syntax_error.what() << std::endl;
+    } catch (const NameError& name_error) {
+        std::cerr << "Caught NameError: " << name_error.what() << std::endl;
+    } catch (const RuntimeError& runtime_error) {
+        std::cerr << "Caught RuntimeError: " << runtime_error.what() << std::endl;
+    } catch (...) {
+        std::cerr << "Caught unknown exception" << std::endl;
+    }
+}
+
+void PrintValue(ObjectPtr value) {
+    std::cout << "=> ";
+    Write(value, std::cout);
+    std::cout << std::endl;
+}
+
+// Evaluates the forms of a script, "-" is the standard input. Returns the exit code.
+int RunScript(Interpreter* interpreter, const std::string& path, bool print_values) {
+    std::function<void(ObjectPtr)> on_value;
+    if (print_values) {
+        on_value = PrintValue;
+    }
+    try {
+        if (path == "-") {
+            interpreter->RunStream(std::cin, on_value);
+        } else {
+            interpreter->RunFile(path, on_value);
+        }
+    } catch (...) {
+        PrintError();
+        return 1;
+    }
+    return 0;
+}
+
+// Saves the image after the script or the session. Returns the exit code.
+int SaveImage(Interpreter* interpreter, const std::string& path) {
+    try {
+        interpreter->SaveImage(path);
+    } catch (...) {
+        PrintError();
+        return 1;
+    }
+    return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    EvalMode mode = EvalMode::Bytecode;
+    bool print_pool_stats = false;
+    bool print_values = false;
+    std::string script;
+    std::string load_image;
+    std::string shared_image;
+    std::string save_image;
+    bool code_cache = false;
+    std::string code_cache_dir;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--tree-walk") {
+            mode = EvalMode::TreeWalk;
+        } else if (arg == "--bytecode") {
+            mode = EvalMode::Bytecode;
+        } else if (arg == "--pool-stats") {
+            print_pool_stats = true;
+        } else if (arg == "--no-simd") {
+            kernels::SetSimdEnabled(false);
+        } else if (arg == "--print") {
+            print_values = true;
+        } else if (arg.starts_with("--load-image=")) {
+            load_image = arg.substr(arg.find('=') + 1);
+        } else if (arg.starts_with("--shared-image=")) {
+            shared_image = arg.substr(arg.find('=') + 1);
+        } else if (arg.starts_with("--save-image=")) {
+            save_image = arg.substr(arg.find('=') + 1);
+        } else if (arg == "--cache") {
+            code_cache = true;
+        } else if (arg.starts_with("--cache-dir=")) {
+            code_cache = true;
+            code_cache_dir = arg.substr(arg.find('=') + 1);
+        } else if (arg.starts_with("--max-read-depth=")) {
+            size_t depth;
+            const char* value = arg.data() + arg.find('=') + 1;
+            auto [end, error] = std::from_chars(value, arg.data() + arg.size(), depth);
+            if (error != std::errc{} || end != arg.data() + arg.size() || depth == 0) {
+                std::cerr << "Invalid option " << arg << std::endl;
+                return 1;
+            }
+            SetMaxReadDepth(depth);
+        } else if (arg.starts_with("--workers=")) {
+            size_t count;
+            const char* value = arg.data() + arg.find('=') + 1;
+            auto [end, error] = std::from_chars(value, arg.data() + arg.size(), count);
+            if (error != std::errc{} || end != arg.data() + arg.size() || count == 0) {
+                std::cerr << "Invalid option " << arg << std::endl;
+                return 1;
+            }
+            SetWorkersCount(count);
+        } else if (script.empty() && (arg == "-" || !arg.starts_with("--"))) {
+            script = arg;
+        } else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+    std::shared_ptr<const FrozenEnvironment> environment;
+    if (!shared_image.empty()) {
+        try {
+            environment = FrozenEnvironment::LoadImage(shared_image);
+        } catch (...) {
+            PrintError();
+            return 1;
+        }
+    }
+    Interpreter interpreter{mode, environment};
+    if (code_cache) {
+        interpreter.EnableCodeCache(code_cache_dir);
+    }
+    if (!load_image.empty()) {
+        try {
+            interpreter.LoadImage(load_image);
+        } catch (...) {
+            PrintError();
+            return 1;
+        }
+    }
+    if (!script.empty()) {
+        int code = RunScript(&interpreter, script, print_values);
+        if (code == 0 && !save_image.empty()) {
+            code = SaveImage(&interpreter, save_image);
+        }
+        if (print_pool_stats) {
+            PrintPoolStats(interpreter);
+        }
+        return code;
+    }
     std::string query;
 
     while (true) {
@@ -12,20 +173,19 @@ int main() {
         std::getline(std::cin, query);
         if (std::cin.eof() || query == "q") {
             std::cerr << "Exiting" << std::endl;
+            if (!save_image.empty()) {
+                SaveImage(&interpreter, save_image);
+            }
+            if (print_pool_stats) {
+                PrintPoolStats(interpreter);
+            }
             break;
         }
 
         try {
-            auto result = interpreter.Run(query);
-            std::cout << "=> " << result << std::endl;
-        } catch (const SyntaxError& syntax_error) {
-            std::cerr << "Caught SyntaxError: " << syntax_error.what() << std::endl;
-        } catch (const NameError& name_error) {
-            std::cerr << "Caught NameError: " << name_error.what() << std::endl;
-        } catch (const RuntimeError& runtime_error) {
-            std::cerr << "Caught RuntimeError: " << runtime_error.what() << std::endl;
+            interpreter.Run(query, PrintValue);
         } catch (...) {
-            std::cerr << "Caught unknown exception" << std::endl;
+            PrintError();
         }
     }
 }
@@ -0,0 +1,85 @@
+#include "number.h"
+#include <charconv>
+#include <cmath>
+#include "error.h"
+#include "runtime.h"
+
+// Flonum
+
+Flonum::Flonum(double value) : Object(ObjectType::Flonum), value_(value) {
+}
+
+std::string Flonum::ToString() {
+    if (std::isnan(value_)) {
+        return "+nan.0";
+    }
+    if (std::isinf(value_)) {
+        return value_ > 0 ? "+inf.0" : "-inf.0";
+    }
+    // Shortest representation which reads back as the same double.
+    char buffer[32];
+    auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), value_);
+    std::string res{buffer, end};
+    if (res.find_first_of(".e") == std::string::npos) {
+        res += ".0";
+    }
+    return res;
+}
+
+double ToDouble(ObjectPtr number) {
+    if (IsFixnum(number)) {
+        return static_cast<double>(Number::GetValue(number));
+    }
+    if (Is<Flonum>(number)) {
+        return As<Flonum>(number)->GetValue();
+    }
+    return As<Bignum>(number)->GetValue().ToDouble();
+}
+
+// End of Flonum
+
+// Arithmetic on numbers
+
+ObjectPtr AddNumbersSlow(ObjectPtr lhs, ObjectPtr rhs) {
+    if (Is<Flonum>(lhs) || Is<Flonum>(rhs)) {
+        return runtime::New<Flonum>(ToDouble(lhs) + ToDouble(rhs));
+    }
+    return MakeInteger(ToBigInteger(lhs) + ToBigInteger(rhs));
+}
+
+ObjectPtr SubtractNumbersSlow(ObjectPtr lhs, ObjectPtr rhs) {
+    if (Is<Flonum>(lhs) || Is<Flonum>(rhs)) {
+        return runtime::New<Flonum>(ToDouble(lhs) - ToDouble(rhs));
+    }
+    return MakeInteger(ToBigInteger(lhs) - ToBigInteger(rhs));
+}
+
+ObjectPtr MultiplyNumbersSlow(ObjectPtr lhs, ObjectPtr rhs) {
+    if (Is<Flonum>(lhs) || Is<Flonum>(rhs)) {
+        return runtime::New<Flonum>(ToDouble(lhs) * ToDouble(rhs));
+    }
+    return MakeInteger(ToBigInteger(lhs) * ToBigInteger(rhs));
+}
+
+ObjectPtr DivideNumbersSlow(ObjectPtr lhs, ObjectPtr rhs) {
+    if (Is<Flonum>(lhs) || Is<Flonum>(rhs)) {
+        return runtime::New<Flonum>(ToDouble(lhs) / ToDouble(rhs));
+    }
+    BigInteger divisor = ToBigInteger(rhs);
+    if (divisor.IsZero()) {
+        throw RuntimeError{"Division by zero"};
+    }
+    return MakeInteger(ToBigInteger(lhs) / divisor);
+}
+
+int CompareNumbersSlow(ObjectPtr lhs, ObjectPtr rhs) {
+    if (Is<Flonum>(lhs) || Is<Flonum>(rhs)) {
+        double lhs_value = ToDouble(lhs);
+        double rhs_value = ToDouble(rhs);
+        return (lhs_value > rhs_value) - (lhs_value < rhs_value);
+    }
+    auto res = ToBigInteger(lhs) <=> ToBigInteger(rhs);
+    return (res > 0) - (res < 0);
+}
+
+// End of Arithmetic on numbers
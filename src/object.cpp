@@ -1,82 +1,101 @@
 #include "object.h"
+#include <algorithm>
 #include <cstddef>
+#include <limits>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include "error.h"
+#include "printer.h"
 #include "scope.h"
 #include "runtime.h"
 
-// Object
+// Immediates
 
-void Object::RemoveDependency(ObjectPtr ptr) {
-    dependencies.erase(ptr);
-}
-
-void Object::AddDependency(ObjectPtr ptr) {
-    dependencies.insert(ptr);
-}
-
-void Object::Mark() {
-    marked = true;
-    for (ObjectPtr neighbour : dependencies) {
-        if (neighbour == nullptr || neighbour->marked) {
-            continue;
-        }
-        neighbour->Mark();
+ObjectPtr EvalObject(ObjectPtr obj) {
+    if (!IsHeapObject(obj)) {
+        return obj;
     }
+    return obj->Eval();
 }
 
-// End of Object
+std::string ObjectToString(ObjectPtr obj) {
+    std::ostringstream out;
+    Write(obj, out);
+    return out.str();
+}
 
-// Number
+// End of Immediates
 
-Number::Number(int value) : value_(value) {
-}
+// Symbol
 
-int Number::GetValue() const {
-    return value_;
+Symbol::Symbol(std::string_view name) : Object(ObjectType::Symbol), name_(name) {
 }
 
-std::string Number::ToString() {
-    return std::to_string(value_);
+SymbolPtr Symbol::Intern(std::string_view name) {
+    return SymbolTable::GetInstance().Intern(name);
 }
 
-ObjectPtr Number::Eval() {
-    return this;
+SymbolPtr Symbol::Boolean(bool value) {
+    auto& table = SymbolTable::GetInstance();
+    return value ? table.GetTrue() : table.GetFalse();
 }
 
-// End of Number
-
-// Symbol
-
-Symbol::Symbol(const std::string& name) : name_(name) {
+const std::string& Symbol::GetName() const {
+    return name_;
 }
 
-Symbol::Symbol(const char* name) : name_(name) {
+ObjectPtr Symbol::Eval() {
+    return ScopeStack::GetCurrent().Current()->GetGlobal()->Get(this);
 }
 
-Symbol::Symbol(bool value) {
-    name_ = value ? kTrueSymbol : kFalseSymbol;
+SymbolTable::SymbolTable() {
+    true_ = Intern(kTrueSymbol);
+    false_ = Intern(kFalseSymbol);
+    for (const char* name : {"quote", "if", "define", "set!", "lambda", "and", "or"}) {
+        Intern(name);
+    }
 }
 
-const std::string& Symbol::GetName() const {
-    return name_;
+SymbolTable::~SymbolTable() {
+    for (auto& [name, symbol] : symbols_) {
+        delete symbol;
+    }
 }
 
-ObjectPtr Symbol::Eval() {
-    return ScopeStack::GetInstance().Current()->Get(GetName());
+SymbolPtr SymbolTable::Intern(std::string_view name) {
+    // Symbols are shared by the interpreters of all threads. Each thread looks them up in
+    // its own cache first, so reading doesn't contend on the lock.
+    thread_local std::unordered_map<std::string_view, SymbolPtr> cache;
+    if (auto it = cache.find(name); it != cache.end()) {
+        return it->second;
+    }
+    std::lock_guard lock{mutex_};
+    auto it = symbols_.find(name);
+    if (it == symbols_.end()) {
+        SymbolPtr symbol = new Symbol(name);
+        it = symbols_.emplace(symbol->GetName(), symbol).first;
+    }
+    cache.emplace(it->first, it->second);
+    return it->second;
 }
 
 // End of Symbol
 
 // Cell
 
-Cell::Cell(ObjectPtr first, ObjectPtr second) : first_(first), second_(second) {
-    AddDependency(first_);
-    AddDependency(second_);
+Cell::Cell() : Object(ObjectType::Cell), first_(nullptr), second_(nullptr) {
+}
+
+Cell::Cell(ObjectPtr first, ObjectPtr second)
+    : Object(ObjectType::Cell), first_(first), second_(second) {
 }
 
-Cell::Cell(ObjectPtr first, std::nullptr_t) : first_(first), second_(nullptr) {
-    AddDependency(first);
+Cell::Cell(ObjectPtr first, std::nullptr_t)
+    : Object(ObjectType::Cell), first_(first), second_(nullptr) {
 }
 
 ObjectPtr Cell::GetFirst() const {
@@ -88,106 +107,188 @@ ObjectPtr Cell::GetSecond() const {
 }
 
 void Cell::SetFirst(const ObjectPtr& obj) {
-    if (first_ != nullptr) {
-        RemoveDependency(first_);
-    }
+    GC::GetCurrent().WriteBarrier(this, first_, obj);
     first_ = obj;
-    AddDependency(first_);
 }
 
 void Cell::SetSecond(const ObjectPtr& obj) {
-    if (second_ != nullptr) {
-        RemoveDependency(second_);
-    }
+    GC::GetCurrent().WriteBarrier(this, second_, obj);
     second_ = obj;
-    AddDependency(second_);
 }
 
 ObjectPtr Cell::Eval() {
-    if (GetFirst() == nullptr) {
-        throw RuntimeError{"Nothing to calculate"};
-    }
-    ObjectPtr func = GetFirst()->Eval();
-    if (!Is<Function>(func)) {
-        throw RuntimeError{"Cell is not evaluating"};
-    }
-    return (*As<Function>(func))(GetSecond());
-}
-
-std::string Cell::ToString() {
-    std::string res = "(";
-    ObjectPtr cur_obj = this;
-    while (cur_obj != nullptr) {
-        if (!Is<Cell>(cur_obj)) {
-            res += ". ";
-            res += cur_obj->ToString();
-            break;
+    // Calls in tail position are continued by this loop instead of recursing.
+    Local<Object> expr{this};
+    Local<Object> func;
+    ScopeGuard frame;
+    while (true) {
+        CellPtr cell = As<Cell>(expr);
+        if (cell->GetFirst() == nullptr) {
+            throw RuntimeError{"Nothing to calculate"};
         }
-        CellPtr list = As<Cell>(cur_obj);
-        if (list->GetFirst() == nullptr) {
-            res += "()";
-        } else {
-            res += list->GetFirst()->ToString();
+        func = EvalObject(cell->GetFirst());
+        if (!Is<Function>(func)) {
+            throw RuntimeError{"Cell is not evaluating"};
         }
-        if (list->GetSecond() != nullptr) {
-            res.push_back(' ');
+        ObjectPtr res;
+        if (!As<Function>(func)->EvalTail(cell->GetSecond(), frame, res)) {
+            return res;
         }
-        cur_obj = list->GetSecond();
+        if (!Is<Cell>(res)) {
+            return EvalObject(res);
+        }
+        expr = res;
     }
-    return res + ")";
+}
+
+std::string Cell::ToString() {
+    return ObjectToString(this);
 }
 
 // End of Cell
 
+// Vector
+
+Vector::Vector(size_t size, ObjectPtr fill) : Object(ObjectType::Vector), size_(size) {
+    std::fill_n(GetElements(), size_, fill);
+}
+
+Vector::Vector(const Args& elements) : Object(ObjectType::Vector), size_(elements.size()) {
+    std::copy(elements.begin(), elements.end(), GetElements());
+}
+
+Vector::Vector(Vector&& other) : Object(std::move(other)), size_(other.size_) {
+    std::copy_n(other.GetElements(), size_, GetElements());
+}
+
+VectorPtr Vector::Make(size_t size, ObjectPtr fill, bool tenured) {
+    if (size > (std::numeric_limits<size_t>::max() - sizeof(Vector)) / sizeof(ObjectPtr)) {
+        throw RuntimeError{"Vector is too large"};
+    }
+    size_t block_size = sizeof(Vector) + size * sizeof(ObjectPtr);
+    if (tenured) {
+        return GC::GetCurrent().NewTenuredSized<Vector>(block_size, size, fill);
+    }
+    return GC::GetCurrent().NewSized<Vector>(block_size, size, fill);
+}
+
+VectorPtr Vector::Make(const Args& elements) {
+    size_t block_size = sizeof(Vector) + elements.size() * sizeof(ObjectPtr);
+    return GC::GetCurrent().NewSized<Vector>(block_size, elements);
+}
+
+void Vector::Set(size_t index, ObjectPtr obj) {
+    GC::GetCurrent().WriteBarrier(this, GetElements()[index], obj);
+    GetElements()[index] = obj;
+}
+
+std::string Vector::ToString() {
+    return ObjectToString(this);
+}
+
+// End of Vector
+
 // Function
 
 ObjectPtr Function::Eval() {
     return this;
 }
 
+bool Function::EvalTail(ObjectPtr args, ScopeGuard&, ObjectPtr& res) {
+    res = (*this)(args);
+    return false;
+}
+
+ObjectPtr Function::EvalThroughTail(ObjectPtr args) {
+    ScopeGuard frame;
+    ObjectPtr res;
+    if (!EvalTail(args, frame, res)) {
+        return res;
+    }
+    return EvalObject(res);
+}
+
+ObjectPtr Procedure::operator()(ObjectPtr obj) {
+    Args args = GetArgsVector(obj);
+    LocalArgs root{args};
+    return Apply(args);
+}
+
 // End of Function
 
 bool ToBoolean(ObjectPtr obj) {
-    if (Is<Symbol>(obj)) {
-        return As<Symbol>(obj)->GetName() != kFalseSymbol;
-    }
-    return true;
+    return obj != Symbol::Boolean(false);
 }
 
 void Visitor::VisitCell(ObjectPtr obj) const {
-    while (obj != nullptr) {
-        if (Is<Cell>(obj)) {
-            first_call_(As<Cell>(obj)->GetFirst());
-            obj = As<Cell>(obj)->GetSecond();
-        } else {
-            second_call_(As<Object>(obj));
-            obj = nullptr;
-        }
+    while (Is<Cell>(obj)) {
+        CellPtr cell = As<Cell>(obj);
+        first_call_(cell->GetFirst());
+        obj = cell->GetSecond();
+    }
+    if (obj != nullptr) {
+        second_call_(obj);
     }
 }
 
-ObjectPtr DeepCopy(ObjectPtr obj) {
-    if (obj == nullptr) {
-        return nullptr;
-    }
+namespace {
 
-    if (Is<Number>(obj)) {
-        return runtime::New<Number>(As<Number>(obj)->GetValue());
+// Deep copy of anything but a pair.
+ObjectPtr CopyAtom(ObjectPtr obj) {
+    if (!IsHeapObject(obj)) {
+        return obj;
     }
-
-    if (Is<Symbol>(obj)) {
-        return runtime::New<Symbol>(As<Symbol>(obj)->GetName());
+    switch (obj->GetType()) {
+        case ObjectType::Symbol:
+        case ObjectType::Bignum:
+        case ObjectType::Flonum:
+        // Vectors are shared: copying would make vector-set! invisible through other names.
+        case ObjectType::Vector:
+        case ObjectType::Future:
+            return obj;
+        default:
+            if (Is<Function>(obj)) {
+                return obj;
+            }
+            throw RuntimeError{"Unsupported object type for deep copy"};
     }
+}
 
-    if (Is<Cell>(obj)) {
-        ObjectPtr first_copy = DeepCopy(As<Cell>(obj)->GetFirst());
-        ObjectPtr second_copy = DeepCopy(As<Cell>(obj)->GetSecond());
-        return runtime::New<Cell>(first_copy, second_copy);
-    }
+}  // namespace
 
-    if (Is<Function>(obj)) {
-        return obj;
+ObjectPtr DeepCopy(ObjectPtr obj) {
+    if (!Is<Cell>(obj)) {
+        return CopyAtom(obj);
     }
-
-    throw RuntimeError{"Unsupported object type for deep copy"};
-}
\ No newline at end of file
+    // Pairs whose copies have no elements yet, so neither long lists nor deeply nested
+    // first elements use the native stack. Sources are reachable from obj and copies
+    // from res. Every pair is copied once, so cycles and shared pairs are copied as such.
+    Local<Object> source{obj};
+    Local<Cell> res{runtime::New<Cell>()};
+    std::vector<std::pair<CellPtr, CellPtr>> pending{{As<Cell>(obj), res}};
+    std::unordered_map<CellPtr, CellPtr> copies{{As<Cell>(obj), res}};
+    while (!pending.empty()) {
+        auto [from, to] = pending.back();
+        pending.pop_back();
+        for (bool first : {true, false}) {
+            ObjectPtr element = first ? from->GetFirst() : from->GetSecond();
+            ObjectPtr copy;
+            if (Is<Cell>(element)) {
+                auto [it, inserted] = copies.try_emplace(As<Cell>(element), nullptr);
+                if (inserted) {
+                    it->second = runtime::New<Cell>();
+                    pending.emplace_back(As<Cell>(element), it->second);
+                }
+                copy = it->second;
+            } else {
+                copy = CopyAtom(element);
+            }
+            if (first) {
+                to->SetFirst(copy);
+            } else {
+                to->SetSecond(copy);
+            }
+        }
+    }
+    return res;
+}
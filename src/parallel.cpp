@@ -0,0 +1,516 @@
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "bytecode.h"
+#include "error.h"
+#include "image.h"
+#include "lambda.h"
+#include "runtime.h"
+#include "scheme.h"
+#include "scope.h"
+
+struct Task {
+    // Environment of the caller, the worker runs the task in an interpreter created with it.
+    std::shared_ptr<const FrozenEnvironment> environment;
+    // Image of the global bindings, shared by the tasks of one parallel map.
+    std::shared_ptr<const ObjectsImage> bindings;
+    // Image of a list of calls, each a list of a procedure and its arguments.
+    ObjectsImage input;
+    bool keep_results = true;
+    // Image of the list of the values of the calls.
+    ObjectsImage output;
+    std::optional<ErrorKind> error_kind;
+    std::string error;
+
+    // Stores the exception being handled.
+    void Fail() {
+        try {
+            throw;
+        } catch (const SyntaxError& syntax_error) {
+            error_kind = ErrorKind::Syntax;
+            error = syntax_error.what();
+        } catch (const NameError& name_error) {
+            error_kind = ErrorKind::Name;
+            error = name_error.what();
+        } catch (const std::exception& exception) {
+            error_kind = ErrorKind::Runtime;
+            error = exception.what();
+        } catch (...) {
+            error_kind = ErrorKind::Runtime;
+            error = "Unknown error in a task";
+        }
+    }
+    void Finish() {
+        std::lock_guard lock{mutex_};
+        done_ = true;
+        done_changed_.notify_all();
+    }
+    void Wait() {
+        std::unique_lock lock{mutex_};
+        done_changed_.wait(lock, [this] { return done_; });
+    }
+    bool IsDone() {
+        std::lock_guard lock{mutex_};
+        return done_;
+    }
+    // Raises the error of a finished task.
+    void CheckError() const {
+        if (error_kind) {
+            Raise(*error_kind, error);
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable done_changed_;
+    bool done_ = false;
+};
+
+namespace {
+
+std::atomic<size_t> workers_count = 0;
+
+GlobalScopePtr GetGlobalScope() {
+    return ScopeStack::GetCurrent().GetGlobal();
+}
+
+// Value of a task which succeeded, copied into the current heap.
+ObjectPtr ReadValue(const Task& task) {
+    ObjectsReader reader{GetGlobalScope(), task.output};
+    return As<Cell>(reader.Read())->GetFirst();
+}
+
+ObjectPtr MakeList(const Args& elements) {
+    Local<Object> res;
+    for (size_t i = elements.size(); i > 0; --i) {
+        res = runtime::New<Cell>(elements[i - 1], res);
+    }
+    return res;
+}
+
+// Applies every call of the list, returns the list of their values if keep_results is
+// set and nil otherwise.
+ObjectPtr ApplyEach(ObjectPtr calls, bool keep_results) {
+    Local<Object> rest{calls};
+    Args results;
+    LocalArgs results_root{results};
+    for (; rest != nullptr; rest = As<Cell>(rest)->GetSecond()) {
+        Args call = GetArgsVector<false>(As<Cell>(rest)->GetFirst());
+        LocalArgs call_root{call};
+        ProcedurePtr procedure = As<Procedure>(call[0]);
+        call.erase(call.begin());
+        ObjectPtr value = procedure->Apply(call);
+        if (keep_results) {
+            results.push_back(value);
+        }
+    }
+    return MakeList(results);
+}
+
+// Bindings of the global scope for tasks created now which run roots: only the ones their
+// code may use are copied. Frozen bindings are not copied, tasks share the environment of
+// the caller.
+std::shared_ptr<const ObjectsImage> SnapshotBindings(GlobalScopePtr global_scope,
+                                                     const Args& roots) {
+    ObjectsWriter writer{global_scope};
+    writer.AddBindings(roots);
+    return std::make_shared<const ObjectsImage>(writer.Finish());
+}
+
+// Task running calls with the current global bindings.
+std::shared_ptr<Task> MakeTask(std::shared_ptr<const ObjectsImage> bindings, ObjectsImage input,
+                               bool keep_results) {
+    auto task = std::make_shared<Task>();
+    task->environment = Interpreter::GetCurrent().GetEnvironment();
+    task->bindings = std::move(bindings);
+    task->input = std::move(input);
+    task->keep_results = keep_results;
+    return task;
+}
+
+ObjectsImage WriteCalls(GlobalScopePtr global_scope, ObjectPtr calls) {
+    ObjectsWriter writer{global_scope};
+    writer.Add(calls);
+    return writer.Finish();
+}
+
+// Worker threads taking tasks from queues of their own, or stealing them from the queues
+// of others when theirs are empty. Tasks are spread over the queues in turn.
+class WorkerPool {
+public:
+    static WorkerPool& GetInstance() {
+        static WorkerPool pool{GetWorkersCount()};
+        return pool;
+    }
+    static bool IsWorker() {
+        return is_worker_;
+    }
+
+    explicit WorkerPool(size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            queues_.push_back(std::make_unique<Queue>());
+        }
+        for (size_t i = 0; i < count; ++i) {
+            threads_.emplace_back([this, i] { Work(i); });
+        }
+    }
+    ~WorkerPool() {
+        {
+            std::lock_guard lock{sleep_mutex_};
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread& thread : threads_) {
+            thread.join();
+        }
+    }
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    void Submit(std::shared_ptr<Task> task) {
+        Queue& queue = *queues_[next_queue_++ % queues_.size()];
+        {
+            std::lock_guard lock{queue.mutex};
+            queue.tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard lock{sleep_mutex_};
+            ++queued_;
+        }
+        wake_.notify_one();
+    }
+
+    // Runs the task on the calling worker if no worker has taken it yet.
+    void RunIfQueued(const std::shared_ptr<Task>& task) {
+        if (TryTake(task)) {
+            Run(task.get());
+        }
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::shared_ptr<Task>> tasks;
+    };
+
+    void Work(size_t index) {
+        is_worker_ = true;
+        while (true) {
+            {
+                std::unique_lock lock{sleep_mutex_};
+                wake_.wait(lock, [this] { return queued_ > 0 || stopping_; });
+                if (stopping_) {
+                    return;
+                }
+                --queued_;
+            }
+            Run(Take(index).get());
+        }
+    }
+
+    // Takes a task reserved by decrementing queued_: the newest one of the own queue,
+    // otherwise the oldest one of another queue.
+    std::shared_ptr<Task> Take(size_t index) {
+        while (true) {
+            for (size_t i = 0; i < queues_.size(); ++i) {
+                Queue& queue = *queues_[(index + i) % queues_.size()];
+                std::lock_guard lock{queue.mutex};
+                if (queue.tasks.empty()) {
+                    continue;
+                }
+                std::shared_ptr<Task> task;
+                if (i == 0) {
+                    task = std::move(queue.tasks.back());
+                    queue.tasks.pop_back();
+                } else {
+                    task = std::move(queue.tasks.front());
+                    queue.tasks.pop_front();
+                }
+                return task;
+            }
+        }
+    }
+
+    // Removes the task from its queue unless every queued task may be reserved by a worker
+    // which is about to take one.
+    bool TryTake(const std::shared_ptr<Task>& task) {
+        std::lock_guard sleep_lock{sleep_mutex_};
+        if (queued_ == 0) {
+            return false;
+        }
+        for (auto& queue : queues_) {
+            std::lock_guard lock{queue->mutex};
+            auto it = std::find(queue->tasks.begin(), queue->tasks.end(), task);
+            if (it != queue->tasks.end()) {
+                queue->tasks.erase(it);
+                --queued_;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Every task runs in an interpreter of its own, so it starts from the bindings of its
+    // caller whatever the tasks run before it on the worker have defined or set.
+    static void Run(Task* task) {
+        try {
+            Interpreter interpreter{EvalMode::Bytecode, task->environment};
+            interpreter.Enter([&](GlobalScopePtr global_scope) {
+                ObjectsReader{global_scope, *task->bindings}.ReadBindings();
+                ObjectsReader reader{global_scope, task->input};
+                Local<Object> results{ApplyEach(reader.Read(), task->keep_results)};
+                if (task->keep_results) {
+                    ObjectsWriter writer{global_scope};
+                    writer.Add(results);
+                    task->output = writer.Finish();
+                }
+            });
+        } catch (...) {
+            task->Fail();
+        }
+        task->Finish();
+    }
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> next_queue_ = 0;
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    size_t queued_ = 0;
+    bool stopping_ = false;
+
+    inline static thread_local bool is_worker_ = false;
+};
+
+// Each worker gets a few chunks, so the ones done early can steal from the others.
+constexpr size_t kChunksPerWorker = 4;
+
+ObjectPtr MapInParallel(const Args& args, bool keep_results) {
+    EnsureArgs(args, 2, kMaxArgs);
+    if (!Is<Procedure>(args[0])) {
+        throw RuntimeError{"Wrong types for parallel-map"};
+    }
+    // Arguments of the calls, the elements of list k from starts[k]. They are rooted here:
+    // the caller roots the lists, but a call may change them.
+    Args elements;
+    LocalArgs elements_root{elements};
+    std::vector<size_t> starts;
+    size_t count = std::numeric_limits<size_t>::max();
+    for (size_t i = 1; i < args.size(); ++i) {
+        starts.push_back(elements.size());
+        ObjectPtr list = args[i];
+        while (Is<Cell>(list)) {
+            elements.push_back(As<Cell>(list)->GetFirst());
+            list = As<Cell>(list)->GetSecond();
+        }
+        if (list != nullptr) {
+            throw RuntimeError{"Wrong types for parallel-map"};
+        }
+        count = std::min(count, elements.size() - starts.back());
+    }
+    if (count == 0) {
+        return nullptr;
+    }
+
+    size_t workers = GetWorkersCount();
+    if (WorkerPool::IsWorker() || workers < 2) {
+        Args results;
+        LocalArgs results_root{results};
+        for (size_t i = 0; i < count; ++i) {
+            Args call;
+            for (size_t start : starts) {
+                call.push_back(elements[start + i]);
+            }
+            ObjectPtr value = As<Procedure>(args[0])->Apply(call);
+            if (keep_results) {
+                results.push_back(value);
+            }
+        }
+        return MakeList(results);
+    }
+
+    GlobalScopePtr global_scope = GetGlobalScope();
+    std::shared_ptr<const ObjectsImage> bindings = SnapshotBindings(global_scope, args);
+    size_t chunks_count = workers * kChunksPerWorker;
+    size_t chunk_size = std::max<size_t>(1, (count + chunks_count - 1) / chunks_count);
+    std::vector<std::shared_ptr<Task>> tasks;
+    for (size_t begin = 0; begin < count; begin += chunk_size) {
+        Local<Object> calls;
+        Local<Object> call;
+        for (size_t i = std::min(count, begin + chunk_size); i > begin; --i) {
+            call = nullptr;
+            for (size_t j = starts.size(); j > 0; --j) {
+                call = runtime::New<Cell>(elements[starts[j - 1] + i - 1], call);
+            }
+            call = runtime::New<Cell>(args[0], call);
+            calls = runtime::New<Cell>(call, calls);
+        }
+        auto task = MakeTask(bindings, WriteCalls(global_scope, calls), keep_results);
+        WorkerPool::GetInstance().Submit(task);
+        tasks.push_back(std::move(task));
+    }
+
+    Args results;
+    LocalArgs results_root{results};
+    for (const auto& task : tasks) {
+        task->Wait();
+        task->CheckError();
+        if (keep_results) {
+            ObjectsReader reader{global_scope, task->output};
+            for (ObjectPtr list = reader.Read(); list != nullptr;
+                 list = As<Cell>(list)->GetSecond()) {
+                results.push_back(As<Cell>(list)->GetFirst());
+            }
+        }
+    }
+    return MakeList(results);
+}
+
+}  // namespace
+
+void SetWorkersCount(size_t count) {
+    workers_count = count;
+}
+
+size_t GetWorkersCount() {
+    size_t count = workers_count;
+    if (count == 0) {
+        count = std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+    return count;
+}
+
+// Future
+
+Future::Future(std::shared_ptr<Task> task) : Object(ObjectType::Future), task_(std::move(task)) {
+}
+
+Future::Future(ObjectPtr value) : Object(ObjectType::Future), value_(value) {
+}
+
+Future::Future(ErrorKind kind, std::string error)
+    : Object(ObjectType::Future), task_(std::make_shared<Task>()) {
+    task_->error_kind = kind;
+    task_->error = std::move(error);
+    task_->Finish();
+}
+
+bool Future::IsReady() const {
+    return !task_ || task_->IsDone();
+}
+
+bool Future::HasValue() const {
+    return IsReady() && (!task_ || !task_->error_kind);
+}
+
+void Future::Wait() {
+    if (!task_) {
+        return;
+    }
+    if (WorkerPool::IsWorker()) {
+        // Waiting for a task which no worker has taken could block every worker.
+        WorkerPool::GetInstance().RunIfQueued(task_);
+    }
+    task_->Wait();
+    // Frozen futures can't refer to the current heap, they copy the value on every touch.
+    if (!task_->error_kind && !IsFrozen()) {
+        ObjectPtr value = ReadValue(*task_);
+        GC::GetCurrent().WriteBarrier(this, value_, value);
+        value_ = value;
+        task_.reset();
+    }
+}
+
+ObjectPtr Future::GetValue() {
+    return task_ ? ReadValue(*task_) : value_;
+}
+
+ObjectPtr Future::Touch() {
+    Wait();
+    if (task_) {
+        task_->CheckError();
+    }
+    return GetValue();
+}
+
+ErrorKind Future::GetErrorKind() const {
+    return *task_->error_kind;
+}
+
+const std::string& Future::GetError() const {
+    return task_->error;
+}
+
+ObjectPtr MakeFuture(ObjectPtr thunk) {
+    if (!Is<Procedure>(thunk)) {
+        throw RuntimeError{"Wrong types for future"};
+    }
+    if (WorkerPool::IsWorker()) {
+        // Waiting for another task could block every worker.
+        Local<Object> value;
+        try {
+            value = As<Procedure>(thunk)->Apply({});
+        } catch (...) {
+            auto task = std::make_shared<Task>();
+            task->Fail();
+            task->Finish();
+            return runtime::New<Future>(std::move(task));
+        }
+        return runtime::New<Future>(static_cast<ObjectPtr>(value));
+    }
+    Local<Object> thunk_root{thunk};
+    Local<Object> calls{runtime::New<Cell>(thunk, nullptr)};
+    calls = runtime::New<Cell>(calls, nullptr);
+    GlobalScopePtr global_scope = GetGlobalScope();
+    auto task =
+        MakeTask(SnapshotBindings(global_scope, {thunk}), WriteCalls(global_scope, calls), true);
+    WorkerPool::GetInstance().Submit(task);
+    return runtime::New<Future>(std::move(task));
+}
+
+ObjectPtr FutureForm::operator()(ObjectPtr args) {
+    if (!Is<Cell>(args)) {
+        throw SyntaxError{"Future wrong syntax"};
+    }
+    CellPtr first = As<Cell>(args);
+    Local<Object> thunk;
+    if (first->GetSecond() == nullptr && Is<Cell>(first->GetFirst()) &&
+        Is<LambdaTemplate>(As<Cell>(first->GetFirst())->GetFirst())) {
+        // Resolved by the resolver into (future (template)).
+        thunk = EvalObject(first->GetFirst());
+    } else {
+        ScopePtr current_scope = ScopeStack::GetCurrent().Current();
+        Local<LambdaTemplate> lambda{runtime::New<LambdaTemplate>(
+            std::vector<SymbolPtr>{}, args, nullptr, current_scope->GetGlobal())};
+        thunk = runtime::New<LambdaFunction>(lambda, current_scope);
+    }
+    return MakeFuture(thunk);
+}
+
+// End of Future
+
+ObjectPtr Touch::Apply(const Args& args) {
+    EnsureArgs(args, 1, 1);
+    if (Is<Future>(args[0])) {
+        return As<Future>(args[0])->Touch();
+    }
+    return args[0];
+}
+
+ObjectPtr ParallelMap::Apply(const Args& args) {
+    return MapInParallel(args, true);
+}
+
+ObjectPtr ParallelForEach::Apply(const Args& args) {
+    MapInParallel(args, false);
+    return nullptr;
+}
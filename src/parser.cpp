@@ -1,81 +1,136 @@
 #include <parser.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "bignum.h"
+#include "number.h"
 #include "error.h"
 #include "object.h"
 #include "tokenizer.h"
 #include "runtime.h"
 
-ObjectPtr Read(Tokenizer* tokenizer) {
-    if (tokenizer->IsEnd()) {
-        throw SyntaxError{"Empty object"};
-    }
-    Token token = tokenizer->GetToken();
-    tokenizer->Next();
-    if (BracketToken* bracket = std::get_if<BracketToken>(&token)) {
-        if (*bracket == BracketToken::OPEN) {
-            return ReadList(tokenizer);
+namespace {
+
+size_t max_read_depth = kDefaultMaxReadDepth;
+
+// Open list, vector or quote waiting for its contents.
+struct Frame {
+    enum Kind { List, Vector, Quote } kind;
+    // Index of the first element in the shared element stack.
+    size_t first;
+    // For lists: the elements are followed by '.' and then by the tail.
+    enum Tail { None, Expected, Read } tail = None;
+};
+
+ObjectPtr ReadAtom(const Token& token) {
+    if (const ConstantToken* number = std::get_if<ConstantToken>(&token)) {
+        if (!number->big_value.empty()) {
+            return MakeInteger(BigInteger::Parse(number->big_value));
         }
-        throw SyntaxError{"Close bracket before open"};
-    } else if (ConstantToken* number = std::get_if<ConstantToken>(&token)) {
-        return runtime::New<Number>(number->value);
-    } else if (DotToken* dot = std::get_if<DotToken>(&token)) {
-        throw SyntaxError{"Dot without cell"};
-    } else if (std::get_if<QuoteToken>(&token)) {
-        CellPtr res = runtime::New<Cell>(runtime::New<Symbol>("quote"), nullptr);
-        ObjectPtr obj = Read(tokenizer);
-        res->SetSecond(runtime::New<Cell>(obj, nullptr));
-        return res;
-    } else if (SymbolToken* symbol = std::get_if<SymbolToken>(&token)) {
-        return runtime::New<Symbol>(symbol->name);
+        return MakeInteger(number->value);
+    }
+    if (const FlonumToken* number = std::get_if<FlonumToken>(&token)) {
+        return runtime::New<Flonum>(number->value);
     }
-    throw SyntaxError{"Undefined token"};
+    return Symbol::Intern(std::get<SymbolToken>(token).name);
 }
 
-CellPtr ReadList(Tokenizer* tokenizer) {
-    Token token = tokenizer->GetToken();
-    if (IsEndOfCell(token)) {
-        tokenizer->Next();
-        return nullptr;
-    }
-    CellPtr main_list = runtime::New<Cell>();
-    CellPtr cur_list = main_list;
-    bool should_end = false;
-    bool is_first_token = true;
-    while (!tokenizer->IsEnd()) {
-        if (IsEndOfCell(token)) {
-            tokenizer->Next();
-            if (!should_end) {
-                cur_list->SetSecond(nullptr);
+// Whether the frame on top needs a datum before anything else.
+bool ExpectsDatum(const std::vector<Frame>& frames) {
+    return frames.empty() || frames.back().kind == Frame::Quote ||
+           frames.back().tail == Frame::Expected;
+}
+
+}  // namespace
+
+void SetMaxReadDepth(size_t depth) {
+    max_read_depth = depth;
+}
+
+size_t GetMaxReadDepth() {
+    return max_read_depth;
+}
+
+ObjectPtr Read(Tokenizer* tokenizer) {
+    // Elements of all open lists and vectors, each frame owns a suffix. Lists are consed
+    // tail first from their elements when they are closed.
+    Args elements;
+    LocalArgs root{elements};
+    std::vector<Frame> frames;
+    Local<Object> datum;
+    while (true) {
+        if (tokenizer->IsEnd()) {
+            if (ExpectsDatum(frames)) {
+                throw SyntaxError{"Empty object"};
             }
-            return main_list;
+            NotFoundCloseBracket();
         }
-        if (should_end) {
+        Token token = tokenizer->GetToken();
+        if (!frames.empty() && frames.back().tail == Frame::Read && !IsEndOfCell(token)) {
             NotFoundCloseBracket();
         }
-        if (IsSeparator(token)) {
-            if (is_first_token) {
+        tokenizer->Next();
+        if (BracketToken* bracket = std::get_if<BracketToken>(&token)) {
+            if (*bracket != BracketToken::CLOSE) {
+                if (frames.size() == max_read_depth) {
+                    throw SyntaxError{"Nesting is too deep"};
+                }
+                Frame::Kind kind = *bracket == BracketToken::OPEN ? Frame::List : Frame::Vector;
+                frames.push_back({kind, elements.size()});
+                continue;
+            }
+            if (ExpectsDatum(frames)) {
+                throw SyntaxError{"Close bracket before open"};
+            }
+            Frame frame = frames.back();
+            frames.pop_back();
+            if (frame.kind == Frame::Vector) {
+                datum = Vector::Make(Args(elements.begin() + frame.first, elements.end()));
+            } else {
+                datum = frame.tail == Frame::Read ? elements.back() : nullptr;
+                size_t end = elements.size() - (frame.tail == Frame::Read ? 1 : 0);
+                for (size_t i = end; i > frame.first; --i) {
+                    datum = runtime::New<Cell>(elements[i - 1], datum);
+                }
+            }
+            elements.resize(frame.first);
+        } else if (std::get_if<DotToken>(&token)) {
+            if (ExpectsDatum(frames)) {
+                throw SyntaxError{"Dot without cell"};
+            }
+            Frame& frame = frames.back();
+            if (frame.kind == Frame::Vector) {
+                throw SyntaxError{"dot cannot be in vector"};
+            }
+            if (elements.size() == frame.first) {
                 throw SyntaxError{"dot cannot be in list begin"};
             }
-            tokenizer->Next();
-            cur_list->SetSecond(Read(tokenizer));
-            should_end = true;
+            frame.tail = Frame::Expected;
+            continue;
+        } else if (std::get_if<QuoteToken>(&token)) {
+            if (frames.size() == max_read_depth) {
+                throw SyntaxError{"Nesting is too deep"};
+            }
+            frames.push_back({Frame::Quote, elements.size()});
+            continue;
         } else {
-            cur_list->SetFirst(Read(tokenizer));
-            cur_list->SetSecond(runtime::New<Cell>());
+            datum = ReadAtom(token);
         }
-        token = tokenizer->GetToken();
-        if (IsStepInto(token)) {
-            cur_list = As<Cell>(cur_list->GetSecond());
+        // The datum is complete: it fills the quotes waiting for it and then goes into the
+        // enclosing list or vector, or is the result.
+        while (!frames.empty() && frames.back().kind == Frame::Quote) {
+            frames.pop_back();
+            datum = runtime::New<Cell>(datum, nullptr);
+            datum = runtime::New<Cell>(Symbol::Intern(kQuoteSymbol), datum);
+        }
+        if (frames.empty()) {
+            return datum;
+        }
+        elements.push_back(datum);
+        if (frames.back().tail == Frame::Expected) {
+            frames.back().tail = Frame::Read;
         }
-        is_first_token = false;
-    }
-    if (!IsEndOfCell(token)) {
-        NotFoundCloseBracket();
-    }
-    if (!should_end) {
-        cur_list->SetSecond(nullptr);
     }
-    tokenizer->Next();
-    return main_list;
 }
 
 bool IsSeparator(const Token& token) {
@@ -95,4 +150,58 @@ bool IsStepInto(const Token& token) {
 
 void NotFoundCloseBracket() {
     throw SyntaxError{"Not found close bracket"};
-}
\ No newline at end of file
+}
+
+// StreamReader
+
+StreamReader::StreamReader(std::istream* in) : in_(in) {
+}
+
+bool StreamReader::IsEnd() {
+    while (true) {
+        Tokenizer tokenizer{GetRest()};
+        start_ += tokenizer.GetPosition();
+        if (!tokenizer.IsEnd() || exhausted_) {
+            return tokenizer.IsEnd();
+        }
+        Fill(kChunkSize);
+    }
+}
+
+ObjectPtr StreamReader::ReadForm() {
+    // A form reaching the end of the buffer may continue in the stream, then it is read
+    // again with at least twice as much input, so long forms are read in linear time.
+    while (true) {
+        std::string_view rest = GetRest();
+        Tokenizer tokenizer{rest};
+        try {
+            ObjectPtr form = Read(&tokenizer);
+            if (!tokenizer.IsEnd() || exhausted_) {
+                start_ += tokenizer.GetPosition();
+                return form;
+            }
+        } catch (const SyntaxError&) {
+            if (!tokenizer.IsEnd() || exhausted_) {
+                throw;
+            }
+        }
+        Fill(std::max(kChunkSize, rest.size()));
+    }
+}
+
+std::string_view StreamReader::GetRest() const {
+    return std::string_view{buffer_}.substr(start_);
+}
+
+void StreamReader::Fill(size_t size) {
+    buffer_.erase(0, start_);
+    start_ = 0;
+    size_t old_size = buffer_.size();
+    buffer_.resize(old_size + size);
+    in_->read(buffer_.data() + old_size, size);
+    size_t read = in_->gcount();
+    buffer_.resize(old_size + read);
+    exhausted_ = read < size;
+}
+
+// End of StreamReader
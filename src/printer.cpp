@@ -0,0 +1,253 @@
+#include "printer.h"
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+bool IsContainer(ObjectPtr obj) {
+    return Is<Cell>(obj) || Is<Vector>(obj);
+}
+
+size_t ChildrenCount(ObjectPtr obj) {
+    return Is<Cell>(obj) ? 2 : As<Vector>(obj)->GetSize();
+}
+
+ObjectPtr GetChild(ObjectPtr obj, size_t index) {
+    if (Is<Cell>(obj)) {
+        return index == 0 ? As<Cell>(obj)->GetFirst() : As<Cell>(obj)->GetSecond();
+    }
+    return As<Vector>(obj)->Get(index);
+}
+
+enum class VisitState : uint8_t { Unvisited, Visiting, Done };
+
+// Visit states of containers in an open-addressing table. Finding cycles looks up every
+// container written, so this is the hot path for large structures.
+class VisitStates {
+public:
+    VisitStates() : keys_(kMinCapacity), states_(kMinCapacity) {
+    }
+
+    // Slot of obj, inserted as unvisited if absent. Slots move when the table grows.
+    VisitState& operator[](ObjectPtr obj) {
+        size_t index = Find(obj);
+        if (keys_[index] == nullptr) {
+            if (2 * (size_ + 1) > keys_.size()) {
+                Grow();
+                index = Find(obj);
+            }
+            keys_[index] = obj;
+            ++size_;
+        }
+        return states_[index];
+    }
+
+private:
+    static constexpr size_t kMinCapacity = 64;
+
+    size_t Find(ObjectPtr obj) const {
+        size_t mask = keys_.size() - 1;
+        // Fibonacci hashing of the address without its alignment bits.
+        size_t index = (reinterpret_cast<uintptr_t>(obj) >> 4) * 0x9e3779b97f4a7c15 >> 20 & mask;
+        while (keys_[index] != nullptr && keys_[index] != obj) {
+            index = (index + 1) & mask;
+        }
+        return index;
+    }
+
+    void Grow() {
+        std::vector<ObjectPtr> keys = std::move(keys_);
+        std::vector<VisitState> states = std::move(states_);
+        keys_.assign(2 * keys.size(), nullptr);
+        states_.assign(2 * keys.size(), VisitState::Unvisited);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (keys[i] != nullptr) {
+                size_t index = Find(keys[i]);
+                keys_[index] = keys[i];
+                states_[index] = states[i];
+            }
+        }
+    }
+
+    std::vector<ObjectPtr> keys_;
+    std::vector<VisitState> states_;
+    size_t size_ = 0;
+};
+
+// Label of each container which needs one, -1 until it is written.
+using Labels = std::unordered_map<ObjectPtr, int64_t>;
+
+// Finds the containers reached again while their own contents are being visited:
+// exactly the ones closing a cycle. Depth-first with an explicit stack.
+Labels FindCycles(ObjectPtr root) {
+    Labels labels;
+    if (!IsContainer(root)) {
+        return labels;
+    }
+    struct Frame {
+        ObjectPtr obj;
+        size_t next_child;
+    };
+    VisitStates states;
+    std::vector<Frame> stack;
+    states[root] = VisitState::Visiting;
+    stack.push_back({root, 0});
+    while (!stack.empty()) {
+        Frame& frame = stack.back();
+        if (frame.next_child == ChildrenCount(frame.obj)) {
+            states[frame.obj] = VisitState::Done;
+            stack.pop_back();
+            continue;
+        }
+        ObjectPtr child = GetChild(frame.obj, frame.next_child++);
+        if (!IsContainer(child)) {
+            continue;
+        }
+        VisitState& state = states[child];
+        if (state == VisitState::Unvisited) {
+            state = VisitState::Visiting;
+            stack.push_back({child, 0});
+        } else if (state == VisitState::Visiting) {
+            labels.emplace(child, -1);
+        }
+    }
+    return labels;
+}
+
+void WriteAtom(ObjectPtr obj, std::string& out) {
+    if (obj == nullptr) {
+        out += "()";
+    } else if (IsFixnum(obj)) {
+        char buffer[24];
+        auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), Number::GetValue(obj));
+        out.append(buffer, end);
+    } else {
+        out += obj->ToString();
+    }
+}
+
+class Writer {
+public:
+    Writer(ObjectPtr root, std::ostream& out) : labels_(FindCycles(root)), out_(out) {
+        tasks_.push_back({Task::Value, root, 0});
+    }
+
+    void Run() {
+        while (!tasks_.empty()) {
+            if (buffer_.size() >= kFlushSize) {
+                Flush();
+            }
+            Task task = tasks_.back();
+            tasks_.pop_back();
+            switch (task.kind) {
+                case Task::Value:
+                    WriteValue(task.obj);
+                    break;
+                case Task::ListRest:
+                    WriteListRest(As<Cell>(task.obj));
+                    break;
+                case Task::VectorRest:
+                    WriteVectorRest(As<Vector>(task.obj), task.index);
+                    break;
+                case Task::Close:
+                    buffer_ += ')';
+                    break;
+            }
+        }
+        Flush();
+    }
+
+private:
+    // Output is collected into chunks, so the stream sees a few large writes.
+    static constexpr size_t kFlushSize = 1 << 16;
+
+    // Pending output, the last one is written first.
+    struct Task {
+        enum Kind { Value, ListRest, VectorRest, Close } kind;
+        ObjectPtr obj;
+        size_t index;
+    };
+
+    bool IsLabeled(ObjectPtr obj) const {
+        return labels_.contains(obj);
+    }
+
+    void Flush() {
+        out_.write(buffer_.data(), buffer_.size());
+        buffer_.clear();
+    }
+
+    void WriteValue(ObjectPtr obj) {
+        if (!IsContainer(obj)) {
+            WriteAtom(obj, buffer_);
+            return;
+        }
+        if (auto it = labels_.find(obj); it != labels_.end()) {
+            if (it->second >= 0) {
+                buffer_ += '#' + std::to_string(it->second) + '#';
+                return;
+            }
+            it->second = next_label_++;
+            buffer_ += '#' + std::to_string(it->second) + '=';
+        }
+        if (Is<Cell>(obj)) {
+            buffer_ += '(';
+            tasks_.push_back({Task::ListRest, obj, 0});
+            tasks_.push_back({Task::Value, As<Cell>(obj)->GetFirst(), 0});
+        } else {
+            buffer_ += "#(";
+            tasks_.push_back({Task::VectorRest, obj, 0});
+        }
+    }
+
+    // Continues a list after the first element of cell.
+    void WriteListRest(CellPtr cell) {
+        ObjectPtr rest = cell->GetSecond();
+        if (rest == nullptr) {
+            buffer_ += ')';
+        } else if (Is<Cell>(rest) && !IsLabeled(rest)) {
+            buffer_ += ' ';
+            tasks_.push_back({Task::ListRest, rest, 0});
+            tasks_.push_back({Task::Value, As<Cell>(rest)->GetFirst(), 0});
+        } else {
+            // Improper tail or a labeled pair, which must be written on its own.
+            buffer_ += " . ";
+            tasks_.push_back({Task::Close, nullptr, 0});
+            tasks_.push_back({Task::Value, rest, 0});
+        }
+    }
+
+    void WriteVectorRest(VectorPtr vector, size_t index) {
+        if (index == vector->GetSize()) {
+            buffer_ += ')';
+            return;
+        }
+        if (index > 0) {
+            buffer_ += ' ';
+        }
+        tasks_.push_back({Task::VectorRest, vector, index + 1});
+        tasks_.push_back({Task::Value, vector->Get(index), 0});
+    }
+
+    Labels labels_;
+    int64_t next_label_ = 0;
+    std::vector<Task> tasks_;
+    std::string buffer_;
+    std::ostream& out_;
+};
+
+}  // namespace
+
+void Write(ObjectPtr obj, std::ostream& out) {
+    if (!IsContainer(obj)) {
+        std::string atom;
+        WriteAtom(obj, atom);
+        out << atom;
+        return;
+    }
+    Writer{obj, out}.Run();
+}
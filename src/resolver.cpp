@@ -0,0 +1,192 @@
+#include "resolver.h"
+#include "error.h"
+#include "lambda.h"
+#include "lib.h"
+#include "parallel.h"
+#include "runtime.h"
+
+// FrameLayout
+
+uint32_t FrameLayout::AddLocal(SymbolPtr name) {
+    for (size_t i = names.size(); i > 0; --i) {
+        if (names[i - 1] == name) {
+            return i - 1;
+        }
+    }
+    names.push_back(name);
+    return names.size() - 1;
+}
+
+std::optional<LocalAddress> ResolveLocal(const FrameLayout* layout, SymbolPtr name) {
+    uint16_t depth = 0;
+    for (; layout != nullptr; layout = layout->parent, ++depth) {
+        for (size_t i = layout->names.size(); i > 0; --i) {
+            if (layout->names[i - 1] == name) {
+                return LocalAddress{depth, static_cast<uint32_t>(i - 1),
+                                    i <= layout->params_count};
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+SpecialForm* FindSpecialForm(ObjectPtr head, const FrameLayout* layout,
+                             GlobalScopePtr global_scope) {
+    if (!Is<Symbol>(head) || ResolveLocal(layout, As<Symbol>(head))) {
+        return nullptr;
+    }
+    ObjectPtr* value = global_scope->Find(As<Symbol>(head));
+    if (value == nullptr) {
+        return nullptr;
+    }
+    return As<SpecialForm>(*value);
+}
+
+void CollectDefines(ObjectPtr expr, FrameLayout* layout, GlobalScopePtr global_scope) {
+    if (!Is<Cell>(expr)) {
+        return;
+    }
+    CellPtr form = As<Cell>(expr);
+    SpecialForm* special = FindSpecialForm(form->GetFirst(), layout, global_scope);
+    if (Is<Quote>(special) || Is<Lambda>(special) || Is<FutureForm>(special)) {
+        return;
+    }
+    if (Is<Define>(special) && Is<Cell>(form->GetSecond())) {
+        ObjectPtr target = As<Cell>(form->GetSecond())->GetFirst();
+        if (Is<Cell>(target)) {
+            target = As<Cell>(target)->GetFirst();
+            if (Is<Symbol>(target)) {
+                layout->AddLocal(As<Symbol>(target));
+            }
+            return;
+        }
+        if (Is<Symbol>(target)) {
+            layout->AddLocal(As<Symbol>(target));
+        }
+    }
+    for (ObjectPtr elem : GetArgsVector<false>(form)) {
+        CollectDefines(elem, layout, global_scope);
+    }
+}
+
+// End of FrameLayout
+
+// LocalRef
+
+LocalRef::LocalRef(SymbolPtr name, LocalAddress address)
+    : Object(ObjectType::LocalRef), name_(name), address_(address) {
+}
+
+FramePtr LocalRef::GetFrame() const {
+    ScopePtr frame = ScopeStack::GetCurrent().Current();
+    for (uint16_t i = 0; i < address_.depth; ++i) {
+        frame = frame->GetParent();
+    }
+    // Local variables are resolved to frames of lambdas only.
+    return static_cast<FramePtr>(frame);
+}
+
+ObjectPtr LocalRef::Eval() {
+    ObjectPtr value = GetFrame()->ForReading()->GetSlot(address_.slot);
+    if (value == UnboundSlot()) {
+        throw NameError{"Symbol " + name_->GetName() + " not defined"};
+    }
+    return value;
+}
+
+void LocalRef::Assign(ObjectPtr obj) {
+    GetFrame()->ForWriting()->SetSlot(address_.slot, obj);
+}
+
+// End of LocalRef
+
+// Resolving
+
+namespace {
+
+ObjectPtr ResolveTarget(SymbolPtr name, const FrameLayout* layout) {
+    auto address = ResolveLocal(layout, name);
+    if (!address) {
+        return name;
+    }
+    return runtime::New<LocalRef>(name, *address);
+}
+
+ObjectPtr ResolveList(ObjectPtr list, const FrameLayout* layout, GlobalScopePtr global_scope) {
+    if (!Is<Cell>(list)) {
+        return ResolveExpr(list, layout, global_scope);
+    }
+    Local<Object> rest{list};
+    Local<Cell> head{runtime::New<Cell>()};
+    CellPtr tail = head;
+    while (true) {
+        tail->SetFirst(ResolveExpr(As<Cell>(rest)->GetFirst(), layout, global_scope));
+        rest = As<Cell>(rest)->GetSecond();
+        if (!Is<Cell>(rest)) {
+            tail->SetSecond(ResolveExpr(rest, layout, global_scope));
+            return head;
+        }
+        tail->SetSecond(runtime::New<Cell>());
+        tail = As<Cell>(tail->GetSecond());
+    }
+}
+
+ObjectPtr MakeTemplateCall(const LambdaSyntax& syntax, const FrameLayout* layout,
+                           GlobalScopePtr global_scope) {
+    Local<LambdaTemplate> lambda{
+        runtime::New<LambdaTemplate>(syntax.params, syntax.body, layout, global_scope)};
+    return runtime::New<Cell>(lambda, nullptr);
+}
+
+}  // namespace
+
+ObjectPtr ResolveExpr(ObjectPtr expr, const FrameLayout* layout, GlobalScopePtr global_scope) {
+    if (Is<Symbol>(expr)) {
+        return ResolveTarget(As<Symbol>(expr), layout);
+    }
+    if (!Is<Cell>(expr)) {
+        return expr;
+    }
+    CellPtr form = As<Cell>(expr);
+    SpecialForm* special = FindSpecialForm(form->GetFirst(), layout, global_scope);
+    if (Is<Quote>(special)) {
+        return expr;
+    }
+    // Malformed forms are left as is to raise the usual error when evaluated.
+    try {
+        if (Is<Lambda>(special)) {
+            return MakeTemplateCall(ParseLambda(form->GetSecond()), layout, global_scope);
+        }
+        // (future (template)), the body becomes a lambda without parameters.
+        if (Is<FutureForm>(special) && Is<Cell>(form->GetSecond())) {
+            Local<Object> thunk{
+                MakeTemplateCall({{}, form->GetSecond()}, layout, global_scope)};
+            Local<Cell> rest{runtime::New<Cell>(thunk, nullptr)};
+            return runtime::New<Cell>(form->GetFirst(), rest);
+        }
+        if ((Is<Define>(special) || Is<Set>(special)) && Is<Cell>(form->GetSecond())) {
+            CellPtr args = As<Cell>(form->GetSecond());
+            if (Is<Symbol>(args->GetFirst())) {
+                Local<Object> target{ResolveTarget(As<Symbol>(args->GetFirst()), layout)};
+                Local<Object> value{ResolveList(args->GetSecond(), layout, global_scope)};
+                Local<Cell> rest{runtime::New<Cell>(target, value)};
+                return runtime::New<Cell>(form->GetFirst(), rest);
+            }
+            if (Is<Define>(special)) {
+                auto [name, syntax] = ParseDefineLambda(args);
+                Local<Cell> rest{runtime::New<Cell>(MakeTemplateCall(syntax, layout, global_scope),
+                                                    nullptr)};
+                Local<Object> target{ResolveTarget(name, layout)};
+                rest = runtime::New<Cell>(target, rest);
+                return runtime::New<Cell>(form->GetFirst(), rest);
+            }
+        }
+    } catch (const SyntaxError&) {
+        return expr;
+    } catch (const RuntimeError&) {
+        return expr;
+    }
+    return ResolveList(form, layout, global_scope);
+}
+
+// End of Resolving
@@ -1,32 +1,447 @@
 #include "runtime.h"
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <utility>
 #include "object.h"
 
+namespace {
+
+size_t AlignUp(size_t size, size_t alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+// Units of work between deadline checks.
+constexpr size_t kClockInterval = 256;
+
+}  // namespace
+
+// MarkStack
+
+MarkStack::MarkStack(size_t chunk_size) : chunk_size_(chunk_size), chunks_(1) {
+    chunks_.back().reserve(chunk_size_);
+}
+
+void MarkStack::Push(ObjectPtr obj) {
+    if (chunks_.back().size() == chunk_size_) {
+        chunks_.emplace_back().reserve(chunk_size_);
+    }
+    chunks_.back().push_back(obj);
+}
+
+ObjectPtr MarkStack::Pop() {
+    ObjectPtr obj = chunks_.back().back();
+    chunks_.back().pop_back();
+    if (chunks_.back().empty() && chunks_.size() > 1) {
+        chunks_.pop_back();
+    }
+    return obj;
+}
+
+// End of MarkStack
+
+// SlabPool
+
+SlabPool::SlabPool(size_t slot_size, size_t slab_size)
+    : slot_size_(slot_size), slab_size_(slab_size) {
+}
+
+void* SlabPool::Allocate() {
+    ++used_;
+    if (free_ != nullptr) {
+        FreeSlot* slot = free_;
+        free_ = slot->next;
+        return slot;
+    }
+    if (static_cast<size_t>(end_ - bump_) < slot_size_) {
+        size_t size = std::max(slab_size_, slot_size_);
+        slabs_.emplace_back(new std::byte[size]);
+        bump_ = slabs_.back().get();
+        end_ = bump_ + size;
+    }
+    void* ptr = bump_;
+    bump_ += slot_size_;
+    ++capacity_;
+    return ptr;
+}
+
+void SlabPool::Free(void* ptr) {
+    --used_;
+    free_ = new (ptr) FreeSlot{free_};
+}
+
+// End of SlabPool
+
+// StackRoot
+
+StackRoot::StackRoot() {
+    GC& gc = GC::GetCurrent();
+    prev_ = gc.stack_roots_;
+    gc.stack_roots_ = this;
+}
+
+StackRoot::~StackRoot() {
+    GC::GetCurrent().stack_roots_ = prev_;
+}
+
+// End of StackRoot
+
+// GC
+
+class GC::Evacuator : public Tracer {
+public:
+    explicit Evacuator(GC* gc) : gc_(gc) {
+    }
+    void Visit(ObjectPtr& slot) override {
+        if (gc_->IsYoung(slot)) {
+            slot = gc_->Evacuate(slot);
+        }
+    }
+
+private:
+    GC* gc_;
+};
+
+class GC::Marker : public Tracer {
+public:
+    explicit Marker(GC* gc) : gc_(gc) {
+    }
+    void Visit(ObjectPtr& slot) override {
+        ++visits_;
+        gc_->Shade(slot);
+    }
+    // Number of references visited since the last call.
+    size_t TakeVisits() {
+        return std::exchange(visits_, 0);
+    }
+
+private:
+    GC* gc_;
+    size_t visits_ = 0;
+};
+
+class GC::YoungFinder : public Tracer {
+public:
+    explicit YoungFinder(GC* gc) : gc_(gc) {
+    }
+    void Visit(ObjectPtr& slot) override {
+        found_ = found_ || gc_->IsYoung(slot);
+    }
+    bool Found() const {
+        return found_;
+    }
+
+private:
+    GC* gc_;
+    bool found_ = false;
+};
+
+GC::GC() : nursery_(new std::byte[kNurserySize]), top_(nursery_.get()) {
+    for (size_t size = kAlignment; size <= kMaxPooledSize; size += kAlignment) {
+        pools_.emplace_back(size, kDefaultSlabSize);
+    }
+}
+
+void* GC::AllocateStorage(size_t size) {
+    if (size > kMaxPooledSize) {
+        // Huge sizes come from programs, e.g. make-vector, and are their errors.
+        void* ptr = ::operator new(size, std::nothrow);
+        if (ptr == nullptr) {
+            throw RuntimeError{"Out of memory"};
+        }
+        return ptr;
+    }
+    return pools_[(size - 1) / kAlignment].Allocate();
+}
+
+void GC::FreeStorage(void* ptr, size_t size) {
+    if (size > kMaxPooledSize) {
+        ::operator delete(ptr);
+        return;
+    }
+    pools_[(size - 1) / kAlignment].Free(ptr);
+}
+
+void GC::DestroyOld(size_t index) {
+    OldObject entry = old_[index];
+    old_bytes_ -= entry.size + entry.external;
+    old_[index] = OldObject{nullptr, 0, 0};
+    free_slots_.push_back(index);
+    if (entry.obj->owns_storage) {
+        entry.obj->~Object();
+    }
+    FreeStorage(entry.obj, entry.size);
+}
+
+void GC::SetSlabSize(size_t slab_size) {
+    for (SlabPool& pool : pools_) {
+        pool.SetSlabSize(slab_size);
+    }
+}
+
+std::vector<PoolStats> GC::GetPoolStats() const {
+    std::vector<PoolStats> stats;
+    for (const SlabPool& pool : pools_) {
+        stats.push_back(PoolStats{pool.GetSlotSize(), pool.GetSlabsCount(), pool.GetCapacity(),
+                                  pool.GetUsed()});
+    }
+    return stats;
+}
+
 void GC::AddRoot(ObjectPtr ptr) {
     roots_.push_back(ptr);
 }
 
-void GC::Collect() {
-    for (ObjectPtr obj : allocations_) {
-        obj->marked = false;
+GC::YoungHeader* GC::AllocateYoung(size_t size) {
+    size = sizeof(YoungHeader) + AlignUp(size, kAlignment);
+    if (static_cast<size_t>(nursery_.get() + kNurserySize - top_) < size ||
+        young_external_bytes_ >= kNurserySize) {
+        return nullptr;
+    }
+    auto* header = new (top_) YoungHeader{size, nullptr, nullptr};
+    top_ += size;
+    return header;
+}
+
+void GC::AddOld(ObjectPtr obj, size_t size) {
+    size_t external = obj->owns_storage ? obj->GetExternalSize() : 0;
+    if (free_slots_.empty()) {
+        obj->heap_index = old_.size();
+        old_.push_back(OldObject{obj, size, external});
+        mark_bits_.resize((old_.size() + 63) / 64);
+    } else {
+        obj->heap_index = free_slots_.back();
+        free_slots_.pop_back();
+        old_[obj->heap_index] = OldObject{obj, size, external};
     }
+    old_bytes_ += size + external;
+    // Objects created during a cycle survive it. While marking, their fields are traced
+    // too: they may refer to objects which were only on the native stack.
+    if (phase_ == Phase::Marking) {
+        Shade(obj);
+    } else if (phase_ == Phase::Sweeping) {
+        mark_bits_[obj->heap_index / 64] |= uint64_t{1} << (obj->heap_index % 64);
+    }
+}
+
+void GC::RememberIfYoungReferrer(ObjectPtr obj) {
+    YoungFinder finder{this};
+    obj->Trace(finder);
+    if (finder.Found()) {
+        Remember(obj);
+    }
+}
+
+ObjectPtr GC::Evacuate(ObjectPtr obj) {
+    YoungHeader* header = HeaderOf(obj);
+    if (header->forward == nullptr) {
+        size_t size = header->size - sizeof(YoungHeader);
+        header->forward = header->relocate(obj, AllocateStorage(size));
+        AddOld(header->forward, size);
+        promoted_.push_back(header->forward);
+    }
+    return header->forward;
+}
+
+void GC::DestroyNursery() {
+    // Promoted objects left moved-from copies, which are destroyed too.
+    for (ObjectPtr obj : young_owners_) {
+        obj->~Object();
+    }
+    young_owners_.clear();
+    young_external_bytes_ = 0;
+    top_ = nursery_.get();
+}
+
+void GC::CollectMinor() {
+    // Roots are old, their young references are in the remembered set.
+    Evacuator evacuator{this};
+    TraceStackRoots(evacuator);
+    for (ObjectPtr obj : remembered_) {
+        obj->remembered = false;
+        obj->Trace(evacuator);
+    }
+    remembered_.clear();
+    while (!promoted_.empty()) {
+        ObjectPtr obj = promoted_.back();
+        promoted_.pop_back();
+        obj->Trace(evacuator);
+    }
+    DestroyNursery();
+}
+
+bool GC::TryMark(ObjectPtr obj) {
+    // Interned symbols live outside the heap and frozen ones in heaps of their own, young
+    // objects are not collected by cycles.
+    if (!IsHeapObject(obj) || Is<Symbol>(obj) || obj->frozen || IsYoung(obj)) {
+        return false;
+    }
+    uint64_t& word = mark_bits_[obj->heap_index / 64];
+    uint64_t bit = uint64_t{1} << (obj->heap_index % 64);
+    if ((word & bit) != 0) {
+        return false;
+    }
+    word |= bit;
+    return true;
+}
+
+void GC::TraceStackRoots(Tracer& tracer) {
+    for (StackRoot* root = stack_roots_; root != nullptr; root = root->GetPrev()) {
+        root->Trace(tracer);
+    }
+}
+
+void GC::StartCycle() {
+    std::fill(mark_bits_.begin(), mark_bits_.end(), 0);
+    grey_ = MarkStack{mark_chunk_size_};
+    tracing_ = nullptr;
+    phase_ = Phase::Marking;
+    Marker marker{this};
     for (ObjectPtr root : roots_) {
-        if (root != nullptr) {
-            root->Mark();
+        Shade(root);
+    }
+    TraceStackRoots(marker);
+    // Young objects are not collected by cycles, so all of them are treated as live.
+    for (std::byte* ptr = nursery_.get(); ptr < top_;) {
+        auto* header = reinterpret_cast<YoungHeader*>(ptr);
+        if (header->relocate != nullptr) {
+            reinterpret_cast<ObjectPtr>(header + 1)->Trace(marker);
         }
+        ptr += header->size;
+    }
+}
+
+size_t GC::MarkChunk(Marker& marker) {
+    size_t work = 0;
+    if (tracing_ == nullptr) {
+        tracing_ = grey_.Pop();
+        tracing_parts_ = tracing_->GetTraceParts();
+        tracing_pos_ = 0;
+        work = 1;
+    } else if (tracing_->GetTraceParts() != tracing_parts_) {
+        // The parts changed, e.g. a global scope rehashed: references may have moved into
+        // parts traced already, so tracing starts over.
+        tracing_parts_ = tracing_->GetTraceParts();
+        tracing_pos_ = 0;
+    }
+    size_t end = std::min(tracing_parts_, tracing_pos_ + kTracePartsChunk);
+    tracing_->TraceParts(marker, tracing_pos_, end);
+    tracing_pos_ = end;
+    if (tracing_pos_ == tracing_parts_) {
+        tracing_ = nullptr;
+    }
+    return work + marker.TakeVisits();
+}
+
+size_t GC::Step(size_t work_limit, Clock::time_point deadline) {
+    Marker marker{this};
+    size_t work = 0;
+    size_t next_check = kClockInterval;
+    while (phase_ != Phase::Idle && work < work_limit) {
+        if (work >= next_check) {
+            if (Clock::now() > deadline) {
+                break;
+            }
+            next_check = work + kClockInterval;
+        }
+        if (phase_ == Phase::Marking) {
+            if (tracing_ != nullptr || !grey_.Empty()) {
+                work += MarkChunk(marker);
+                continue;
+            }
+            phase_ = Phase::Sweeping;
+            sweep_pos_ = 0;
+            sweep_end_ = old_.size();
+            // Unreachable objects may still be remembered, the next minor collection must
+            // not trace them once they are destroyed. Objects remembered from now on are
+            // reachable.
+            std::erase_if(remembered_,
+                          [this](ObjectPtr obj) { return !IsMarked(obj->heap_index); });
+        }
+        if (sweep_pos_ == sweep_end_) {
+            phase_ = Phase::Idle;
+            cycle_trigger_ = std::max<size_t>(kMinHeapBytes, growth_factor_ * old_bytes_);
+            work_debt_ = 0;
+            slice_bytes_ = kSliceBytes;
+            break;
+        }
+        ++work;
+        size_t index = sweep_pos_++;
+        OldObject& entry = old_[index];
+        if (entry.obj == nullptr) {
+            continue;
+        }
+        if (!IsMarked(index)) {
+            DestroyOld(index);
+        } else if (entry.obj->owns_storage) {
+            // External storage may have grown since the object was added, e.g. new bindings.
+            size_t external = entry.obj->GetExternalSize();
+            old_bytes_ = old_bytes_ - entry.external + external;
+            entry.external = external;
+        }
+    }
+    return work;
+}
+
+void GC::RunAllocationSlice() {
+    work_debt_ += allocated_since_slice_ / kBytesPerWork;
+    allocated_since_slice_ = 0;
+    work_debt_ -= std::min(work_debt_, Step(work_debt_, Clock::now() + max_pause_));
+    // A slice stopped by the deadline leaves a debt: slices come more often until the
+    // cycle keeps up with the allocations again.
+    if (work_debt_ > 0) {
+        slice_bytes_ = std::max(kMinSliceBytes, slice_bytes_ / 2);
+    } else {
+        slice_bytes_ = std::min(kSliceBytes, slice_bytes_ * 2);
+    }
+}
+
+void GC::Safepoint() {
+    if (static_cast<size_t>(top_ - nursery_.get()) + young_external_bytes_ >= kMinorTrigger) {
+        CollectMinor();
     }
-    for (size_t i = 0; i < allocations_.size(); ++i) {
-        if (!allocations_[i]->marked) {
-            std::swap(allocations_.back(), allocations_[i]);
-            delete allocations_.back();
-            allocations_.pop_back();
-            --i;
+    if (phase_ == Phase::Idle && old_bytes_ > cycle_trigger_) {
+        // Keeps the snapshot small: the nursery is empty afterwards.
+        CollectMinor();
+        StartCycle();
+    }
+    if (phase_ != Phase::Idle) {
+        work_debt_ -= std::min(work_debt_, Step(std::numeric_limits<size_t>::max(),
+                                                Clock::now() + max_pause_));
+    }
+}
+
+void GC::CollectFull() {
+    if (phase_ == Phase::Idle) {
+        StartCycle();
+    }
+    while (phase_ != Phase::Idle) {
+        Step(std::numeric_limits<size_t>::max(), Clock::time_point::max());
+    }
+}
+
+void GC::Freeze() {
+    CollectMinor();
+    // The first cycle only finishes the current one, which keeps objects created during it.
+    CollectFull();
+    CollectFull();
+    for (const OldObject& old : old_) {
+        if (old.obj != nullptr) {
+            old.obj->frozen = true;
         }
     }
+    cycle_trigger_ = std::numeric_limits<size_t>::max();
 }
 
 GC::~GC() {
-    for (ObjectPtr ptr : allocations_) {
-        delete ptr;
+    DestroyNursery();
+    for (size_t index = 0; index < old_.size(); ++index) {
+        if (old_[index].obj != nullptr) {
+            DestroyOld(index);
+        }
     }
-}
\ No newline at end of file
+}
+
+// End of GC
@@ -5,43 +5,254 @@
 #include "tokenizer.h"
 #include "parser.h"
 #include "runtime.h"
+#include "compiler.h"
+#include "image.h"
+#include "vm.h"
 
+#include <cstdio>
 #include <exception>
+#include <fstream>
 #include <memory>
 #include <sstream>
+#include <utility>
 
-Interpreter::Interpreter() {
-    ScopePtr global_scope = CreateGlobalScope();
-    ScopeStack::GetInstance().Push(global_scope);
-    GC::GetInstance().AddRoot(global_scope);
+class Interpreter::Activation {
+public:
+    explicit Activation(Interpreter* interpreter)
+        : prev_interpreter_(std::exchange(current_, interpreter)),
+          prev_heap_(GC::SetCurrent(interpreter->heap_.get())),
+          prev_scopes_(ScopeStack::SetCurrent(interpreter->scopes_.get())) {
+    }
+    ~Activation() {
+        current_ = prev_interpreter_;
+        GC::SetCurrent(prev_heap_);
+        ScopeStack::SetCurrent(prev_scopes_);
+    }
+    Activation(const Activation&) = delete;
+    Activation& operator=(const Activation&) = delete;
+
+private:
+    Interpreter* prev_interpreter_;
+    GC* prev_heap_;
+    ScopeStack* prev_scopes_;
+};
+
+Interpreter::Interpreter(EvalMode mode, std::shared_ptr<const FrozenEnvironment> environment)
+    : mode_(mode),
+      environment_(std::move(environment)),
+      heap_(std::make_unique<GC>()),
+      scopes_(std::make_unique<ScopeStack>()) {
+    Activation activation{this};
+    global_scope_ = CreateGlobalScope();
+    if (environment_ != nullptr) {
+        global_scope_->SetBase(environment_->GetGlobalScope());
+        scopes_->SetEnvironmentShadows(&environment_->GetShadows());
+    }
+    ScopeStack::GetCurrent().Push(global_scope_);
+    GC::GetCurrent().AddRoot(global_scope_);
 }
 
 Interpreter::~Interpreter() {
-    ScopeStack::GetInstance().Pop();
+    Activation activation{this};
+    ScopeStack::GetCurrent().Pop();
+    // Objects are destroyed while their heap is current.
+    heap_.reset();
 }
 
 std::string Interpreter::Run(const std::string& str) {
+    std::string res;
+    Run(str, [&res](ObjectPtr value) { res = ObjectToString(value); });
+    return res;
+}
+
+void Interpreter::Run(const std::string& str, const std::function<void(ObjectPtr)>& on_value) {
+    Activation activation{this};
     try {
-        std::stringstream stream{str};
-        Tokenizer tokenizer{&stream};
-        ObjectPtr ast = Read(&tokenizer);
+        Tokenizer tokenizer{str};
+        Local<Object> ast{Read(&tokenizer)};
         if (!tokenizer.IsEnd()) {
             throw SyntaxError{"Not correct command"};
         }
-        if (ast == nullptr) {
-            throw SyntaxError{"No exression was provided"};
+        RunForm(ast, on_value);
+    } catch (...) {
+        GC::GetCurrent().Safepoint();
+        throw;
+    }
+}
+
+void Interpreter::RunStream(std::istream& in, const std::function<void(ObjectPtr)>& on_value) {
+    Activation activation{this};
+    try {
+        StreamReader reader{&in};
+        while (!reader.IsEnd()) {
+            Local<Object> ast{reader.ReadForm()};
+            RunForm(ast, on_value);
+        }
+    } catch (...) {
+        GC::GetCurrent().Safepoint();
+        throw;
+    }
+}
+
+void Interpreter::RunFile(const std::string& path,
+                          const std::function<void(ObjectPtr)>& on_value) {
+    std::ifstream in{path, std::ios::binary};
+    if (!in.is_open()) {
+        throw RuntimeError{"Can't open " + path};
+    }
+    if (!code_cache_) {
+        RunStream(in, on_value);
+        return;
+    }
+    in.close();
+    Activation activation{this};
+    RunCached(path, on_value);
+}
+
+void Interpreter::SaveImage(const std::string& path) {
+    Activation activation{this};
+    ::SaveImage(global_scope_, path);
+}
+
+void Interpreter::LoadImage(const std::string& path) {
+    Activation activation{this};
+    try {
+        ::LoadImage(global_scope_, path);
+        GC::GetCurrent().Safepoint();
+    } catch (...) {
+        GC::GetCurrent().Safepoint();
+        throw;
+    }
+}
+
+void Interpreter::EnableCodeCache(const std::string& dir) {
+    code_cache_ = true;
+    code_cache_dir_ = dir;
+}
+
+void Interpreter::Enter(const std::function<void(GlobalScopePtr global_scope)>& body) {
+    Activation activation{this};
+    try {
+        body(global_scope_);
+    } catch (...) {
+        GC::GetCurrent().Safepoint();
+        throw;
+    }
+    GC::GetCurrent().Safepoint();
+}
+
+std::vector<PoolStats> Interpreter::GetPoolStats() const {
+    return heap_->GetPoolStats();
+}
+
+std::string Interpreter::GetCodeCachePath(const std::string& path,
+                                          std::string_view source) const {
+    if (code_cache_dir_.empty()) {
+        return path + "c";
+    }
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016llx",
+                  static_cast<unsigned long long>(HashSource(source)));
+    return code_cache_dir_ + '/' + name + ".scmc";
+}
+
+void Interpreter::RunCached(const std::string& path,
+                            const std::function<void(ObjectPtr)>& on_value) {
+    std::ifstream in{path, std::ios::binary};
+    std::ostringstream contents;
+    if (!(contents << in.rdbuf()) && in.peek() != std::ifstream::traits_type::eof()) {
+        throw RuntimeError{"Can't read " + path};
+    }
+    std::string source = std::move(contents).str();
+    std::string cache_path = GetCodeCachePath(path, source);
+    try {
+        Args forms;
+        LocalArgs forms_root{forms};
+        if (ReadCodeCache(global_scope_, cache_path, source, &forms)) {
+            for (ObjectPtr& form : forms) {
+                RunForm(form, on_value);
+                form = nullptr;
+            }
+            return;
+        }
+        // Forms are saved only after all of them ran, a cache never has a partial source.
+        CodeCacheWriter cache{source};
+        Tokenizer tokenizer{source};
+        while (!tokenizer.IsEnd()) {
+            Local<Object> ast{Read(&tokenizer)};
+            cache.Add(ast);
+            RunForm(ast, on_value);
         }
-        ObjectPtr res = ast->Eval();
-        if (res == nullptr) {
-            GC::GetInstance().Collect();
-            return "()";
+        try {
+            cache.Save(cache_path);
+        } catch (const RuntimeError&) {
+            // The script has run, a cache which can't be written only costs the next run a
+            // parse.
         }
-        auto ans = res->ToString();
-        res = nullptr;
-        GC::GetInstance().Collect();
-        return ans;
-    } catch (std::exception) {
-        GC::GetInstance().Collect();
+    } catch (...) {
+        GC::GetCurrent().Safepoint();
         throw;
     }
 }
+
+void Interpreter::RunForm(ObjectPtr ast, const std::function<void(ObjectPtr)>& on_value) {
+    if (ast == nullptr) {
+        throw SyntaxError{"No exression was provided"};
+    }
+    Local<Object> res{Evaluate(ast)};
+    if (on_value) {
+        on_value(res);
+    }
+    res = nullptr;
+    GC::GetCurrent().Safepoint();
+}
+
+ObjectPtr Interpreter::Evaluate(ObjectPtr ast) {
+    if (mode_ == EvalMode::TreeWalk) {
+        return EvalObject(ast);
+    }
+    Local<Prototype> proto{Compiler{global_scope_}.Compile(ast)};
+    return VirtualMachine{global_scope_}.Execute(proto);
+}
+
+FrozenEnvironment::FrozenEnvironment(std::shared_ptr<const FrozenEnvironment> base)
+    : interpreter_(std::make_unique<Interpreter>(EvalMode::Bytecode, std::move(base))) {
+}
+
+void FrozenEnvironment::Seal() {
+    interpreter_->Enter([this](GlobalScopePtr global_scope) {
+        GC::GetCurrent().Freeze();
+        global_scope_ = global_scope;
+        if (const auto& base = interpreter_->GetEnvironment()) {
+            shadows_ = base->GetShadows();
+        }
+        for (const auto& [frozen, copy] : ScopeStack::GetCurrent().GetShadows()) {
+            shadows_[frozen] = copy;
+        }
+    });
+}
+
+std::shared_ptr<const FrozenEnvironment> FrozenEnvironment::LoadImage(const std::string& path) {
+    std::shared_ptr<FrozenEnvironment> environment{new FrozenEnvironment{nullptr}};
+    environment->interpreter_->LoadImage(path);
+    environment->Seal();
+    return environment;
+}
+
+std::shared_ptr<const FrozenEnvironment> FrozenEnvironment::Freeze(Interpreter* interpreter) {
+    ObjectsImage bindings;
+    interpreter->Enter([&bindings](GlobalScopePtr global_scope) {
+        ObjectsWriter writer{global_scope};
+        writer.AddBindings();
+        bindings = writer.Finish();
+    });
+    // Frozen objects in the bindings belong to the environment of the interpreter, which
+    // stays alive as the base of the new one.
+    std::shared_ptr<FrozenEnvironment> environment{
+        new FrozenEnvironment{interpreter->GetEnvironment()}};
+    environment->interpreter_->Enter([&bindings](GlobalScopePtr global_scope) {
+        ObjectsReader{global_scope, bindings}.ReadBindings();
+    });
+    environment->Seal();
+    return environment;
+}
@@ -1,96 +1,264 @@
 #include "scope.h"
+#include <algorithm>
+#include <utility>
 #include "runtime.h"
 #include "lib.h"
 #include "lambda.h"
+#include "parallel.h"
 
-Scope::Scope(ScopePtr parent) : parent_(parent) {
+// Scope
+
+GlobalScopePtr Scope::GetGlobal() {
+    ScopePtr scope = this;
+    while (scope->parent_ != nullptr) {
+        scope = scope->parent_;
+    }
+    // Chains end with a global scope, frames always have a parent.
+    auto global = static_cast<GlobalScopePtr>(scope);
+    if (global->IsFrozen()) {
+        return ScopeStack::GetCurrent().GetGlobal();
+    }
+    return global;
 }
 
-void Scope::Define(const std::string& name, ObjectPtr obj) {
-    AddDependency(obj);
-    mapping_[name] = obj;
+// End of Scope
+
+// GlobalScope
+
+GlobalScope::GlobalScope() : Scope(ObjectType::GlobalScope, nullptr) {
 }
 
-void Scope::Set(const std::string& name, ObjectPtr obj) {
-    if (mapping_.contains(name)) {
-        RemoveDependency(mapping_[name]);
-        mapping_[name] = obj;
-        AddDependency(obj);
-    } else if (parent_) {
-        parent_->Set(name, obj);
-    } else {
-        throw NameError{"Symbol " + name + " not defined"};
+void GlobalScope::Trace(Tracer& tracer) {
+    for (auto& [name, value] : mapping_) {
+        tracer(value);
+    }
+}
+
+void GlobalScope::TraceParts(Tracer& tracer, size_t begin, size_t end) {
+    for (size_t bucket = begin; bucket < end; ++bucket) {
+        for (auto it = mapping_.begin(bucket); it != mapping_.end(bucket); ++it) {
+            tracer(it->second);
+        }
+    }
+}
+
+ObjectPtr* GlobalScope::Find(SymbolPtr name) {
+    auto it = mapping_.find(name);
+    if (it == mapping_.end()) {
+        return base_ != nullptr ? base_->Find(name) : nullptr;
     }
+    return &it->second;
 }
 
-ObjectPtr Scope::Get(const std::string& name) {
-    if (mapping_.contains(name)) {
-        return mapping_[name];
-    } else if (parent_) {
-        return parent_->Get(name);
+void GlobalScope::Define(SymbolPtr name, ObjectPtr obj) {
+    // The barrier comes first: it refuses to change frozen scopes.
+    auto it = mapping_.find(name);
+    if (it == mapping_.end()) {
+        GC::GetCurrent().WriteBarrier(this, nullptr, obj);
+        mapping_.emplace(name, obj);
     } else {
-        throw NameError{"Symbol " + name + " not defined"};
+        GC::GetCurrent().WriteBarrier(this, it->second, obj);
+        it->second = obj;
+    }
+}
+
+void GlobalScope::Set(SymbolPtr name, ObjectPtr obj) {
+    if (auto it = mapping_.find(name); it != mapping_.end()) {
+        GC::GetCurrent().WriteBarrier(this, it->second, obj);
+        it->second = obj;
+        return;
+    }
+    if (base_ != nullptr && base_->Find(name) != nullptr) {
+        Define(name, obj);
+        return;
+    }
+    throw NameError{"Symbol " + name->GetName() + " not defined"};
+}
+
+ObjectPtr GlobalScope::Get(SymbolPtr name) {
+    if (ObjectPtr* value = Find(name)) {
+        return *value;
+    }
+    throw NameError{"Symbol " + name->GetName() + " not defined"};
+}
+
+size_t GlobalScope::GetExternalSize() const {
+    // A node holds a binding and the link to the next node of its bucket.
+    return mapping_.size() * (sizeof(std::pair<const SymbolPtr, ObjectPtr>) + sizeof(void*)) +
+           mapping_.bucket_count() * sizeof(void*);
+}
+
+// End of GlobalScope
+
+// Frame
+
+Frame::Frame(ScopePtr parent, size_t slots_count, ObjectPtr init)
+    : Scope(ObjectType::Frame, parent), slots_count_(slots_count) {
+    std::fill_n(GetSlots(), slots_count_, init);
+}
+
+Frame::Frame(Frame&& other) : Scope(std::move(other)), slots_count_(other.slots_count_) {
+    std::copy_n(other.GetSlots(), slots_count_, GetSlots());
+}
+
+FramePtr Frame::Make(ScopePtr parent, size_t slots_count, ObjectPtr init, bool tenured) {
+    size_t size = sizeof(Frame) + slots_count * sizeof(ObjectPtr);
+    if (tenured) {
+        return GC::GetCurrent().NewTenuredSized<Frame>(size, parent, slots_count, init);
+    }
+    return GC::GetCurrent().NewSized<Frame>(size, parent, slots_count, init);
+}
+
+void Frame::SetSlot(size_t index, ObjectPtr obj) {
+    GC::GetCurrent().WriteBarrier(this, GetSlots()[index], obj);
+    GetSlots()[index] = obj;
+}
+
+void Frame::Trace(Tracer& tracer) {
+    tracer(parent_);
+    for (size_t i = 0; i < slots_count_; ++i) {
+        tracer(GetSlots()[i]);
+    }
+}
+
+FramePtr Frame::Copy() const {
+    FramePtr copy = Make(parent_, slots_count_, nullptr, true);
+    for (size_t i = 0; i < slots_count_; ++i) {
+        copy->SetSlot(i, GetSlots()[i]);
     }
+    return copy;
 }
 
+// End of Frame
+
 ScopePtr ScopeStack::Current() {
     if (scopes_.empty()) {
         throw std::runtime_error{"Scope stack is empty"};
     }
-    return scopes_.top();
+    return scopes_.back();
+}
+
+GlobalScopePtr ScopeStack::GetGlobal() {
+    if (scopes_.empty()) {
+        throw std::runtime_error{"Scope stack is empty"};
+    }
+    // The interpreter pushes its global scope first.
+    return static_cast<GlobalScopePtr>(scopes_.front());
 }
 
 void ScopeStack::Push(ScopePtr scope) {
-    scopes_.push(scope);
+    scopes_.push_back(scope);
 }
 
 void ScopeStack::Pop() {
     if (scopes_.empty()) {
         throw std::runtime_error{"Scope stack is empty"};
     }
-    scopes_.pop();
-}
-
-ScopePtr CreateGlobalScope() {
-    ScopePtr global_scope = runtime::New<Scope>();
-
-    global_scope->Define(kTrueSymbol, runtime::New<Symbol>(kTrueSymbol));
-    global_scope->Define(kFalseSymbol, runtime::New<Symbol>(kFalseSymbol));
-
-    global_scope->Define("quote", runtime::New<Quote>());
-    global_scope->Define("number?", runtime::New<NumPredicate>());
-    global_scope->Define("=", runtime::New<Equal>());
-    global_scope->Define(">", runtime::New<Greater>());
-    global_scope->Define("<", runtime::New<Less>());
-    global_scope->Define(">=", runtime::New<GreaterEq>());
-    global_scope->Define("<=", runtime::New<LessEq>());
-    global_scope->Define("+", runtime::New<Plus>());
-    global_scope->Define("-", runtime::New<Minus>());
-    global_scope->Define("*", runtime::New<Multiply>());
-    global_scope->Define("/", runtime::New<Div>());
-    global_scope->Define("max", runtime::New<Max>());
-    global_scope->Define("min", runtime::New<Min>());
-    global_scope->Define("abs", runtime::New<Abs>());
-    global_scope->Define("boolean?", runtime::New<BoolPredicate>());
-    global_scope->Define("not", runtime::New<LogicalNot>());
-    global_scope->Define("and", runtime::New<LogicalAnd>());
-    global_scope->Define("or", runtime::New<LogicalOr>());
-    global_scope->Define("pair?", runtime::New<PairPredicate>());
-    global_scope->Define("null?", runtime::New<NullPredicate>());
-    global_scope->Define("list?", runtime::New<ListPredicate>());
-    global_scope->Define("cons", runtime::New<PairCons>());
-    global_scope->Define("car", runtime::New<PairCar>());
-    global_scope->Define("cdr", runtime::New<PairCdr>());
-    global_scope->Define("list", runtime::New<ListCtor>());
-    global_scope->Define("list-ref", runtime::New<ListRef>());
-    global_scope->Define("list-tail", runtime::New<ListTail>());
-    global_scope->Define("if", runtime::New<If>());
-    global_scope->Define("symbol?", runtime::New<SymbolPredicate>());
-    global_scope->Define("define", runtime::New<Define>());
-    global_scope->Define("set!", runtime::New<Set>());
-    global_scope->Define("set-car!", runtime::New<SetCar>());
-    global_scope->Define("set-cdr!", runtime::New<SetCdr>());
-    global_scope->Define("lambda", runtime::New<Lambda>());
+    scopes_.pop_back();
+}
+
+FramePtr ScopeStack::GetShadow(FramePtr frozen) const {
+    if (auto it = shadows_.find(frozen); it != shadows_.end()) {
+        return it->second;
+    }
+    if (environment_shadows_ != nullptr) {
+        if (auto it = environment_shadows_->find(frozen); it != environment_shadows_->end()) {
+            return it->second;
+        }
+    }
+    return frozen;
+}
+
+FramePtr ScopeStack::Shadow(FramePtr frozen) {
+    if (auto it = shadows_.find(frozen); it != shadows_.end()) {
+        return it->second;
+    }
+    FramePtr copy = GetShadow(frozen)->Copy();
+    SetShadow(frozen, copy);
+    return copy;
+}
+
+void ScopeStack::SetShadow(FramePtr frozen, FramePtr copy) {
+    GC::GetCurrent().AddRoot(copy);
+    shadows_[frozen] = copy;
+}
+
+void ScopeStack::Replace(ScopePtr scope) {
+    if (scopes_.empty()) {
+        throw std::runtime_error{"Scope stack is empty"};
+    }
+    scopes_.back() = scope;
+}
+
+SymbolPtr UnboundSlot() {
+    // The name can't be produced by the tokenizer.
+    static SymbolPtr unbound = Symbol::Intern("#<unbound slot>");
+    return unbound;
+}
+
+GlobalScopePtr CreateGlobalScope() {
+    GlobalScopePtr global_scope = runtime::NewTenured<GlobalScope>();
+
+    global_scope->Define(Symbol::Intern(kTrueSymbol), Symbol::Boolean(true));
+    global_scope->Define(Symbol::Intern(kFalseSymbol), Symbol::Boolean(false));
+
+    global_scope->Define(Symbol::Intern("quote"), runtime::New<Quote>());
+    global_scope->Define(Symbol::Intern("number?"), runtime::New<NumPredicate>());
+    global_scope->Define(Symbol::Intern("="), runtime::New<Equal>());
+    global_scope->Define(Symbol::Intern(">"), runtime::New<Greater>());
+    global_scope->Define(Symbol::Intern("<"), runtime::New<Less>());
+    global_scope->Define(Symbol::Intern(">="), runtime::New<GreaterEq>());
+    global_scope->Define(Symbol::Intern("<="), runtime::New<LessEq>());
+    global_scope->Define(Symbol::Intern("+"), runtime::New<Plus>());
+    global_scope->Define(Symbol::Intern("-"), runtime::New<Minus>());
+    global_scope->Define(Symbol::Intern("*"), runtime::New<Multiply>());
+    global_scope->Define(Symbol::Intern("/"), runtime::New<Div>());
+    global_scope->Define(Symbol::Intern("max"), runtime::New<Max>());
+    global_scope->Define(Symbol::Intern("min"), runtime::New<Min>());
+    global_scope->Define(Symbol::Intern("abs"), runtime::New<Abs>());
+    global_scope->Define(Symbol::Intern("boolean?"), runtime::New<BoolPredicate>());
+    global_scope->Define(Symbol::Intern("not"), runtime::New<LogicalNot>());
+    global_scope->Define(Symbol::Intern("and"), runtime::New<LogicalAnd>());
+    global_scope->Define(Symbol::Intern("or"), runtime::New<LogicalOr>());
+    global_scope->Define(Symbol::Intern("pair?"), runtime::New<PairPredicate>());
+    global_scope->Define(Symbol::Intern("null?"), runtime::New<NullPredicate>());
+    global_scope->Define(Symbol::Intern("list?"), runtime::New<ListPredicate>());
+    global_scope->Define(Symbol::Intern("cons"), runtime::New<PairCons>());
+    global_scope->Define(Symbol::Intern("car"), runtime::New<PairCar>());
+    global_scope->Define(Symbol::Intern("cdr"), runtime::New<PairCdr>());
+    global_scope->Define(Symbol::Intern("list"), runtime::New<ListCtor>());
+    global_scope->Define(Symbol::Intern("list-ref"), runtime::New<ListRef>());
+    global_scope->Define(Symbol::Intern("list-tail"), runtime::New<ListTail>());
+    global_scope->Define(Symbol::Intern("vector?"), runtime::New<VectorPredicate>());
+    global_scope->Define(Symbol::Intern("make-vector"), runtime::New<MakeVector>());
+    global_scope->Define(Symbol::Intern("vector"), runtime::New<VectorCtor>());
+    global_scope->Define(Symbol::Intern("vector-length"), runtime::New<VectorLength>());
+    global_scope->Define(Symbol::Intern("vector-ref"), runtime::New<VectorRef>());
+    global_scope->Define(Symbol::Intern("vector-set!"), runtime::New<VectorSet>());
+    global_scope->Define(Symbol::Intern("vector->list"), runtime::New<VectorToList>());
+    global_scope->Define(Symbol::Intern("list->vector"), runtime::New<ListToVector>());
+    global_scope->Define(Symbol::Intern("vector-sum"), runtime::New<VectorSum>());
+    global_scope->Define(Symbol::Intern("vector-min"), runtime::New<VectorMin>());
+    global_scope->Define(Symbol::Intern("vector-max"), runtime::New<VectorMax>());
+    global_scope->Define(Symbol::Intern("vector-dot"), runtime::New<VectorDot>());
+    global_scope->Define(Symbol::Intern("vector-add"), runtime::New<VectorAdd>());
+    global_scope->Define(Symbol::Intern("vector-scale"), runtime::New<VectorScale>());
+    global_scope->Define(Symbol::Intern("vector="), runtime::New<VectorEqual>());
+    global_scope->Define(Symbol::Intern("vector<"), runtime::New<VectorLess>());
+    global_scope->Define(Symbol::Intern("vector>"), runtime::New<VectorGreater>());
+    global_scope->Define(Symbol::Intern("vector<="), runtime::New<VectorLessEq>());
+    global_scope->Define(Symbol::Intern("vector>="), runtime::New<VectorGreaterEq>());
+    global_scope->Define(Symbol::Intern("if"), runtime::New<If>());
+    global_scope->Define(Symbol::Intern("symbol?"), runtime::New<SymbolPredicate>());
+    global_scope->Define(Symbol::Intern("define"), runtime::New<Define>());
+    global_scope->Define(Symbol::Intern("set!"), runtime::New<Set>());
+    global_scope->Define(Symbol::Intern("set-car!"), runtime::New<SetCar>());
+    global_scope->Define(Symbol::Intern("set-cdr!"), runtime::New<SetCdr>());
+    global_scope->Define(Symbol::Intern("lambda"), runtime::New<Lambda>());
+    global_scope->Define(Symbol::Intern("future"), runtime::New<FutureForm>());
+    global_scope->Define(Symbol::Intern("touch"), runtime::New<Touch>());
+    global_scope->Define(Symbol::Intern("parallel-map"), runtime::New<ParallelMap>());
+    global_scope->Define(Symbol::Intern("parallel-for-each"), runtime::New<ParallelForEach>());
 
     return global_scope;
 }
\ No newline at end of file
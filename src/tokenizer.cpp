@@ -1,59 +1,173 @@
 #include <tokenizer.h>
+#include <charconv>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include "error.h"
 
-Tokenizer::Tokenizer(std::istream* in) : in_(in) {
+#if defined(__SSE2__)
+#define TOKENIZER_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Position of the first token start at or after pos.
+size_t SkipToTokenStart(std::string_view input, size_t pos) {
+    while (pos < input.size() && !IsValidTokenStart(input[pos])) {
+        ++pos;
+#ifdef TOKENIZER_SSE2
+        // Whitespace comes in runs (indentation, line breaks), so it is skipped in blocks:
+        // bytes up to the space, and above 0x7f as signed ones, never start a token.
+        const __m128i space = _mm_set1_epi8(' ');
+        while (pos + 16 <= input.size()) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input.data() + pos));
+            int candidates = _mm_movemask_epi8(_mm_cmpgt_epi8(block, space));
+            if (candidates != 0) {
+                pos += __builtin_ctz(candidates);
+                break;
+            }
+            pos += 16;
+        }
+#endif
+    }
+    return pos;
+}
+
+// Literals of the infinities and of NaN, as Flonum::ToString writes them, and their
+// opposites. Their length doesn't depend on the sign.
+constexpr std::string_view kPositiveInfinity = "+inf.0";
+constexpr std::string_view kNegativeInfinity = "-inf.0";
+constexpr std::string_view kPositiveNaN = "+nan.0";
+constexpr std::string_view kNegativeNaN = "-nan.0";
+
+}  // namespace
+
+Tokenizer::Tokenizer(std::string_view input) : input_(input) {
     Next();
 }
 
 bool Tokenizer::IsEnd() {
-    return in_->peek() == EOF;
+    return pos_ == input_.size();
 }
 
 void Tokenizer::Next() {
     empty_ = true;
-    while (!IsEnd()) {
-        char symbol = in_->peek();
-        if (IsValidTokenStart(symbol)) {
-            break;
-        }
-        in_->get();
-    }
+    pos_ = SkipToTokenStart(input_, pos_);
+}
+
+char Tokenizer::Peek() const {
+    return pos_ < input_.size() ? input_[pos_] : '\0';
 }
 
 Token Tokenizer::GetTokenMove() {
-    char first_symbol = in_->peek();
-    if (IsOneSymbolToken(first_symbol)) {
-        in_->get();
-        return kOneSymbolMapping.at(first_symbol);
+    if (IsEnd()) {
+        // Not a bracket, so a list missing its close bracket is reported as such.
+        return Token{SymbolToken{}};
+    }
+    size_t start = pos_;
+    char first_symbol = input_[pos_++];
+    // Fractions without an integer part: .5, -.5.
+    size_t dot = IsSign(first_symbol) ? pos_ : start;
+    if (dot + 1 < input_.size() && input_[dot] == token_symbols::one_symbol_tokens::kDot &&
+        IsDigit(input_[dot + 1])) {
+        pos_ = dot;
+        return ReadFlonum(start);
+    }
+    switch (first_symbol) {
+        case token_symbols::one_symbol_tokens::kOpenParen:
+            return Token{BracketToken::OPEN};
+        case token_symbols::one_symbol_tokens::kCloseParen:
+            return Token{BracketToken::CLOSE};
+        case token_symbols::one_symbol_tokens::kDot:
+            return Token{DotToken{}};
+        case token_symbols::one_symbol_tokens::kQuote:
+            return Token{QuoteToken{}};
+    }
+    if (first_symbol == token_symbols::special_symbols::kHash &&
+        Peek() == token_symbols::one_symbol_tokens::kOpenParen) {
+        ++pos_;
+        return Token{BracketToken::OPEN_VECTOR};
     }
-    in_->get();
-    if (IsDigit(first_symbol) || (IsSign(first_symbol) && IsDigit(in_->peek()))) {
-        int sign = 1;
-        int value = 0;
-        if (first_symbol == token_symbols::signs::kMinus) {
-            sign = -1;
-        } else if (!IsSign(first_symbol)) {
+    if (IsDigit(first_symbol) || (IsSign(first_symbol) && IsDigit(Peek()))) {
+        int64_t value = 0;
+        if (IsDigit(first_symbol)) {
             value = first_symbol - token_symbols::digits::kDigitsStart;
         }
-        while (IsDigit(in_->peek())) {
-            char digit = in_->get();
-            value = value * 10 + (digit - token_symbols::digits::kDigitsStart);
+        // Digits are accumulated into value until it overflows, then the literal is kept
+        // as text.
+        bool is_big = false;
+        while (IsDigit(Peek())) {
+            int digit = input_[pos_++] - token_symbols::digits::kDigitsStart;
+            is_big = is_big || __builtin_mul_overflow(value, 10, &value) ||
+                     __builtin_add_overflow(value, digit, &value);
         }
-        return Token{ConstantToken{value * sign}};
+        char next = Peek();
+        if (next == token_symbols::one_symbol_tokens::kDot || next == 'e' || next == 'E') {
+            return ReadFlonum(start);
+        }
+        if (is_big) {
+            return Token{ConstantToken{0, input_.substr(start, pos_ - start)}};
+        }
+        return Token{
+            ConstantToken{first_symbol == token_symbols::signs::kMinus ? -value : value, {}}};
+    }
+    if (IsSign(first_symbol)) {
+        std::string_view text = input_.substr(start, kPositiveInfinity.size());
+        size_t end = start + text.size();
+        if (end == input_.size() || !IsValidTokenSymbol(input_[end])) {
+            if (text == kPositiveInfinity || text == kNegativeInfinity) {
+                pos_ = end;
+                double value = std::numeric_limits<double>::infinity();
+                return Token{FlonumToken{text == kPositiveInfinity ? value : -value}};
+            }
+            if (text == kPositiveNaN || text == kNegativeNaN) {
+                pos_ = end;
+                return Token{FlonumToken{std::numeric_limits<double>::quiet_NaN()}};
+            }
+        }
+        return Token{SymbolToken{input_.substr(start, 1)}};
     }
-    std::string str_token;
-    str_token.push_back(first_symbol);
-    if (str_token == "+" || str_token == "-") {
-        return Token{SymbolToken{str_token}};
+    while (IsValidTokenSymbol(Peek())) {
+        ++pos_;
     }
-    while (!IsEnd()) {
-        char symbol = in_->peek();
-        if (!IsValidTokenSymbol(symbol)) {
-            break;
+    return Token{SymbolToken{input_.substr(start, pos_ - start)}};
+}
+
+Token Tokenizer::ReadFlonum(size_t start) {
+    if (Peek() == token_symbols::one_symbol_tokens::kDot) {
+        ++pos_;
+        while (IsDigit(Peek())) {
+            ++pos_;
         }
-        in_->get();
-        str_token.push_back(symbol);
     }
-    return Token{SymbolToken{str_token}};
+    char exponent = Peek();
+    if (exponent == 'e' || exponent == 'E') {
+        ++pos_;
+        if (IsSign(Peek())) {
+            ++pos_;
+        }
+        if (!IsDigit(Peek())) {
+            throw SyntaxError{"Invalid number"};
+        }
+        while (IsDigit(Peek())) {
+            ++pos_;
+        }
+    }
+    std::string_view text = input_.substr(start, pos_ - start);
+    if (text.front() == token_symbols::signs::kPlus) {
+        text.remove_prefix(1);
+    }
+    double value;
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (error == std::errc::invalid_argument || end != text.data() + text.size()) {
+        throw SyntaxError{"Invalid number"};
+    }
+    // Out of range literals read as infinity or zero.
+    if (error == std::errc::result_out_of_range) {
+        value = std::strtod(std::string{text}.c_str(), nullptr);
+    }
+    return Token{FlonumToken{value}};
 }
 
 Token Tokenizer::GetToken() {
@@ -78,5 +192,9 @@ bool DotToken::operator==(const DotToken&) const {
 }
 
 bool ConstantToken::operator==(const ConstantToken& other) const {
+    return value == other.value && big_value == other.big_value;
+}
+
+bool FlonumToken::operator==(const FlonumToken& other) const {
     return value == other.value;
 }
@@ -0,0 +1,210 @@
+#include "vm.h"
+#include "error.h"
+#include "parallel.h"
+#include "runtime.h"
+
+namespace {
+
+SymbolPtr GlobalName(ObjectPtr constant) {
+    return static_cast<SymbolPtr>(constant);
+}
+
+}  // namespace
+
+// Closure
+
+Closure::Closure(PrototypePtr proto, ScopePtr scope)
+    : Procedure(ObjectType::Closure), proto_(proto), captured_scope_(scope) {
+}
+
+ObjectPtr Closure::Apply(const Args& args) {
+    return VirtualMachine{captured_scope_->GetGlobal()}.Call(this, args);
+}
+
+// End of Closure
+
+// VirtualMachine
+
+VirtualMachine::VirtualMachine(GlobalScopePtr global_scope) : global_scope_(global_scope) {
+}
+
+void VirtualMachine::Trace(Tracer& tracer) {
+    tracer(global_scope_);
+    for (ObjectPtr& obj : stack_) {
+        tracer(obj);
+    }
+    for (CallFrame& frame : frames_) {
+        tracer(frame.proto);
+        tracer(frame.scope);
+    }
+}
+
+ObjectPtr VirtualMachine::Execute(PrototypePtr proto) {
+    frames_.push_back(CallFrame{proto, 0, global_scope_, stack_.size()});
+    return Run();
+}
+
+ObjectPtr VirtualMachine::Call(Closure* closure, const Args& args) {
+    stack_.insert(stack_.end(), args.begin(), args.end());
+    FramePtr frame = MakeFrame(closure, args.size());
+    stack_.resize(stack_.size() - args.size());
+    frames_.push_back(CallFrame{closure->GetPrototype(), 0, frame, stack_.size()});
+    return Run();
+}
+
+FramePtr VirtualMachine::MakeFrame(Closure* closure, size_t args_count) {
+    PrototypePtr proto = closure->GetPrototype();
+    if (args_count != proto->GetParamsCount()) {
+        throw RuntimeError{"Wrong argument number"};
+    }
+    FramePtr frame = Frame::Make(closure->GetScope(), proto->GetSlotsCount(), UnboundSlot());
+    const ObjectPtr* args = stack_.data() + stack_.size() - args_count;
+    for (size_t i = 0; i < args_count; ++i) {
+        frame->SetSlot(i, args[i]);
+    }
+    return frame;
+}
+
+ObjectPtr VirtualMachine::Run() {
+    const Instruction* code;
+    const ObjectPtr* constants;
+    PrototypePtr proto;
+    ScopePtr scope;
+    size_t pc;
+    auto load_frame = [&] {
+        const CallFrame& frame = frames_.back();
+        proto = frame.proto;
+        code = proto->GetCode();
+        constants = proto->GetConstants();
+        scope = frame.scope;
+        pc = frame.pc;
+    };
+    load_frame();
+
+    while (true) {
+        const Instruction& ins = code[pc++];
+        switch (ins.op) {
+            case OpCode::Const:
+                stack_.push_back(constants[ins.arg]);
+                break;
+            case OpCode::Nil:
+                stack_.push_back(nullptr);
+                break;
+            case OpCode::Local:
+            case OpCode::CheckedLocal: {
+                ScopePtr frame = scope;
+                for (uint16_t i = 0; i < ins.depth; ++i) {
+                    frame = frame->GetParent();
+                }
+                ObjectPtr value = static_cast<FramePtr>(frame)->ForReading()->GetSlot(ins.arg);
+                if (ins.op == OpCode::CheckedLocal) {
+                    if (value == UnboundSlot()) {
+                        break;
+                    }
+                    ++pc;
+                }
+                stack_.push_back(value);
+                break;
+            }
+            case OpCode::SetLocal: {
+                ScopePtr frame = scope;
+                for (uint16_t i = 0; i < ins.depth; ++i) {
+                    frame = frame->GetParent();
+                }
+                static_cast<FramePtr>(frame)->ForWriting()->SetSlot(ins.arg, stack_.back());
+                stack_.pop_back();
+                break;
+            }
+            case OpCode::Global:
+                stack_.push_back(global_scope_->Get(GlobalName(constants[ins.arg])));
+                break;
+            case OpCode::SetGlobal:
+                global_scope_->Set(GlobalName(constants[ins.arg]), stack_.back());
+                stack_.pop_back();
+                break;
+            case OpCode::DefineGlobal:
+                global_scope_->Define(GlobalName(constants[ins.arg]), stack_.back());
+                stack_.pop_back();
+                break;
+            case OpCode::DeepCopy:
+                stack_.back() = DeepCopy(stack_.back());
+                break;
+            case OpCode::Future:
+                stack_.back() = MakeFuture(stack_.back());
+                break;
+            case OpCode::Pop:
+                stack_.pop_back();
+                break;
+            case OpCode::Jump:
+                pc = ins.arg;
+                break;
+            case OpCode::JumpIfFalse: {
+                bool value = ToBoolean(stack_.back());
+                stack_.pop_back();
+                if (!value) {
+                    pc = ins.arg;
+                }
+                break;
+            }
+            case OpCode::JumpIfFalseKeep:
+            case OpCode::JumpIfTrueKeep:
+                if (ToBoolean(stack_.back()) == (ins.op == OpCode::JumpIfTrueKeep)) {
+                    pc = ins.arg;
+                } else {
+                    stack_.pop_back();
+                }
+                break;
+            case OpCode::Closure:
+                stack_.push_back(
+                    runtime::New<Closure>(static_cast<PrototypePtr>(constants[ins.arg]), scope));
+                break;
+            case OpCode::Call:
+            case OpCode::TailCall: {
+                size_t callee_index = stack_.size() - ins.arg - 1;
+                ObjectPtr callee = stack_[callee_index];
+                if (Is<Closure>(callee)) {
+                    Closure* closure = As<Closure>(callee);
+                    FramePtr frame = MakeFrame(closure, ins.arg);
+                    stack_.resize(callee_index);
+                    if (ins.op == OpCode::TailCall) {
+                        stack_.resize(frames_.back().base);
+                        frames_.back() = CallFrame{closure->GetPrototype(), 0, frame, stack_.size()};
+                    } else {
+                        frames_.back().pc = pc;
+                        frames_.push_back(
+                            CallFrame{closure->GetPrototype(), 0, frame, stack_.size()});
+                    }
+                    load_frame();
+                    break;
+                }
+                if (!Is<Procedure>(callee)) {
+                    throw RuntimeError{Is<SpecialForm>(callee) ? "Special form is not a procedure"
+                                                               : "Cell is not evaluating"};
+                }
+                Args args(stack_.begin() + callee_index + 1, stack_.end());
+                ObjectPtr res = As<Procedure>(callee)->Apply(args);
+                stack_.resize(callee_index);
+                stack_.push_back(res);
+                if (ins.op == OpCode::Call) {
+                    break;
+                }
+                [[fallthrough]];
+            }
+            case OpCode::Return: {
+                ObjectPtr res = stack_.back();
+                stack_.resize(frames_.back().base);
+                frames_.pop_back();
+                if (frames_.empty()) {
+                    return res;
+                }
+                stack_.push_back(res);
+                load_frame();
+                break;
+            }
+            case OpCode::Raise:
+                Raise(static_cast<ErrorKind>(ins.depth), proto->GetError(ins.arg));
+        }
+    }
+}
+
+// End of VirtualMachine
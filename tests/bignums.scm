@@ -0,0 +1,43 @@
+(define fix-max 4611686018427387903)
+(define fix-min -4611686018427387904)
+(define v (vector 'zero 'one))
+(+ fix-max 1)
+(- fix-min 1)
+(* fix-max 2)
+(* fix-min -1)
+(- 0 fix-min)
+(abs fix-min)
+(* 2147483648 2147483648)
+(* -2147483648 2147483648)
+(* 2147483648 -2147483649)
+(- (+ fix-max 1) 1)
+(vector-ref v (- (+ fix-max 1) fix-max))
+(vector-ref v (+ (- fix-min 1) 4611686018427387905))
+(vector-ref v (- (* fix-max 3) (* fix-max 3)))
+(vector-ref v (+ (* -2147483648 2147483648) fix-max 1))
+(+ (- fix-min 10) (+ fix-max 10))
+(- (+ fix-max 1) (- fix-min 1))
+(* (- fix-min 1) (+ fix-max 1))
+(* (- fix-min 1) (- fix-min 1))
+(= (+ fix-max 1) 4611686018427387904)
+(< (- fix-min 1) fix-min (+ fix-max 1))
+(/ (* fix-max 4) 4)
+99999999999999999999999999999
+-99999999999999999999999999999
+(+ 99999999999999999999999999999 -99999999999999999999999999998)
+(define (fact n) (if (= n 0) 1 (* n (fact (- n 1)))))
+(define (square x) (* x x))
+(define small (+ (fact 150) 12345678901))
+(define large (+ (fact 300) 12345678901))
+(define huge (- (fact 1000) 98765432109))
+(square small)
+(square large)
+(* small (- 0 large))
+(- (square (+ small 1)) (square small) (* 2 small))
+(- (square (+ large 1)) (square large) (* 2 large))
+(- (* (+ huge 1) (- huge 1)) (square huge))
+(- (* huge large) (* large huge))
+(+ (* (- 0 large) huge) (* large huge))
+(- (* (- 0 huge) (- 0 large)) (* huge large))
+(= (/ (* huge large) large) huge)
+(= (/ (square huge) (- 0 huge)) (- 0 huge))
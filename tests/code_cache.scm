@@ -0,0 +1,10 @@
+(define (fact n) (if (= n 0) 1 (* n (fact (- n 1)))))
+(fact 25)
+(define data '(1 (2.5 #t) #(3 4) . x))
+data
+(define (sum l) (if (null? l) 0 (+ (car l) (sum (cdr l)))))
+(sum '(1 2 3 4 5))
+(define counter 0)
+(set! counter (+ counter 1))
+counter
+((lambda (x) (* x x)) 12)
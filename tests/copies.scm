@@ -0,0 +1,16 @@
+(define l (list 1 2 3))
+(set-cdr! (cdr (cdr l)) l)
+(define m l)
+m
+(set-car! m 10)
+(list (car l) (car m) (car (cdr (cdr (cdr m)))))
+(set! m (cons 0 l))
+(set-car! (cdr m) 20)
+(list (car l) (car (cdr m)) (car (cdr (cdr (cdr (cdr m))))))
+(define s (list 1 2))
+(define t (cons s s))
+(set-car! (car t) 30)
+(list s t)
+(define v (vector l))
+(set-car! (vector-ref v 0) 40)
+(car l)
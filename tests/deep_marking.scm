@@ -0,0 +1,6 @@
+(define (nest n acc) (if (= n 0) acc (nest (- n 1) (list acc))))
+(define (depth d n) (if (null? d) n (depth (car d) (+ n 1))))
+(define deep (nest 10000000 '()))
+(depth deep 0)
+(set! deep (nest 10 deep))
+(depth deep 0)
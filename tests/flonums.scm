@@ -0,0 +1,9 @@
+(define computed (list (/ 1.0 3) (* 1e300 1e300) (- 0 (* 1e300 1e300)) (- (* 1e300 1e300) (* 1e300 1e300)) (+ 0.1 0.2) (* 1e20 10) (/ 1.0 10000000) (* -1.0 0) (/ 5e-300 1e24) (* 1.7976931348623157 1e308) (/ 1.0 2)))
+computed
+(define written '(0.3333333333333333 +inf.0 -inf.0 +nan.0 0.30000000000000004 1e+21 1e-07 -0.0 5e-324 1.7976931348623157e+308 .5))
+written
+(define (nan? x) (not (= x x)))
+(define (same? a b) (if (null? a) (null? b) (if (or (= (car a) (car b)) (and (nan? (car a)) (nan? (car b)))) (same? (cdr a) (cdr b)) #f)))
+(same? computed written)
+(list +inf.0 -inf.0 -nan.0 -.5 +.25 '(.5 . .5))
+(+ .5 -inf.0 1)
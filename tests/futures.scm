@@ -0,0 +1,22 @@
+(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))
+(define bad (future (car '())))
+(define slow (future (fib 20)))
+(touch (future (+ 1 2)))
+(touch slow)
+(touch (future (+ 1 (touch slow))))
+(define fs (list bad slow))
+(touch (future (touch (car (cdr fs)))))
+(touch (touch (future (future (fib 10)))))
+(touch (vector-ref (touch (future (vector (future 3)))) 0))
+(define (helper x) (* x 10))
+(define (f x) (helper x))
+(touch (future (f 4)))
+(define g (future (lambda () (helper 2))))
+(touch (future ((touch g))))
+(define c 0)
+(touch (future (set! c 5) c))
+c
+(touch (future c))
+(touch 7)
+(define late (future (touch (car fs))))
+(touch late)
@@ -0,0 +1,117 @@
+#include <charconv>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "scheme.h"
+
+// Runs threads x interpreters interpreters, each thread switching between its own after
+// every step, and compares everything they print with the same interpreters run one by
+// one. Every interpreter binds the same names to values of its own and keeps its
+// collector busy, so a heap, a scope stack or a binding shared by mistake shows up as a
+// different output, or as a race under ThreadSanitizer.
+
+namespace {
+
+constexpr size_t kDefaultThreads = 8;
+constexpr size_t kDefaultInterpreters = 4;
+constexpr size_t kRounds = 10;
+
+class Worker {
+public:
+    explicit Worker(size_t id)
+        : id_(std::to_string(id)),
+          interpreter_(id % 2 == 0 ? EvalMode::Bytecode : EvalMode::TreeWalk) {
+        interpreter_.Run("(define id " + id_ + ")");
+        interpreter_.Run(
+            "(define (build n acc) (if (= n 0) acc "
+            "(build (- n 1) (cons (list n 'sym" + id_ + " 1.5 100000000000000000000 id) acc))))");
+        interpreter_.Run("(define (len l acc) (if (null? l) acc (len (cdr l) (+ acc 1))))");
+        interpreter_.Run("(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))");
+    }
+
+    void Step(size_t round) {
+        std::string value = std::to_string(round);
+        output_ += interpreter_.Run("(len (build 5000 '()) 0)") + ' ';
+        output_ += interpreter_.Run("(fib 12)") + ' ';
+        output_ += interpreter_.Run("(car (build 1 '()))") + ' ';
+        interpreter_.Run("(define v (make-vector 1000 (+ id " + value + ")))");
+        output_ += interpreter_.Run("(vector-sum v)") + ' ';
+        interpreter_.Run("(set! id (+ id 1))");
+        output_ += interpreter_.Run("id") + '\n';
+    }
+
+    const std::string& GetOutput() const {
+        return output_;
+    }
+
+private:
+    std::string id_;
+    Interpreter interpreter_;
+    std::string output_;
+};
+
+// Outputs of the interpreters of thread, in order.
+std::vector<std::string> RunThread(size_t thread, size_t interpreters) {
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (size_t i = 0; i < interpreters; ++i) {
+        workers.push_back(std::make_unique<Worker>(thread * interpreters + i));
+    }
+    for (size_t round = 0; round < kRounds; ++round) {
+        for (auto& worker : workers) {
+            worker->Step(round);
+        }
+    }
+    std::vector<std::string> outputs;
+    for (auto& worker : workers) {
+        outputs.push_back(worker->GetOutput());
+    }
+    return outputs;
+}
+
+size_t ParseCount(std::string_view arg, size_t default_count) {
+    size_t count = default_count;
+    std::from_chars(arg.data(), arg.data() + arg.size(), count);
+    return count;
+}
+
+}  // namespace
+
+// Usage: interpreters_stress [threads] [interpreters per thread]
+int main(int argc, char** argv) {
+    size_t threads_count = argc > 1 ? ParseCount(argv[1], kDefaultThreads) : kDefaultThreads;
+    size_t interpreters =
+        argc > 2 ? ParseCount(argv[2], kDefaultInterpreters) : kDefaultInterpreters;
+
+    std::vector<std::vector<std::string>> expected;
+    for (size_t thread = 0; thread < threads_count; ++thread) {
+        expected.push_back(RunThread(thread, interpreters));
+    }
+
+    std::vector<std::vector<std::string>> outputs(threads_count);
+    std::vector<std::thread> threads;
+    for (size_t thread = 0; thread < threads_count; ++thread) {
+        threads.emplace_back(
+            [&outputs, thread, interpreters] { outputs[thread] = RunThread(thread, interpreters); });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (size_t thread = 0; thread < threads_count; ++thread) {
+        for (size_t i = 0; i < interpreters; ++i) {
+            if (outputs[thread][i] != expected[thread][i]) {
+                std::cerr << "Interpreter " << i << " of thread " << thread
+                          << " differs from the serial run:\n"
+                          << outputs[thread][i] << "expected:\n"
+                          << expected[thread][i];
+                return 1;
+            }
+        }
+    }
+    std::cout << threads_count << " threads x " << interpreters << " interpreters ok"
+              << std::endl;
+    return 0;
+}
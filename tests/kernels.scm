@@ -0,0 +1,21 @@
+(define (iota n acc) (if (= n 0) acc (iota (- n 1) (cons (- n 1) acc))))
+(define v9 (list->vector (iota 9 '())))
+(define v17 (list->vector (iota 17 '())))
+(define big 4611686018427387903)
+(list (vector-sum v9) (vector-sum v17) (vector-min v17) (vector-max v17))
+(list (vector-dot v9 v9) (vector-add v9 v9) (vector-scale v9 -2))
+(vector-sum (vector big big 1 2 3 4 5 6 7))
+(vector-add (vector big 1 2 3 4) (vector 1 1 1 1 1))
+(vector-dot (vector big 2 3 4 5) (vector 2 2 2 2 2))
+(vector-scale (vector 1 2 3 big) 2)
+(define d9 (vector 0.5 -1.5 2.25 8.0 -4.0 3 4 5.5 -0.0))
+(list (vector-sum d9) (vector-min d9) (vector-max d9) (vector-dot d9 d9))
+(vector-scale d9 0.5)
+(vector-add d9 v9)
+(list (vector= v9 d9) (vector< v9 d9) (vector> v9 d9) (vector<= v9 v9) (vector>= d9 d9))
+(define n9 (vector 1.0 2.0 3.0 4.0 +nan.0 -inf.0 6.0 7.0 8.0))
+(list (vector-min n9) (vector-max n9) (vector-sum n9) (vector= n9 n9) (vector< n9 v9))
+(list (vector-min (vector +nan.0 1.0)) (vector-max (vector 1.0 +nan.0)) (vector-min (vector 1 +nan.0)))
+(list (min +nan.0 1.0) (min 1.0 +nan.0) (max 2 +nan.0 1) (min 1 -inf.0 +inf.0))
+(list (vector-min (vector 3 1.5 +inf.0 -inf.0 2)) (vector-max (vector 1e300 -1e300 1 2 3 4 5 6 7)))
+(vector-max (vector 100000000000000000000 1.5 2))
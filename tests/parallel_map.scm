@@ -0,0 +1,21 @@
+(define (range n acc) (if (= n 0) acc (range (- n 1) (cons n acc))))
+(define (square x) (* x x))
+(define bad (future (car '())))
+(parallel-map square '(1 2 3 4))
+(parallel-map + '(1 2 3) '(10 20 30 40))
+(parallel-map square '())
+(define xs (parallel-map square (range 100 '())))
+(list-ref xs 99)
+(vector-sum (list->vector xs))
+(parallel-map (lambda (x) (parallel-map square (list x x))) '(1 2 3))
+(parallel-map (lambda (f) (touch f)) (list (future 1) (future 2)))
+(define c 0)
+(parallel-map (lambda (x) ((lambda (old) (set! c x) old) c)) (range 16 '()))
+(parallel-for-each (lambda (x) (set! c x)) (range 100 '()))
+c
+(define (boxes n acc) (if (= n 0) acc (boxes (- n 1) (cons (list n) acc))))
+(define (churn n) (if (= n 0) 0 ((lambda (c) (churn (- n 1))) (list n n))))
+(define boxed (boxes 40 '()))
+(define (unbox-wiping x) (set-cdr! boxed '()) (churn 1000) (car x))
+(parallel-map (lambda (k) (parallel-map unbox-wiping boxed)) '(1 2))
+(parallel-map (lambda (x) (if (= x 50) (car '()) x)) (range 100 '()))
@@ -0,0 +1,78 @@
+# Runs SCRIPT with INTERPRETER in MODE and --cache in a fresh copy under WORK_DIR: the first
+# run writes the cache, the next ones load it. Its output must match EXPECTED each time,
+# after the source is edited and after the cache is damaged too, and a cache which can't be
+# written must not fail the script.
+set(source ${WORK_DIR}/${MODE}/script.scm)
+set(cache ${source}c)
+file(REMOVE_RECURSE ${WORK_DIR}/${MODE})
+file(MAKE_DIRECTORY ${WORK_DIR}/${MODE})
+configure_file(${SCRIPT} ${source} COPYONLY)
+file(READ ${EXPECTED} expected)
+
+function(run step)
+    execute_process(COMMAND ${INTERPRETER} --${MODE} --print --cache ${ARGN} ${source}
+                    OUTPUT_VARIABLE output
+                    ERROR_VARIABLE output
+                    RESULT_VARIABLE result)
+    if(NOT result EQUAL 0 OR NOT output STREQUAL expected)
+        message(FATAL_ERROR "${step}: ${SCRIPT} failed: ${result}\n${output}")
+    endif()
+endfunction()
+
+# Overwrites the byte at offset of the cache with another one.
+function(flip_byte offset)
+    file(READ ${cache} byte OFFSET ${offset} LIMIT 1 HEX)
+    if(byte STREQUAL "5a")
+        file(WRITE ${WORK_DIR}/${MODE}/byte "Y")
+    else()
+        file(WRITE ${WORK_DIR}/${MODE}/byte "Z")
+    endif()
+    execute_process(COMMAND dd if=${WORK_DIR}/${MODE}/byte of=${cache} bs=1 seek=${offset}
+                            count=1 conv=notrunc
+                    RESULT_VARIABLE result ERROR_QUIET)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "Can't change ${cache}")
+    endif()
+endfunction()
+
+function(expect_cache step hash)
+    if(NOT EXISTS ${cache})
+        message(FATAL_ERROR "${step}: no ${cache}")
+    endif()
+    file(SHA256 ${cache} actual)
+    if(NOT actual STREQUAL hash)
+        message(FATAL_ERROR "${step}: ${cache} wasn't rewritten")
+    endif()
+endfunction()
+
+run("Parse")
+file(SHA256 ${cache} parsed)
+run("Load")
+expect_cache("Load" ${parsed})
+
+# A stale cache is replaced.
+file(APPEND ${source} "(+ 1 2)\n")
+string(APPEND expected "=> 3\n")
+run("Edited source")
+file(SHA256 ${cache} edited)
+if(edited STREQUAL parsed)
+    message(FATAL_ERROR "Edited source: ${cache} wasn't rewritten")
+endif()
+run("Load edited")
+
+# Damaged caches are parsed again and replaced by the same cache.
+flip_byte(0)
+run("Damaged header")
+expect_cache("Damaged header" ${edited})
+file(SIZE ${cache} size)
+math(EXPR middle "${size} / 2")
+flip_byte(${middle})
+run("Damaged image")
+expect_cache("Damaged image" ${edited})
+execute_process(COMMAND dd if=${cache} of=${cache}.part bs=60 count=1
+                RESULT_VARIABLE result ERROR_QUIET)
+file(RENAME ${cache}.part ${cache})
+run("Truncated")
+expect_cache("Truncated" ${edited})
+
+run("Unwritable" --cache-dir=${WORK_DIR}/${MODE}/missing)
@@ -0,0 +1,13 @@
+# Runs SCRIPT with INTERPRETER in MODE and compares its output with EXPECTED. Exit code 1
+# means the script raised an error, which must be in the expected output too.
+execute_process(COMMAND ${INTERPRETER} --${MODE} --print ${ARGS} ${SCRIPT}
+                OUTPUT_VARIABLE output
+                ERROR_VARIABLE output
+                RESULT_VARIABLE result)
+if(NOT result EQUAL 0 AND NOT result EQUAL 1)
+    message(FATAL_ERROR "${SCRIPT} failed: ${result}\n${output}")
+endif()
+file(READ ${EXPECTED} expected)
+if(NOT output STREQUAL expected)
+    message(FATAL_ERROR "Output of ${SCRIPT} differs from ${EXPECTED}:\n${output}")
+endif()
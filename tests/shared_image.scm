@@ -0,0 +1,22 @@
+(counter)
+(counter)
+(define other (make-counter))
+(other)
+(counter)
+((car (cdr account)) 5)
+((car account))
+((deposit-later) 7)
+((car account))
+(define (helper x) x)
+(adder 1)
+(adder 2)
+(touch (future (counter)))
+(counter)
+(parallel-map (lambda (x) (counter)) '(1 2 3 4))
+(touch (future ((car (cdr account)) 1000)))
+((car account))
+(touch (future (adder 3)))
+((car (cdr box)) (list 1 2 3))
+(touch (future ((car box))))
+(set! counter 5)
+counter
@@ -0,0 +1,10 @@
+(define (make-counter) ((lambda (n) (lambda () (set! n (+ n 1)) n)) 0))
+(define counter (make-counter))
+(counter)
+(define (make-account balance) (list (lambda () balance) (lambda (x) (set! balance (+ balance x)) balance)))
+(define account (make-account 100))
+(define (helper x) (* x 10))
+(define (make-adder) ((lambda (total) (lambda (x) (set! total (+ total (helper x))) total)) 0))
+(define adder (make-adder))
+(define (deposit-later) (lambda (x) ((car (cdr account)) x)))
+(define box ((lambda (v) (list (lambda () v) (lambda (x) (set! v x)))) '()))
@@ -0,0 +1,15 @@
+(define (count n) (if (= n 0) 'done (count (- n 1))))
+(count 1000000)
+(define (count-and n) (and (> n -1) (if (= n 0) 'done (count-and (- n 1)))))
+(count-and 100000)
+(define (count-or n) (or (= n 0) (count-or (- n 1))))
+(count-or 100000)
+(define (nested n) (or #f (and 1 (if (> n 0) (nested (- n 1)) 'end))))
+(nested 100000)
+(define (sum n acc) (set! acc (+ acc n)) (if (= n 0) acc (sum (- n 1) acc)))
+(sum 100000 0)
+(define (even? n) (if (= n 0) #t (odd? (- n 1))))
+(define (odd? n) (if (= n 0) #f (even? (- n 1))))
+(list (even? 100000) (odd? 100001) (even? 99999))
+(define (through-lambda n) (if (= n 0) 'done ((lambda (m) (through-lambda m)) (- n 1))))
+(through-lambda 100000)
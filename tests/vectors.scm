@@ -0,0 +1,8 @@
+(define v (make-vector 1000000 7))
+(define w (vector 1 (list 2 3) #(4 5)))
+(vector-set! v 999999 w)
+(vector-length v)
+(vector-ref v 999999)
+(vector-ref v 0)
+(list->vector (vector->list w))
+(make-vector 4611686018427387903)